@@ -0,0 +1,507 @@
+/*!
+ * @file fault_bench.cpp
+ *
+ * Recovery under injected faults. Runs three paths of the library against
+ * an emulated module, each under a set of fault profiles, with a
+ * FaultTransport on both directions of a simulated 9600 baud link (virtual
+ * time, so an hour runs in about a second):
+ *
+ *   decoder     a stream of module packets through the faults into
+ *               FrameParser: share of packets decoded intact, packets lost
+ *               per injected fault, time to the next intact packet after a
+ *               loss, packets received twice, and packets accepted that
+ *               were never sent (false frames, per million accepted)
+ *   retransmit  stop-and-wait commands with feedback, resent on 0x40 or on
+ *               an RttTable timeout up to 3 times: confirmed commands per
+ *               second, mean and p99 time to the ACK, commands given up,
+ *               commands the module executed twice, false frames
+ *   watchdog    status queries every second and volume changes every 10 s
+ *               under Watchdog, while outages brown the module out (it
+ *               reboots when power returns): outages, lock-ups detected and
+ *               false detections, mean and max time from detection to the
+ *               replayed state, share of seconds the module had the volume
+ *               the host set
+ *
+ * build: g++ -std=c++17 -O2 -Isrc extras/bench/fault_bench.cpp
+ *            src/DFPlayerMini.cpp src/DFPlayerMiniFault.cpp
+ *            src/DFPlayerMiniPacer.cpp src/DFPlayerMiniRtt.cpp
+ *            src/DFPlayerMiniState.cpp src/DFPlayerMiniWatchdog.cpp
+ *            -o fault_bench
+ *
+ * usage: fault_bench [hours] [seed]
+ *
+ */
+
+#include "DFPlayerMiniFault.hpp"
+#include "DFPlayerMiniRtt.hpp"
+#include "DFPlayerMiniWatchdog.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+constexpr uint32_t BYTE_US =
+    LINK::BITS_PER_BYTE * 1000000u / LINK::DEFAULT_BAUD;
+constexpr uint32_t TURNAROUND_MIN = 10000; // us
+constexpr uint32_t TURNAROUND_MAX = 30000; // us
+constexpr uint32_t INIT_US = 1500000;      // boot time after power returns
+constexpr uint32_t MIN_RTT_MS = 2 * PACKET::SIZE * BYTE_US / 1000;
+constexpr uint8_t MAX_RETRIES = 3;
+constexpr uint32_t DECODER_PACKETS = 1000000;
+
+struct profile_t {
+  const char *name;
+  fault_profile_t faults;
+};
+
+// drop flip garbage truncate duplicate spike outage stall(ms)
+const profile_t PROFILES[] = {
+    {"clean", {0, 0, 0, 0, 0, 0, 0, 0}},
+    {"noisy", {300, 1000, 0, 0, 0, 0, 0, 0}},
+    {"garbage", {0, 0, 5000, 0, 0, 0, 0, 0}},
+    {"truncate", {0, 0, 0, 20000, 0, 0, 0, 0}},
+    {"duplicate", {0, 0, 0, 0, 20000, 0, 0, 0}},
+    {"spikes", {0, 0, 0, 0, 0, 10000, 0, 300}},
+    {"brownout", {0, 0, 0, 0, 0, 0, 2000, 2000}},
+    {"mixed", {300, 1000, 1000, 5000, 5000, 5000, 1000, 1000}}};
+
+/** Virtual time */
+uint64_t g_us = 0;
+uint32_t clockMs() { return static_cast<uint32_t>(g_us / 1000); }
+
+uint32_t key(const stack_t &_stack) {
+  return (uint32_t(_stack.command) << 24) | (uint32_t(_stack.feedback) << 16) |
+         (uint32_t(_stack.paramMSB) << 8) | _stack.paramLSB;
+}
+
+/** Packet with a raw 16 bit parameter, as the module sends them */
+void packet(stack_t &_stack, uint8_t cmd, uint16_t value) {
+  DFPlayerMini::encode(_stack, PACKET::FEEDBACK::NO, cmd);
+  _stack.paramMSB = static_cast<uint8_t>(value >> 8);
+  _stack.paramLSB = static_cast<uint8_t>(value);
+  uint16_t checksum = DFPlayerMini::calChecksum(_stack);
+  _stack.checksumMSB = static_cast<uint8_t>(checksum >> 8);
+  _stack.checksumLSB = static_cast<uint8_t>(checksum);
+}
+
+/** One direction of the UART, bytes arrive after their wire time */
+class Wire : public Transport {
+  std::deque<std::pair<uint64_t, uint8_t>> _bytes;
+  uint64_t _free = 0;
+
+public:
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t i = 0; i < len; i++) {
+      _free = std::max(_free, g_us) + BYTE_US;
+      _bytes.push_back({_free, buf[i]});
+    }
+    return len;
+  }
+  bool read(uint8_t &c) {
+    if (_bytes.empty() || _bytes.front().first > g_us)
+      return false;
+    c = _bytes.front().second;
+    _bytes.pop_front();
+    return true;
+  }
+};
+
+/** Both directions of a link to an emulated module */
+struct link_t {
+  Wire toModule;
+  Wire toHost;
+  FaultTransport host;   // host -> module, outages brown the module out
+  FaultTransport module; // module -> host
+  std::unordered_set<uint32_t> hostSent;
+  std::unordered_set<uint32_t> moduleSent;
+
+  link_t(const fault_profile_t &faults, uint32_t seed)
+      : host(toModule, clockMs, faults, seed),
+        module(toHost, clockMs, replyFaults(faults), seed * 7 + 1) {}
+
+  static fault_profile_t replyFaults(fault_profile_t faults) {
+    faults.outage = 0;
+    return faults;
+  }
+
+  void send(const stack_t &_stack) {
+    hostSent.insert(key(_stack));
+    host.write(reinterpret_cast<const uint8_t *>(&_stack), PACKET::SIZE);
+  }
+};
+
+/** Emulated module */
+class Module {
+  link_t &_link;
+  FrameParser _parser;
+  std::deque<std::pair<uint64_t, stack_t>> _out;
+  uint64_t _bootAt = 0;
+  uint32_t _random;
+  uint32_t _lastKey = 0;
+  bool _dark = false;
+
+  void answer(uint8_t cmd, uint16_t value) {
+    stack_t _stack;
+    packet(_stack, cmd, value);
+    _random = _random * 1103515245u + 12345u;
+    uint64_t due = std::max(g_us, _out.empty() ? 0 : _out.back().first) +
+                   TURNAROUND_MIN +
+                   (_random >> 8) % (TURNAROUND_MAX - TURNAROUND_MIN);
+    _out.push_back({due, _stack});
+  }
+
+  void boot() {
+    _bootAt = g_us + INIT_US;
+    _out.clear();
+    _parser.reset();
+    volume = DEFAULTS::VOLUME;
+    _out.push_back({_bootAt, {}});
+    packet(_out.back().second, QUERYCMD::SEND_INIT, 0x02);
+  }
+
+  void handle(const stack_t &_stack) {
+    uint32_t k = key(_stack);
+    if (!_link.hostSent.count(k))
+      falseFrames++;
+    if (k == _lastKey && _stack.command == CONTROLCMD::PLAY_TRACK)
+      duplicates++;
+    _lastKey = k;
+    executed++;
+
+    uint16_t first;
+    uint16_t second;
+    DFPlayerMini::decode(_stack, first, second);
+    switch (_stack.command) {
+    case CONTROLCMD::SET_VOL:
+      volume = static_cast<uint8_t>(first);
+      break;
+    case CONTROLCMD::MODE_RESET:
+      boot();
+      return;
+    case QUERYCMD::GET_VOL:
+      answer(QUERYCMD::GET_VOL, volume);
+      return;
+    case QUERYCMD::GET_STATUS_:
+      answer(QUERYCMD::GET_STATUS_, 0x0201);
+      return;
+    }
+    if (_stack.feedback == PACKET::FEEDBACK::YES)
+      answer(QUERYCMD::REPLY, 0);
+  }
+
+public:
+  uint8_t volume = DEFAULTS::VOLUME;
+  uint64_t executed = 0;
+  uint64_t duplicates = 0;
+  uint64_t falseFrames = 0;
+
+  Module(link_t &link, uint32_t seed) : _link(link), _random(seed) {}
+
+  bool dark() const { return _dark; }
+
+  void tick() {
+    bool down = _link.host.down();
+    if (down && !_dark) {
+      _dark = true;
+      _out.clear();
+    } else if (!down && _dark) {
+      _dark = false;
+      boot();
+    }
+
+    uint8_t c;
+    while (_link.toModule.read(c))
+      if (!_dark && g_us >= _bootAt && _parser.parse(c))
+        handle(_parser.getStack());
+
+    while (!_dark && !_out.empty() && _out.front().first <= g_us) {
+      const stack_t &_stack = _out.front().second;
+      _link.moduleSent.insert(key(_stack));
+      _link.module.write(reinterpret_cast<const uint8_t *>(&_stack),
+                         PACKET::SIZE);
+      _out.pop_front();
+    }
+    _link.module.poll();
+    _link.host.poll();
+  }
+};
+
+/** Decoder path */
+void decoder(const profile_t &profile, uint32_t seed) {
+  FaultInjector faults(profile.faults, seed);
+  FrameParser parser;
+  std::vector<uint64_t> starts(DECODER_PACKETS);
+  uint8_t out[FAULT::EXPANSION * PACKET::SIZE];
+
+  uint64_t offset = 0;
+  uint64_t decoded = 0;
+  uint64_t accepted = 0;
+  uint64_t falseFrames = 0;
+  uint64_t repeats = 0;
+  uint64_t bursts = 0;
+  uint64_t burstBytes = 0;
+  uint32_t next = 0; // first packet not yet decoded or lost
+
+  for (uint32_t i = 0; i < DECODER_PACKETS; i++) {
+    stack_t _stack;
+    packet(_stack, QUERYCMD::GET_FOLDER_FILES + i % 2,
+           static_cast<uint16_t>(i));
+    starts[i] = offset;
+    size_t n = faults.apply(reinterpret_cast<const uint8_t *>(&_stack),
+                            PACKET::SIZE, out);
+
+    for (size_t b = 0; b < n; b++) {
+      offset++;
+      if (!parser.parse(out[b]))
+        continue;
+      accepted++;
+
+      // packets are matched within a window of the recent ones
+      const stack_t &got = parser.getStack();
+      uint16_t first;
+      uint16_t second;
+      DFPlayerMini::decode(got, first, second);
+      uint32_t j = (i & ~0xFFFFu) | first;
+      if (j > i)
+        j -= 0x10000;
+      if (j + 16 < i || got.command != QUERYCMD::GET_FOLDER_FILES + j % 2) {
+        falseFrames++;
+        continue;
+      }
+      if (j < next) { // a packet sent once, received twice
+        repeats++;
+        continue;
+      }
+      if (j > next) {
+        bursts++;
+        burstBytes += offset - starts[next];
+      }
+      decoded++;
+      next = j + 1;
+    }
+  }
+
+  const fault_stats_t &stats = faults.getStats();
+  uint64_t injected = stats.dropped + stats.flipped + stats.garbage +
+                      stats.truncated + stats.duplicated;
+  printf("%-10s %9.3f %9.2f %9.1f %9llu %9.1f\n", profile.name,
+         100.0 * decoded / DECODER_PACKETS,
+         injected ? double(DECODER_PACKETS - decoded) / injected : 0.0,
+         bursts ? burstBytes * BYTE_US / 1000.0 / bursts : 0.0,
+         static_cast<unsigned long long>(repeats),
+         accepted ? falseFrames * 1e6 / accepted : 0.0);
+}
+
+/** Retransmission path */
+void retransmit(const profile_t &profile, uint32_t hours, uint32_t seed) {
+  link_t link(profile.faults, seed);
+  Module module(link, seed);
+  FrameParser parser;
+  Pacer pacer;
+  rtt_t entries[RTT::CLASSES];
+  RttTable rtt(entries, 1);
+  rtt.clear();
+
+  std::vector<uint32_t> latencies;
+  uint64_t gaveUp = 0;
+  uint64_t falseFrames = 0;
+  uint32_t seq = 0;
+  uint32_t firstSent = 0;
+  uint32_t sentAt = 0;
+  uint32_t quietUntil = 0;
+  uint8_t tries = 0; // 0: nothing in flight
+  bool resend = true;
+  stack_t packet;
+
+  uint64_t end = uint64_t(hours) * 3600000000u;
+  for (g_us = 0; g_us < end; g_us += 100) {
+    uint32_t now = clockMs();
+    module.tick();
+
+    uint8_t c;
+    while (link.toHost.read(c)) {
+      if (!parser.parse(c))
+        continue;
+      const stack_t &got = parser.getStack();
+      if (!link.moduleSent.count(key(got)))
+        falseFrames++;
+      if (!tries)
+        continue;
+      // an ACK sooner than both packets' wire time answers an earlier one
+      if (got.command == QUERYCMD::REPLY && now - sentAt >= MIN_RTT_MS) {
+        if (tries == 1)
+          rtt.sample(0, RTT::ACK, static_cast<uint16_t>(now - sentAt));
+        latencies.push_back(now - firstSent);
+        // ACKs carry no sequence number: after a resend, let the ACK of
+        // the other copy arrive before it can confirm the next command
+        if (tries > 1)
+          quietUntil = now + rtt.timeout(0, RTT::ACK);
+        tries = 0;
+      } else if (got.command == QUERYCMD::RETRANSMIT) {
+        resend = true;
+      }
+    }
+
+    if (tries && !resend && now - sentAt >= rtt.timeout(0, RTT::ACK)) {
+      rtt.backoff(0, RTT::ACK);
+      if (tries > MAX_RETRIES) {
+        gaveUp++;
+        quietUntil = now + rtt.timeout(0, RTT::ACK);
+        tries = 0;
+      } else {
+        resend = true;
+      }
+    }
+
+    if (!pacer.ready(now) || !TIME::reached(now, quietUntil))
+      continue;
+    if (!tries) {
+      DFPlayerMini::encode(packet, PACKET::FEEDBACK::YES,
+                           CONTROLCMD::PLAY_TRACK,
+                           static_cast<uint16_t>(seq++ % 2999 + 1));
+      firstSent = now;
+      resend = true;
+    }
+    if (resend) {
+      link.send(packet);
+      pacer.sent(now);
+      sentAt = now;
+      tries++;
+      resend = false;
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  double mean = 0;
+  for (uint32_t latency : latencies)
+    mean += latency;
+  mean = latencies.empty() ? 0 : mean / latencies.size();
+  uint32_t p99 =
+      latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+  printf("%-10s %9.2f %9.1f %9u %9llu %9llu %9llu\n", profile.name,
+         latencies.size() / (hours * 3600.0), mean, p99,
+         static_cast<unsigned long long>(gaveUp),
+         static_cast<unsigned long long>(module.duplicates),
+         static_cast<unsigned long long>(falseFrames + module.falseFrames));
+}
+
+/** Watchdog path */
+void watchdog(const profile_t &profile, uint32_t hours, uint32_t seed) {
+  link_t link(profile.faults, seed);
+  Module module(link, seed);
+  FrameParser parser;
+  Pacer pacer;
+  PlaybackState state;
+  state.clear();
+  Watchdog dog(state, pacer);
+
+  uint8_t volume = 20;
+  uint32_t lastOutage = 0;
+  uint32_t outages = 0;
+  uint32_t failures = 0;
+  uint32_t falseDetections = 0;
+  uint32_t inSync = 0;
+  uint32_t samples = 0;
+  bool volumeDue = true;
+
+  uint64_t end = uint64_t(hours) * 3600000000u;
+  for (g_us = 0; g_us < end; g_us += 100) {
+    uint32_t now = clockMs();
+    module.tick();
+
+    if (link.host.faults().getStats().outages != outages) {
+      outages = link.host.faults().getStats().outages;
+      lastOutage = now;
+    }
+    if (dog.getStats().failures != failures) {
+      failures = dog.getStats().failures;
+      if (!outages || now - lastOutage > 10000)
+        falseDetections++;
+    }
+
+    uint8_t c;
+    while (link.toHost.read(c))
+      if (parser.parse(c)) {
+        state.observeReceived(parser.getStack());
+        dog.notify(parser.getStack(), now);
+      }
+
+    if (g_us % 1000000 == 0) {
+      samples++;
+      inSync += !module.dark() && module.volume == volume;
+    }
+    if (g_us % 10000000 == 0) {
+      volume = volume == 20 ? 10 : 20;
+      volumeDue = true;
+    }
+
+    stack_t packet;
+    if (dog.poll(now, packet)) {
+      link.send(packet);
+      continue;
+    }
+    if (dog.recovering() || !pacer.ready(now))
+      continue;
+
+    if (volumeDue) {
+      DFPlayerMini::encode(packet, PACKET::FEEDBACK::NO, CONTROLCMD::SET_VOL,
+                           volume);
+      volumeDue = false;
+    } else if (g_us % 1000000 == 0) {
+      DFPlayerMini::encode(packet, PACKET::FEEDBACK::NO, QUERYCMD::GET_VOL);
+    } else {
+      continue;
+    }
+    state.observeSent(packet);
+    dog.sent(packet, now);
+    link.send(packet);
+    pacer.sent(now);
+  }
+
+  const watchdog_stats_t &stats = dog.getStats();
+  printf("%-10s %9u %9u %9u %9.0f %9u %9.2f\n", profile.name, outages,
+         stats.failures, falseDetections,
+         stats.recoveries ? double(stats.totalRecovery) / stats.recoveries
+                          : 0.0,
+         stats.maxRecovery, samples ? 100.0 * inSync / samples : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t hours = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1;
+  uint32_t seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+  if (!hours)
+    hours = 1;
+
+  printf("# dfplayer fault bench v1, %u h per profile, seed %u\n", hours,
+         seed);
+
+  printf("\n# decoder, %u packets\n", DECODER_PACKETS);
+  printf("%-10s %9s %9s %9s %9s %9s\n", "profile", "intact%", "lost/flt",
+         "resync_ms", "repeats", "false_ppm");
+  for (const profile_t &profile : PROFILES)
+    decoder(profile, seed);
+
+  printf("\n# retransmit\n");
+  printf("%-10s %9s %9s %9s %9s %9s %9s\n", "profile", "cmds/s", "mean_ms",
+         "p99_ms", "gave_up", "twice", "false");
+  for (const profile_t &profile : PROFILES)
+    retransmit(profile, hours, seed);
+
+  printf("\n# watchdog\n");
+  printf("%-10s %9s %9s %9s %9s %9s %9s\n", "profile", "outages", "detected",
+         "false", "mttr_ms", "max_ms", "in_sync%");
+  for (const profile_t &profile : PROFILES)
+    watchdog(profile, hours, seed);
+  return 0;
+}
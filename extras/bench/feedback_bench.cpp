@@ -0,0 +1,185 @@
+/*!
+ * @file feedback_bench.cpp
+ *
+ * Receive-side link load of the feedback policies. Replays a scripted
+ * jukebox session (tracks started with a fade-in, volume nudges, pause and
+ * resume, a fade-out, a status query every 30 s) through a FrameQueue per
+ * policy and counts what the module sends back: an ACK for every packet
+ * requesting feedback plus the query replies. Reports the bytes received,
+ * how long the module's TX line is busy at 9600 baud and the host time
+ * spent parsing them with FrameParser, relative to requesting feedback for
+ * every packet.
+ *
+ * build: g++ -std=c++17 -O2 -Isrc extras/bench/feedback_bench.cpp
+ *            src/DFPlayerMini.cpp src/DFPlayerMiniFade.cpp
+ *            src/DFPlayerMiniPacer.cpp src/DFPlayerMiniQueue.cpp
+ *            src/DFPlayerMiniTransport.cpp -o feedback_bench
+ *
+ * usage: feedback_bench [hours]
+ *
+ */
+
+#include "DFPlayerMiniFade.hpp"
+#include "DFPlayerMiniQueue.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+constexpr uint32_t TRACK_MS = 240000;
+constexpr uint32_t QUERY_MS = 30000;
+constexpr double FRAME_MS =
+    PACKET::SIZE * LINK::BITS_PER_BYTE * 1000.0 / LINK::DEFAULT_BAUD;
+
+struct policy_t {
+  const char *name;
+  FeedbackPolicy policy;
+};
+
+/** Transport counting the frames the module answers */
+class ModuleTransport : public Transport {
+public:
+  uint64_t sent = 0;
+  uint64_t acks = 0;
+  uint64_t replies = 0;
+
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t i = 0; i + PACKET::SIZE <= len; i += PACKET::SIZE) {
+      stack_t _stack;
+      memcpy(&_stack, buf + i, PACKET::SIZE);
+      sent++;
+      if (_stack.feedback == PACKET::FEEDBACK::YES)
+        acks++;
+      if (_stack.command >= QUERYCMD::GET_STATUS_)
+        replies++;
+    }
+    return len;
+  }
+};
+
+/** Run the session, counting the frames on port */
+void session(FeedbackPolicy policy, uint32_t hours, ModuleTransport &port) {
+  frame_slot_t slots[64];
+  FrameQueue queue(slots, 64, policy);
+  fade_t fades[1];
+  Pacer links[1];
+  Fader fader(fades, 1, links);
+
+  queue.submit(CONTROLCMD::MODE_RESET);
+  queue.submit(CONTROLCMD::SET_PLAYBACK_SRC, PLAYBACK_SRC::TF);
+  queue.submit(CONTROLCMD::SET_EQ, EQ::ROCK);
+
+  uint32_t end = hours * 3600000u;
+  for (uint32_t now = 1; now < end; now++) {
+    uint32_t at = now % TRACK_MS;
+    uint16_t track = static_cast<uint16_t>(now / TRACK_MS % 255 + 1);
+
+    switch (at) {
+    case 0:
+      queue.submit(CONTROLCMD::SET_VOL, 0);
+      queue.submit(CONTROLCMD::PLAY_FOLDER_TRACK, 1, track);
+      fader.start(0, 0, 20, 3000, CURVE::S_CURVE, now);
+      break;
+    case 60000:
+    case 61000:
+      queue.submit(CONTROLCMD::INC_VOL);
+      break;
+    case 90000:
+      queue.submit(CONTROLCMD::DEC_VOL);
+      break;
+    case 120000:
+      queue.submit(CONTROLCMD::PAUSE);
+      break;
+    case 125000:
+      queue.submit(CONTROLCMD::PLAY);
+      break;
+    case 230000:
+      fader.start(0, 21, 0, 10000, CURVE::LINEAR, now);
+      break;
+    }
+    if (now % QUERY_MS == 0)
+      queue.submit(QUERYCMD::GET_STATUS_);
+
+    uint8_t device;
+    stack_t _stack;
+    if (fader.poll(now, device, _stack)) {
+      uint16_t first;
+      uint16_t second;
+      DFPlayerMini::decode(_stack, first, second);
+      queue.submit(_stack.command, first, second);
+    }
+    queue.drain(port);
+  }
+  queue.submit(CONTROLCMD::MODE_STANDBY);
+  queue.drain(port);
+}
+
+/** Host time to parse one received frame, in ns */
+double parseCost() {
+  std::vector<uint8_t> stream;
+  for (uint32_t i = 0; i < 100000; i++) {
+    stack_t _stack;
+    DFPlayerMini::encode(_stack, PACKET::FEEDBACK::NO, QUERYCMD::REPLY,
+                         static_cast<uint16_t>(i));
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&_stack);
+    stream.insert(stream.end(), bytes, bytes + PACKET::SIZE);
+  }
+
+  FrameParser parser;
+  uint32_t frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < 10; round++)
+    for (uint8_t c : stream)
+      frames += parser.parse(c);
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return frames ? elapsed.count() / frames : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t hours = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1;
+  if (!hours)
+    hours = 1;
+
+  const policy_t policies[] = {
+      {"all", FeedbackPolicy(true)},
+      {"critical", FeedbackPolicy(FEEDBACK_CLASS::CRITICAL)},
+      {"playback", FeedbackPolicy(FEEDBACK_CLASS::PLAYBACK)},
+      {"none", FeedbackPolicy(false)}};
+
+  double parse = parseCost();
+  printf("# dfplayer feedback policy bench v1\n");
+  printf("# %u h jukebox session, %.1f ms per frame at %u baud, parse %.1f "
+         "ns per frame\n",
+         hours, FRAME_MS, LINK::DEFAULT_BAUD, parse);
+  printf("%-9s %8s %8s %8s %9s %8s %9s %7s\n", "policy", "tx", "acks",
+         "replies", "rx_bytes", "rx_busy%", "parse_us", "saved%");
+
+  uint64_t baseline = 0;
+  for (const policy_t &entry : policies) {
+    ModuleTransport port;
+    session(entry.policy, hours, port);
+
+    uint64_t received = port.acks + port.replies;
+    uint64_t bytes = received * PACKET::SIZE;
+    if (!baseline)
+      baseline = bytes;
+    printf("%-9s %8llu %8llu %8llu %9llu %8.3f %9.1f %7.1f\n", entry.name,
+           static_cast<unsigned long long>(port.sent),
+           static_cast<unsigned long long>(port.acks),
+           static_cast<unsigned long long>(port.replies),
+           static_cast<unsigned long long>(bytes),
+           received * FRAME_MS * 100.0 / (hours * 3600000.0),
+           received * parse / 1000.0,
+           100.0 * (1.0 - static_cast<double>(bytes) / baseline));
+  }
+  return 0;
+}
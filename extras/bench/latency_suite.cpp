@@ -0,0 +1,516 @@
+/*!
+ * @file latency_suite.cpp
+ *
+ * End-to-end latency under load. Every module is a pty pair: the host side
+ * runs the full stack (encoder, FrameQueue, Pacer, FdTransport, FrameParser,
+ * PollSet, Fader, Announcer) on the master, an emulator thread answers on
+ * the slave with the timing of a real module (processing delay plus wire
+ * time at 9600 baud, ACKs, query replies, track-finished reports after
+ * 0.3 to 0.7 s of playback).
+ *
+ * Each module runs a mixed workload: a storm of 4 play commands every 2 s,
+ * a poll round every 1 s, a fade every 3 s and an announcement every 4 s,
+ * and reacts to every track-finished report with PLAY_NEXT. Measured are
+ * command-to-ACK latency (submission to the ACK reaching the host),
+ * event-to-action latency (report written by the module to the reaction
+ * arriving at it) and the share of link time in use. Error answers in place
+ * of an ACK are counted apart, as are packets still waiting for an ACK when
+ * the run ends.
+ *
+ * The output is stable for comparing releases: one comment header naming
+ * the format version and the columns, then one whitespace-separated line
+ * per device count. Latencies are in us.
+ *
+ * build: g++ -std=c++17 -O2 -pthread -Isrc extras/bench/latency_suite.cpp
+ *            src/DFPlayerMini.cpp src/DFPlayerMiniQueue.cpp
+ *            src/DFPlayerMiniPacer.cpp src/DFPlayerMiniTransport.cpp
+ *            src/DFPlayerMiniPoll.cpp src/DFPlayerMiniRtt.cpp
+ *            src/DFPlayerMiniState.cpp src/DFPlayerMiniFade.cpp
+ *            src/DFPlayerMiniAnnounce.cpp -o latency_suite
+ *
+ * usage: latency_suite [duration ms] [max devices]
+ *
+ */
+
+#include "DFPlayerMiniAnnounce.hpp"
+#include "DFPlayerMiniFade.hpp"
+#include "DFPlayerMiniPoll.hpp"
+#include "DFPlayerMiniQueue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <poll.h>
+#include <random>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+constexpr uint32_t FORMAT_VERSION = 2;
+constexpr uint32_t WIRE_US = 10417;  // one packet at 9600 baud 8N1
+constexpr uint32_t STORM_EVERY = 2000; // ms
+constexpr uint32_t POLL_EVERY = 1000;
+constexpr uint32_t FADE_EVERY = 3000;
+constexpr uint32_t ANNOUNCE_EVERY = 4000;
+constexpr uint32_t SETTLE = 1000; // ms without new work at the end
+
+uint64_t clockUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+bool rawPty(int &master, int &slave) {
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) || unlockpt(master))
+    return false;
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0)
+    return false;
+
+  for (int fd : {master, slave}) {
+    termios tio;
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd, TCSANOW, &tio);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+  return true;
+}
+
+void writeAll(int fd, const uint8_t *buf, size_t len) {
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n > 0) {
+      buf += n;
+      len -= n;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/** Output of the emulated module, due at a time in us */
+struct output_t {
+  uint64_t due;
+  stack_t packet;
+  bool report; // track-finished report the host reacts to
+};
+
+/** Emulated module */
+struct module_t {
+  int fd;
+  FrameParser parser;
+  std::deque<output_t> out;
+  uint64_t busyUntil = 0;
+  uint64_t reportAt = 0;   // pending end of the playing track, 0 if none
+  uint64_t reportedAt = 0; // when the last report was written
+  bool awaiting = false;   // reaction to the last report outstanding
+  bool playing = false;
+};
+
+/** Packet waiting in the FrameQueue, with its submit time in us */
+struct queued_t {
+  uint64_t at;
+  stack_t packet;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Thread answering on the slave side of every pty.
+*/
+/**************************************************************************/
+class Emulator {
+  std::vector<module_t> &_modules;
+  std::atomic<bool> &_stop;
+  std::mt19937 _random{7};
+  std::vector<uint32_t> _reactions;
+
+  void emit(module_t &module, uint64_t now, uint8_t cmd, uint16_t param = 0,
+            bool report = false) {
+    uint64_t start = std::max(now, module.busyUntil);
+    uint64_t due = start + 3000 + _random() % 5000 + WIRE_US;
+    module.busyUntil = due;
+
+    output_t output;
+    DFPlayerMini::encode(output.packet, PACKET::FEEDBACK::NO, cmd, param);
+    output.due = due;
+    output.report = report;
+    module.out.push_back(output);
+  }
+
+  void play(module_t &module, uint64_t now) {
+    module.playing = true;
+    module.reportAt = now + 300000 + _random() % 400000;
+  }
+
+  void handle(module_t &module, const stack_t &packet, uint64_t now) {
+    uint8_t cmd = packet.command;
+
+    if (cmd == CONTROLCMD::PLAY_NEXT && module.awaiting) {
+      _reactions.push_back(static_cast<uint32_t>(now - module.reportedAt));
+      module.awaiting = false;
+    }
+
+    if (cmd == CONTROLCMD::INSERT_ADVERT && !module.playing) {
+      emit(module, now, QUERYCMD::RETRANSMIT, ERROR_CODE::INSERTION);
+      return;
+    }
+    if (packet.feedback)
+      emit(module, now, QUERYCMD::REPLY);
+
+    switch (cmd) {
+    case CONTROLCMD::PLAY_TRACK:
+    case CONTROLCMD::PLAY_NEXT:
+    case CONTROLCMD::PLAY_FOLDER_TRACK:
+    case CONTROLCMD::PLAY_MP3_FOLDER:
+    case CONTROLCMD::PLAY:
+      play(module, now);
+      break;
+    case CONTROLCMD::INSERT_ADVERT:
+      module.reportAt += 500000; // the advert delays the track
+      break;
+    case CONTROLCMD::PAUSE:
+    case CONTROLCMD::STOP:
+      module.playing = false;
+      module.reportAt = 0;
+      break;
+    case QUERYCMD::GET_STATUS_:
+      emit(module, now, cmd, module.playing ? 0x0201 : 0x0200);
+      break;
+    case QUERYCMD::GET_VOL:
+      emit(module, now, cmd, 20);
+      break;
+    case QUERYCMD::GET_TF_TRACK:
+      emit(module, now, cmd, 3);
+      break;
+    default:
+      break;
+    }
+  }
+
+public:
+  Emulator(std::vector<module_t> &modules, std::atomic<bool> &stop)
+      : _modules(modules), _stop(stop) {}
+
+  void run() {
+    std::vector<pollfd> fds(_modules.size());
+    for (size_t i = 0; i < fds.size(); i++)
+      fds[i] = {_modules[i].fd, POLLIN, 0};
+
+    while (!_stop.load(std::memory_order_relaxed)) {
+      uint64_t now = clockUs();
+      uint64_t next = now + 1000;
+
+      for (module_t &module : _modules) {
+        if (module.reportAt && now >= module.reportAt) {
+          module.reportAt = 0;
+          module.playing = false;
+          emit(module, now, REPORT::TF_FINISHED, 1, true);
+        }
+        while (!module.out.empty() && module.out.front().due <= now) {
+          output_t &output = module.out.front();
+          if (output.report) {
+            module.reportedAt = clockUs();
+            module.awaiting = true;
+          }
+          writeAll(module.fd, reinterpret_cast<uint8_t *>(&output.packet),
+                   PACKET::SIZE);
+          module.out.pop_front();
+        }
+        if (!module.out.empty())
+          next = std::min(next, module.out.front().due);
+        if (module.reportAt)
+          next = std::min(next, module.reportAt);
+      }
+
+      int wait = next > now ? static_cast<int>((next - now + 999) / 1000) : 0;
+      if (poll(fds.data(), fds.size(), wait) <= 0)
+        continue;
+
+      now = clockUs();
+      for (size_t i = 0; i < fds.size(); i++) {
+        if (!(fds[i].revents & POLLIN))
+          continue;
+        uint8_t buf[256];
+        ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+        for (ssize_t j = 0; j < n; j++)
+          if (_modules[i].parser.parse(buf[j]))
+            handle(_modules[i], _modules[i].parser.getStack(), now);
+      }
+    }
+  }
+
+  std::vector<uint32_t> &reactions() { return _reactions; }
+};
+
+/** Host side of one module */
+struct device_t {
+  int fd;
+  std::unique_ptr<FdTransport> port;
+  FrameParser parser;
+  PlaybackState state;
+  std::vector<frame_slot_t> slots = std::vector<frame_slot_t>(64);
+  std::unique_ptr<FrameQueue> queue;
+  std::deque<queued_t> submitted; // packets queued, in order
+  std::deque<uint64_t> unacked;   // submit times of packets sent
+  query_t queries[3];
+  std::unique_ptr<PollSet> polls;
+  announcement_t announcements[2];
+  std::unique_ptr<Announcer> announcer;
+  uint32_t frames = 0;
+  uint32_t offset = 0;
+  uint8_t volume = 10;
+};
+
+uint32_t percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[index];
+}
+
+/**************************************************************************/
+/*!
+        @brief  Host loop driving the workload of all devices.
+*/
+/**************************************************************************/
+class Host {
+  std::vector<device_t> &_devices;
+  std::vector<Pacer> &_links;
+  Fader &_fader;
+  std::vector<uint32_t> _acks;
+  uint32_t _lost = 0;   // ACKs with no packet waiting for one
+  uint32_t _errors = 0; // error answers to packets waiting for an ACK
+
+  void submit(device_t &dev, uint8_t cmd, uint16_t param) {
+    queued_t queued;
+    queued.at = clockUs();
+    DFPlayerMini::encode(queued.packet, PACKET::FEEDBACK::YES, cmd, param);
+    if (dev.queue->submit(queued.packet))
+      dev.submitted.push_back(queued);
+  }
+
+  void schedule(device_t &dev, uint8_t index, uint32_t tick, uint32_t now) {
+    uint32_t t = tick + dev.offset;
+
+    if (t % STORM_EVERY == 0)
+      for (uint16_t track = 1; track <= 4; track++)
+        submit(dev, CONTROLCMD::PLAY_TRACK, track);
+    if (t % POLL_EVERY == 0 && dev.polls->done())
+      dev.polls->start(now);
+    if (t % FADE_EVERY == 0) {
+      uint8_t to = dev.volume == 10 ? 25 : 10;
+      _fader.start(index, dev.volume, to, 600, CURVE::S_CURVE, now);
+      dev.volume = to;
+    }
+    if (t % ANNOUNCE_EVERY == 0)
+      dev.announcer->announce(1, 1, 20, now);
+  }
+
+  void send(device_t &dev, const stack_t &packet, uint64_t submitted) {
+    dev.port->write(reinterpret_cast<const uint8_t *>(&packet), PACKET::SIZE);
+    dev.frames++;
+    if (packet.feedback)
+      dev.unacked.push_back(submitted);
+  }
+
+  void transmit(device_t &dev, Pacer &link, uint32_t now) {
+    stack_t packet;
+
+    size_t drained = dev.queue->drain(*dev.port, link, now);
+    for (size_t i = 0; i < drained; i++) {
+      const queued_t &queued = dev.submitted.front();
+      dev.frames++;
+      dev.state.observeSent(queued.packet);
+      dev.unacked.push_back(queued.at);
+      dev.submitted.pop_front();
+    }
+    if (drained)
+      return;
+
+    if (dev.announcer->poll(now, packet))
+      send(dev, packet, clockUs());
+    else if (dev.polls->poll(now, packet))
+      send(dev, packet, clockUs());
+  }
+
+  void receive(device_t &dev, const stack_t &packet, uint32_t now) {
+    uint64_t at = clockUs();
+
+    switch (packet.command) {
+    case QUERYCMD::REPLY:
+      if (dev.unacked.empty()) {
+        _lost++;
+        break;
+      }
+      _acks.push_back(static_cast<uint32_t>(at - dev.unacked.front()));
+      dev.unacked.pop_front();
+      break;
+    case QUERYCMD::RETRANSMIT:
+      // the module answers instead of an ACK, e.g. an advert while idle
+      if (dev.unacked.empty()) {
+        _lost++;
+        break;
+      }
+      _errors++;
+      dev.unacked.pop_front();
+      break;
+    case REPORT::TF_FINISHED:
+      if (!dev.announcer->busy())
+        submit(dev, CONTROLCMD::PLAY_NEXT, 0);
+      break;
+    default:
+      break;
+    }
+
+    dev.state.observeReceived(packet);
+    dev.polls->feed(packet, now);
+    dev.announcer->notify(packet);
+  }
+
+public:
+  Host(std::vector<device_t> &devices, std::vector<Pacer> &links,
+       Fader &fader)
+      : _devices(devices), _links(links), _fader(fader) {}
+
+  void run(uint32_t duration) {
+    std::vector<pollfd> fds(_devices.size());
+    for (size_t i = 0; i < fds.size(); i++)
+      fds[i] = {_devices[i].fd, POLLIN, 0};
+
+    uint64_t start = clockUs();
+    uint32_t tick = 0;
+
+    for (;;) {
+      uint32_t now = static_cast<uint32_t>((clockUs() - start) / 1000);
+      if (now >= duration + SETTLE)
+        break;
+
+      for (; tick <= now && tick < duration; tick++)
+        for (size_t i = 0; i < _devices.size(); i++)
+          schedule(_devices[i], static_cast<uint8_t>(i), tick, now);
+
+      for (size_t i = 0; i < _devices.size(); i++)
+        transmit(_devices[i], _links[i], now);
+
+      uint8_t index;
+      stack_t packet;
+      while (_fader.poll(now, index, packet))
+        send(_devices[index], packet, clockUs());
+
+      if (poll(fds.data(), fds.size(), 1) <= 0)
+        continue;
+
+      for (size_t i = 0; i < fds.size(); i++) {
+        if (!(fds[i].revents & POLLIN))
+          continue;
+        uint8_t buf[256];
+        ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+        for (ssize_t j = 0; j < n; j++)
+          if (_devices[i].parser.parse(buf[j]))
+            receive(_devices[i], _devices[i].parser.getStack(), now);
+      }
+    }
+  }
+
+  std::vector<uint32_t> &acks() { return _acks; }
+  uint32_t lost() const { return _lost; }
+  uint32_t errors() const { return _errors; }
+};
+
+bool run(uint8_t count, uint32_t duration) {
+  std::vector<module_t> modules(count);
+  std::vector<device_t> devices(count);
+  std::vector<Pacer> links(count);
+  std::vector<fade_t> fades(count);
+  Fader fader(fades.data(), count, links.data());
+
+  for (uint8_t i = 0; i < count; i++) {
+    device_t &dev = devices[i];
+    if (!rawPty(dev.fd, modules[i].fd)) {
+      perror("pty");
+      return false;
+    }
+
+    dev.port.reset(new FdTransport(dev.fd));
+    dev.queue.reset(new FrameQueue(dev.slots.data(), dev.slots.size(), true));
+    dev.queries[0].cmd = QUERYCMD::GET_STATUS_;
+    dev.queries[1].cmd = QUERYCMD::GET_VOL;
+    dev.queries[2].cmd = QUERYCMD::GET_TF_TRACK;
+    for (query_t &query : dev.queries)
+      query.param = 0;
+    dev.polls.reset(new PollSet(dev.queries, 3, links[i]));
+    dev.polls->setState(&dev.state);
+    dev.announcer.reset(
+        new Announcer(dev.announcements, 2, dev.state, links[i], true));
+    dev.announcer->setMaxDuration(3000);
+    dev.offset = i * 37u;
+  }
+
+  std::atomic<bool> stop(false);
+  Emulator emulator(modules, stop);
+  std::thread thread([&] { emulator.run(); });
+
+  Host host(devices, links, fader);
+  host.run(duration);
+
+  stop.store(true);
+  thread.join();
+
+  uint64_t frames = 0;
+  size_t unacked = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    frames += devices[i].frames;
+    unacked += devices[i].unacked.size();
+    close(devices[i].fd);
+    close(modules[i].fd);
+  }
+
+  std::vector<uint32_t> &acks = host.acks();
+  std::vector<uint32_t> &events = emulator.reactions();
+  std::sort(acks.begin(), acks.end());
+  std::sort(events.begin(), events.end());
+  double busy = frames * links[0].slotMs();
+  double available = static_cast<double>(count) * (duration + SETTLE);
+
+  printf("%7u %8u %8lu %7zu %9u %9u %9u %7zu %9u %9u %9u %6.1f %5u %6u "
+         "%7zu\n",
+         count, duration, static_cast<unsigned long>(frames), acks.size(),
+         percentile(acks, 0.5), percentile(acks, 0.99),
+         percentile(acks, 0.999), events.size(), percentile(events, 0.5),
+         percentile(events, 0.99), percentile(events, 0.999),
+         100.0 * busy / available, host.lost(), host.errors(), unacked);
+  fflush(stdout);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t duration = argc > 1 ? strtoul(argv[1], nullptr, 0) : 5000;
+  uint32_t maxDevices = argc > 2 ? strtoul(argv[2], nullptr, 0) : 32;
+  if (maxDevices > 128)
+    maxDevices = 128;
+
+  printf("# dfplayer latency suite v%u, workload mixed, us\n", FORMAT_VERSION);
+  printf("# devices duration   frames    acks   ack_p50   ack_p99  ack_p999 "
+         " events  ev_p50    ev_p99   ev_p999  util%%  lost "
+         "errors unacked\n");
+
+  for (uint32_t count = 1; count <= maxDevices; count *= 2)
+    if (!run(static_cast<uint8_t>(count), duration))
+      return 1;
+
+  return 0;
+}
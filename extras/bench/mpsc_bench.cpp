@@ -0,0 +1,158 @@
+/*!
+ * @file mpsc_bench.cpp
+ *
+ * Submission throughput with 1 to 32 producer threads: the lock-free
+ * FrameQueue drained by one writer thread, against a std::mutex around a
+ * shared DFPlayerMini instance that each thread encodes into and writes
+ * from. Both write to a counting in-memory transport, so the numbers are
+ * the cost of submission and hand-off only.
+ *
+ * build: g++ -std=c++17 -O2 -pthread -Isrc extras/bench/mpsc_bench.cpp
+ *            src/DFPlayerMini.cpp src/DFPlayerMiniPacer.cpp
+ *            src/DFPlayerMiniQueue.cpp -o mpsc_bench
+ *
+ * usage: mpsc_bench [frames] [slots]
+ *
+ */
+
+#include "DFPlayerMiniQueue.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+constexpr uint8_t THREADS[] = {1, 2, 4, 8, 16, 32};
+
+/** Transport counting frames and checking their checksums */
+class CountingTransport : public Transport {
+  uint64_t _frames = 0;
+  uint64_t _corrupt = 0;
+
+  void check(const uint8_t *buf) {
+    stack_t _stack;
+    memcpy(&_stack, buf, PACKET::SIZE);
+    if (!DFPlayerMini::checkChecksum(_stack))
+      _corrupt++;
+    _frames++;
+  }
+
+public:
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t i = 0; i + PACKET::SIZE <= len; i += PACKET::SIZE)
+      check(buf + i);
+    return len;
+  }
+  size_t writev(const span_t *spans, uint8_t count) override {
+    size_t total = 0;
+    for (uint8_t i = 0; i < count; i++)
+      total += write(spans[i].data, spans[i].len);
+    return total;
+  }
+  uint64_t frames() const { return _frames; }
+  uint64_t corrupt() const { return _corrupt; }
+};
+
+template <class F> double measure(F body) {
+  auto start = std::chrono::steady_clock::now();
+  body();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+double lockFree(uint8_t threads, uint32_t frames, uint32_t slots,
+                CountingTransport &port) {
+  std::vector<frame_slot_t> storage(slots);
+  FrameQueue queue(storage.data(), slots);
+  std::atomic<bool> done(false);
+  uint32_t each = frames / threads;
+
+  return measure([&] {
+    std::thread writer([&] {
+      while (!done.load(std::memory_order_acquire))
+        if (!queue.drain(port))
+          std::this_thread::yield();
+      queue.drain(port);
+    });
+
+    std::vector<std::thread> producers;
+    for (uint8_t t = 0; t < threads; t++)
+      producers.emplace_back([&, t] {
+        for (uint32_t i = 0; i < each; i++)
+          while (!queue.submit(CONTROLCMD::SET_VOL, 0, (t + i) % 31))
+            std::this_thread::yield();
+      });
+
+    for (auto &producer : producers)
+      producer.join();
+    done.store(true, std::memory_order_release);
+    writer.join();
+  });
+}
+
+double locked(uint8_t threads, uint32_t frames, CountingTransport &port) {
+  DFPlayerMini player(false);
+  std::mutex lock;
+  uint32_t each = frames / threads;
+
+  return measure([&] {
+    std::vector<std::thread> producers;
+    for (uint8_t t = 0; t < threads; t++)
+      producers.emplace_back([&, t] {
+        uint8_t frame[PACKET::SIZE];
+        for (uint32_t i = 0; i < each; i++) {
+          std::lock_guard<std::mutex> guard(lock);
+          player.setVolume(static_cast<uint8_t>((t + i) % 31));
+          player.getStack(frame);
+          port.write(frame, PACKET::SIZE);
+        }
+      });
+
+    for (auto &producer : producers)
+      producer.join();
+  });
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 2000000;
+  uint32_t slots = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1024;
+  if (slots & (slots - 1)) {
+    fprintf(stderr, "slots must be a power of two\n");
+    return 1;
+  }
+
+  printf("%u frames, %u slots, %u CPUs\n", frames, slots,
+         std::thread::hardware_concurrency());
+  printf("threads   mpsc Mfr/s  ns/submit   mutex Mfr/s  ns/submit\n");
+
+  for (uint8_t threads : THREADS) {
+    uint32_t total = frames - frames % threads;
+    CountingTransport queued, serial;
+
+    double queueTime = lockFree(threads, total, slots, queued);
+    double lockTime = locked(threads, total, serial);
+
+    if (queued.frames() != total || serial.frames() != total ||
+        queued.corrupt() || serial.corrupt()) {
+      fprintf(stderr, "lost or corrupt frames at %u threads\n", threads);
+      return 1;
+    }
+
+    printf("%7u   %10.2f  %9.1f   %11.2f  %9.1f\n", threads,
+           total * 1e3 / queueTime, queueTime / total,
+           total * 1e3 / lockTime, lockTime / total);
+  }
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*!
+ * @file tx_bench.cpp
+ *
+ * Cost per transmitted packet of the old per-byte transmit path against
+ * whole-frame writes, batched writes and gathered writes, measured on an
+ * in-memory transport (virtual call overhead only) and on a file
+ * descriptor (/dev/null by default, one system call per write).
+ *
+ * build: g++ -std=c++17 -O2 -Isrc extras/bench/tx_bench.cpp
+ *            src/DFPlayerMini.cpp src/DFPlayerMiniBatch.cpp
+ *            src/DFPlayerMiniTransport.cpp -o tx_bench
+ *
+ * usage: tx_bench [device] [frames]
+ *
+ */
+
+#include "DFPlayerMiniBatch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+constexpr uint8_t BATCH = 8;
+
+/** Transport copying into memory, like a UART driver's TX ring */
+class MemoryTransport : public Transport {
+  uint8_t _ring[4096];
+  size_t _head = 0;
+
+public:
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t i = 0; i < len; i++)
+      _ring[(_head + i) & (sizeof(_ring) - 1)] = buf[i];
+    _head += len;
+    return len;
+  }
+  size_t head() const { return _head; }
+};
+
+/** The old sendData(): one write per byte */
+void perByte(Transport &port, DFPlayerMini &player) {
+  uint8_t frame[PACKET::SIZE];
+  player.getStack(frame);
+  for (uint8_t i = 0; i < PACKET::SIZE; i++)
+    port.write(&frame[i], 1);
+}
+
+template <class F> double measure(uint32_t frames, F body) {
+  auto start = std::chrono::steady_clock::now();
+  body();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / frames;
+}
+
+void run(const char *name, Transport &port, uint32_t frames) {
+  DFPlayerMini player(false);
+  uint8_t buffer[BATCH * PACKET::SIZE];
+  FrameBatch batch(port, buffer, BATCH);
+  stack_t stacks[BATCH];
+  const stack_t *pointers[BATCH];
+  for (uint8_t i = 0; i < BATCH; i++)
+    pointers[i] = &stacks[i];
+
+  double byteCost = measure(frames, [&] {
+    for (uint32_t i = 0; i < frames; i++) {
+      player.setVolume(static_cast<uint8_t>(i % 31));
+      perByte(port, player);
+    }
+  });
+
+  double frameCost = measure(frames, [&] {
+    for (uint32_t i = 0; i < frames; i++) {
+      player.setVolume(static_cast<uint8_t>(i % 31));
+      FrameBatch::send(port, player);
+    }
+  });
+
+  double batchCost = measure(frames, [&] {
+    for (uint32_t i = 0; i < frames; i++) {
+      player.setVolume(static_cast<uint8_t>(i % 31));
+      batch.add(player);
+      if (batch.full())
+        batch.flush();
+    }
+    batch.flush();
+  });
+
+  double gatherCost = measure(frames, [&] {
+    for (uint32_t i = 0; i < frames; i += BATCH) {
+      for (uint8_t j = 0; j < BATCH; j++) {
+        player.setVolume(static_cast<uint8_t>((i + j) % 31));
+        player.getStack(stacks[j]);
+      }
+      FrameBatch::send(port, pointers, BATCH);
+    }
+  });
+
+  printf("%-8s per-byte %8.1f  frame %8.1f  batch/%u %8.1f  gather/%u %8.1f "
+         "ns/frame\n",
+         name, byteCost, frameCost, BATCH, batchCost, BATCH, gatherCost);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *device = argc > 1 ? argv[1] : "/dev/null";
+  uint32_t frames = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1000000;
+  frames -= frames % BATCH;
+
+  MemoryTransport memory;
+  run("memory", memory, frames);
+  if (memory.head() == 0)
+    return 1;
+
+  int fd = open(device, O_WRONLY);
+  if (fd < 0) {
+    perror(device);
+    return 1;
+  }
+  FdTransport file(fd);
+  run("fd", file, frames / 10);
+  close(fd);
+
+  return 0;
+}
@@ -0,0 +1,487 @@
+/*!
+ * @file dfpframe.cpp
+ *
+ * Command line frame encoder/decoder built on the library's encoder and
+ * FrameParser. Both directions stream stdin to stdout through large
+ * buffers, so captures of hundreds of MB decode at disk speed.
+ *
+ *   dfpframe encode [-b] [-f] [command args...]
+ *       Encode one command given as arguments, or one command per line of
+ *       stdin, e.g. "play-folder 3 17" or "vol 20". Prints hex frames, or
+ *       raw bytes with -b. -f requests feedback (ACK) from the module.
+ *       Out-of-range parameters follow the descriptor table's policy, just
+ *       like the library. "raw <id> [first] [second]" encodes any ID.
+ *
+ *   dfpframe decode [-x]
+ *       Decode a raw byte stream, or hex text with -x (any separators),
+ *       into one annotated line per valid frame:
+ *
+ *           <offset> <10 hex bytes> <name> <parameters> [meaning]
+ *
+ *       Bytes outside valid frames are reported as skipped.
+ *
+ *   dfpframe list
+ *       List the command names.
+ *
+ * build: g++ -std=c++17 -O2 -Isrc extras/cli/dfpframe.cpp src/DFPlayerMini.cpp
+ *            -o dfpframe
+ *
+ */
+
+#include "DFPlayerMini.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+/** Textual name of a command ID */
+struct name_t {
+  const char *name;
+  uint8_t cmd;
+  uint8_t args; // parameters taken on the command line
+};
+
+const name_t NAMES[] = {
+    {"next", CONTROLCMD::PLAY_NEXT, 0},
+    {"prev", CONTROLCMD::PLAY_PREV, 0},
+    {"play-track", CONTROLCMD::PLAY_TRACK, 1},
+    {"vol-up", CONTROLCMD::INC_VOL, 0},
+    {"vol-down", CONTROLCMD::DEC_VOL, 0},
+    {"vol", CONTROLCMD::SET_VOL, 1},
+    {"eq", CONTROLCMD::SET_EQ, 1},
+    {"mode", CONTROLCMD::SET_PLAYBACK_MODE, 1},
+    {"source", CONTROLCMD::SET_PLAYBACK_SRC, 1},
+    {"standby", CONTROLCMD::MODE_STANDBY, 0},
+    {"normal", CONTROLCMD::MODE_NORMAL, 0},
+    {"reset", CONTROLCMD::MODE_RESET, 0},
+    {"play", CONTROLCMD::PLAY, 0},
+    {"pause", CONTROLCMD::PAUSE, 0},
+    {"play-folder", CONTROLCMD::PLAY_FOLDER_TRACK, 2},
+    {"amp", CONTROLCMD::SET_AUDIO_AMP, 2},
+    {"repeat-play", CONTROLCMD::SET_REPEAT_PLAY, 1},
+    {"play-mp3", CONTROLCMD::PLAY_MP3_FOLDER, 1},
+    {"advert", CONTROLCMD::INSERT_ADVERT, 1},
+    {"play-large", CONTROLCMD::PLAY_LARGE_FOLDER, 2},
+    {"stop-advert", CONTROLCMD::STOP_ADVERT, 0},
+    {"stop", CONTROLCMD::STOP, 0},
+    {"repeat-folder", CONTROLCMD::REPEAT_FOLDER, 1},
+    {"random", CONTROLCMD::RANDOM_ALL, 0},
+    {"repeat-current", CONTROLCMD::REPEAT_CURRENT, 1},
+    {"dac", CONTROLCMD::SET_DAC, 1},
+    {"device-inserted", REPORT::DEVICE_INSERTED, 1},
+    {"device-removed", REPORT::DEVICE_REMOVED, 1},
+    {"u-finished", REPORT::U_FINISHED, 1},
+    {"tf-finished", REPORT::TF_FINISHED, 1},
+    {"flash-finished", REPORT::FLASH_FINISHED, 1},
+    {"init", QUERYCMD::SEND_INIT, 1},
+    {"error", QUERYCMD::RETRANSMIT, 1},
+    {"ack", QUERYCMD::REPLY, 0},
+    {"status", QUERYCMD::GET_STATUS_, 0},
+    {"get-vol", QUERYCMD::GET_VOL, 0},
+    {"get-eq", QUERYCMD::GET_EQ, 0},
+    {"get-mode", QUERYCMD::GET_MODE, 0},
+    {"version", QUERYCMD::GET_VERSION, 0},
+    {"tf-files", QUERYCMD::GET_TF_FILES, 0},
+    {"u-files", QUERYCMD::GET_U_FILES, 0},
+    {"flash-files", QUERYCMD::GET_FLASH_FILES, 0},
+    {"keep-on", QUERYCMD::KEEP_ON, 0},
+    {"tf-track", QUERYCMD::GET_TF_TRACK, 0},
+    {"u-track", QUERYCMD::GET_U_TRACK, 0},
+    {"flash-track", QUERYCMD::GET_FLASH_TRACK, 0},
+    {"folder-files", QUERYCMD::GET_FOLDER_FILES, 1},
+    {"folders", QUERYCMD::GET_FOLDERS, 0},
+};
+
+/** Meanings of the 0x40 error codes */
+const char *errorMeaning(uint8_t code) {
+  switch (code) {
+  case ERROR_CODE::BUSY:
+    return "module busy (initialising)";
+  case ERROR_CODE::SLEEPING:
+    return "module sleeping";
+  case ERROR_CODE::SERIAL_ERROR:
+    return "incomplete frame received";
+  case ERROR_CODE::CHECKSUM:
+    return "checksum error";
+  case ERROR_CODE::OUT_OF_SCOPE:
+    return "track out of scope";
+  case ERROR_CODE::NOT_FOUND:
+    return "track not found";
+  case ERROR_CODE::INSERTION:
+    return "advert insertion error (nothing playing)";
+  case ERROR_CODE::CARD_READ:
+    return "storage read error";
+  case ERROR_CODE::ENTER_SLEEP:
+    return "entered sleep mode";
+  default:
+    return "unknown error";
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Buffered stdout writer.
+*/
+/**************************************************************************/
+class Output {
+  static constexpr size_t SIZE = 1 << 16;
+  char _buf[SIZE];
+  size_t _len = 0;
+
+public:
+  ~Output() { flush(); }
+
+  void flush() {
+    fwrite(_buf, 1, _len, stdout);
+    _len = 0;
+  }
+
+  void reserve(size_t n) {
+    if (_len + n > SIZE)
+      flush();
+  }
+
+  void put(char c) {
+    reserve(1);
+    _buf[_len++] = c;
+  }
+
+  void puts(const char *s) {
+    size_t n = strlen(s);
+    reserve(n);
+    memcpy(_buf + _len, s, n);
+    _len += n;
+  }
+
+  void hex(uint8_t b) {
+    static const char DIGITS[] = "0123456789ABCDEF";
+    reserve(2);
+    _buf[_len++] = DIGITS[b >> 4];
+    _buf[_len++] = DIGITS[b & 0x0F];
+  }
+
+  void number(uint64_t value) {
+    char tmp[20];
+    int n = 0;
+    do {
+      tmp[n++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    reserve(n);
+    while (n)
+      _buf[_len++] = tmp[--n];
+  }
+
+  void bytes(const uint8_t *data, size_t n) {
+    reserve(n);
+    memcpy(_buf + _len, data, n);
+    _len += n;
+  }
+};
+
+const name_t *findName(const char *name) {
+  for (const name_t &entry : NAMES)
+    if (!strcmp(entry.name, name))
+      return &entry;
+  return nullptr;
+}
+
+const char *findCmd(uint8_t cmd) {
+  for (const name_t &entry : NAMES)
+    if (entry.cmd == cmd)
+      return entry.name;
+  return nullptr;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Encode one textual command.
+        @param    argc
+                          Number of words.
+        @param    argv
+                          The words, command name first.
+        @param    feedback
+                          Boolean to control whether the frame requests an
+                          ACK.
+        @param    binary
+                          Boolean to control whether raw bytes are written.
+        @param    out
+                          Output.
+        @return False if the command is unknown.
+*/
+/**************************************************************************/
+bool encodeCommand(int argc, char **argv, bool feedback, bool binary,
+                   Output &out) {
+  uint8_t cmd;
+  uint16_t params[2] = {0, 0};
+  int first = 1;
+
+  if (!strcmp(argv[0], "raw")) {
+    if (argc < 2)
+      return false;
+    cmd = static_cast<uint8_t>(strtoul(argv[1], nullptr, 0));
+    first = 2;
+  } else {
+    const name_t *entry = findName(argv[0]);
+    if (!entry || argc - 1 < entry->args)
+      return false;
+    cmd = entry->cmd;
+  }
+
+  for (int i = first; i < argc && i - first < 2; i++)
+    params[i - first] = static_cast<uint16_t>(strtoul(argv[i], nullptr, 0));
+
+  stack_t stack;
+  DFPlayerMini::encode(stack, feedback ? PACKET::FEEDBACK::YES
+                                       : PACKET::FEEDBACK::NO,
+                       cmd, params[0], params[1]);
+
+  const uint8_t *frame = reinterpret_cast<const uint8_t *>(&stack);
+  if (binary) {
+    out.bytes(frame, PACKET::SIZE);
+    return true;
+  }
+
+  out.reserve(3 * PACKET::SIZE);
+  for (uint8_t i = 0; i < PACKET::SIZE; i++) {
+    if (i)
+      out.put(' ');
+    out.hex(frame[i]);
+  }
+  out.put('\n');
+  return true;
+}
+
+int encode(int argc, char **argv) {
+  bool binary = false;
+  bool feedback = false;
+  int i = 0;
+
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-b"))
+      binary = true;
+    else if (!strcmp(argv[i], "-f"))
+      feedback = true;
+    else
+      return 2;
+  }
+
+  Output out;
+  if (i < argc) {
+    if (!encodeCommand(argc - i, argv + i, feedback, binary, out)) {
+      fprintf(stderr, "unknown command or missing parameter: %s\n", argv[i]);
+      return 1;
+    }
+    return 0;
+  }
+
+  char line[256];
+  unsigned long lineNo = 0;
+  int status = 0;
+  while (fgets(line, sizeof(line), stdin)) {
+    lineNo++;
+
+    char *words[4];
+    int count = 0;
+    for (char *tok = strtok(line, " \t\r\n,"); tok && count < 4;
+         tok = strtok(nullptr, " \t\r\n,"))
+      words[count++] = tok;
+
+    if (!count || words[0][0] == '#')
+      continue;
+    if (!encodeCommand(count, words, feedback, binary, out)) {
+      fprintf(stderr, "line %lu: unknown command or missing parameter: %s\n",
+              lineNo, words[0]);
+      status = 1;
+    }
+  }
+
+  return status;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Streaming decoder from bytes to annotated lines.
+*/
+/**************************************************************************/
+class Decoder {
+  FrameParser _parser;
+  Output &_out;
+  uint64_t _offset = 0;   // bytes consumed
+  uint64_t _accepted = 0; // offset after the last valid frame
+  uint64_t _frames = 0;
+  uint64_t _skipped = 0;
+
+  void frame(const stack_t &stack);
+
+public:
+  explicit Decoder(Output &out) : _out(out) {}
+
+  void feed(uint8_t byte) {
+    _offset++;
+    if (_parser.parse(byte))
+      frame(_parser.getStack());
+  }
+
+  void finish();
+};
+
+void Decoder::frame(const stack_t &stack) {
+  uint64_t start = _offset - PACKET::SIZE;
+  if (start > _accepted) {
+    _skipped += start - _accepted;
+    _out.puts("# skipped ");
+    _out.number(start - _accepted);
+    _out.puts(" bytes\n");
+  }
+  _accepted = _offset;
+  _frames++;
+
+  _out.number(start);
+  _out.reserve(3 * PACKET::SIZE + 2);
+  _out.put('\t');
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&stack);
+  for (uint8_t i = 0; i < PACKET::SIZE; i++) {
+    if (i)
+      _out.put(' ');
+    _out.hex(bytes[i]);
+  }
+  _out.put('\t');
+
+  const char *name = findCmd(stack.command);
+  if (name) {
+    _out.puts(name);
+  } else {
+    _out.puts("0x");
+    _out.hex(stack.command);
+  }
+
+  uint16_t first, second;
+  DFPlayerMini::decode(stack, first, second);
+
+  command_t desc;
+  uint8_t format = FORMAT::WORD;
+  if (DFPlayerMini::describe(stack.command, desc))
+    format = desc.format;
+
+  if (format != FORMAT::NONE) {
+    _out.put(' ');
+    _out.number(first);
+    if (format != FORMAT::WORD) {
+      _out.put(' ');
+      _out.number(second);
+    }
+  }
+
+  if (stack.feedback == PACKET::FEEDBACK::YES)
+    _out.puts(" [ack requested]");
+  if (stack.command == QUERYCMD::RETRANSMIT) {
+    _out.puts(" [");
+    _out.puts(errorMeaning(stack.paramLSB));
+    _out.put(']');
+  }
+
+  _out.put('\n');
+}
+
+void Decoder::finish() {
+  if (_offset > _accepted)
+    _skipped += _offset - _accepted;
+
+  fprintf(stderr, "%llu bytes, %llu frames, %llu bytes skipped\n",
+          static_cast<unsigned long long>(_offset),
+          static_cast<unsigned long long>(_frames),
+          static_cast<unsigned long long>(_skipped));
+}
+
+int decode(int argc, char **argv) {
+  bool hexInput = false;
+
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "-x"))
+      hexInput = true;
+    else
+      return 2;
+  }
+
+  // nibble value of every input byte, 0xFF if it is no hex digit
+  uint8_t nibble[256];
+  memset(nibble, 0xFF, sizeof(nibble));
+  for (int c = 0; c < 10; c++)
+    nibble['0' + c] = static_cast<uint8_t>(c);
+  for (int c = 0; c < 6; c++)
+    nibble['a' + c] = nibble['A' + c] = static_cast<uint8_t>(10 + c);
+
+  Output out;
+  Decoder decoder(out);
+  static uint8_t buf[1 << 20];
+  int high = -1;
+  bool prefix = false; // previous character was a '0' that may start "0x"
+
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0) {
+    if (!hexInput) {
+      for (size_t i = 0; i < n; i++)
+        decoder.feed(buf[i]);
+      continue;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      uint8_t c = buf[i];
+      if ((c == 'x' || c == 'X') && prefix && high == 0) {
+        high = -1; // drop the "0" of a "0x" prefix
+        prefix = false;
+        continue;
+      }
+      prefix = false;
+
+      uint8_t value = nibble[c];
+      if (value == 0xFF) {
+        high = -1;
+        continue;
+      }
+
+      if (high < 0) {
+        high = value;
+        prefix = c == '0';
+      } else {
+        decoder.feed(static_cast<uint8_t>(high << 4 | value));
+        high = -1;
+      }
+    }
+  }
+
+  out.flush();
+  decoder.finish();
+  return 0;
+}
+
+int list() {
+  for (const name_t &entry : NAMES)
+    printf("0x%02X  %-16s %u parameter%s\n", entry.cmd, entry.name,
+           entry.args, entry.args == 1 ? "" : "s");
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int status = 2;
+
+  if (argc >= 2 && !strcmp(argv[1], "encode"))
+    status = encode(argc - 2, argv + 2);
+  else if (argc >= 2 && !strcmp(argv[1], "decode"))
+    status = decode(argc - 2, argv + 2);
+  else if (argc >= 2 && !strcmp(argv[1], "list"))
+    status = list();
+
+  if (status == 2)
+    fprintf(stderr, "usage: dfpframe encode [-b] [-f] [command args...]\n"
+                    "       dfpframe decode [-x]\n"
+                    "       dfpframe list\n");
+  return status;
+}
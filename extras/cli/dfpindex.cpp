@@ -0,0 +1,486 @@
+/*!
+ * @file dfpindex.cpp
+ *
+ * Offline indexer and validator of a card layout. Scans a mounted card or
+ * a directory tree with a pool of threads, checks every folder and file
+ * name against the rules the module applies (CardLayout), measures the
+ * duration of every MP3 (Xing/Info/VBRI frame count, or the bitrate of the
+ * first frame for CBR files) and WAV file, and writes the binary index
+ * CardIndex reads.
+ *
+ *   dfpindex [-j threads] [-o index.bin] <card root>
+ *       Validate the layout and write the index (default index.bin).
+ *       Problems are printed as "error: <path>: <problem>" or
+ *       "warning: ...". The exit status is 1 if there were errors; the
+ *       index is still written, without the offending files.
+ *
+ *   dfpindex -d index.bin
+ *       Print an index.
+ *
+ * build: g++ -std=c++17 -O2 -pthread -Isrc extras/cli/dfpindex.cpp
+ *            src/DFPlayerMiniCard.cpp -o dfpindex
+ *
+ */
+
+#include "DFPlayerMiniCard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+/** File to examine */
+struct file_t {
+  std::string path;
+  std::string name;
+  uint8_t folder;
+  card_track_t track;
+  bool valid;
+};
+
+/** Messages of a run, printed in path order at the end */
+struct report_t {
+  std::mutex lock;
+  std::vector<std::string> lines;
+  uint32_t errors = 0;
+  uint32_t warnings = 0;
+
+  void add(bool error, const std::string &path, const char *what) {
+    std::lock_guard<std::mutex> guard(lock);
+    lines.push_back(std::string(error ? "error: " : "warning: ") + path +
+                    ": " + what);
+    if (error)
+      errors++;
+    else
+      warnings++;
+  }
+};
+
+uint32_t be32(const uint8_t *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | p[3];
+}
+
+uint32_t le32(const uint8_t *p) {
+  return (uint32_t(p[3]) << 24) | (uint32_t(p[2]) << 16) |
+         (uint32_t(p[1]) << 8) | p[0];
+}
+
+/** Append little endian fields of the index, whatever the host order */
+void put8(std::vector<uint8_t> &out, uint8_t value) { out.push_back(value); }
+
+void put16(std::vector<uint8_t> &out, uint16_t value) {
+  out.push_back(static_cast<uint8_t>(value));
+  out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value) {
+  put16(out, static_cast<uint16_t>(value));
+  put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+/** Decoded MPEG audio frame header */
+struct mpeg_t {
+  uint32_t bitrate;    // bit/s
+  uint32_t sampleRate; // Hz
+  uint32_t samples;    // per frame
+  uint32_t length;     // bytes of the frame
+  uint32_t side;       // bytes of side information after the header
+};
+
+bool decodeHeader(const uint8_t *p, mpeg_t &frame) {
+  static const uint16_t RATES[5][15] = {
+      {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+      {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+      {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+      {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+  static const uint32_t SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+    return false;
+
+  uint8_t version = (p[1] >> 3) & 3; // 3 MPEG1, 2 MPEG2, 0 MPEG2.5
+  uint8_t layer = 4 - ((p[1] >> 1) & 3);
+  uint8_t rateIndex = p[2] >> 4;
+  uint8_t srIndex = (p[2] >> 2) & 3;
+  uint8_t padding = (p[2] >> 1) & 1;
+  bool mono = (p[3] >> 6) == 3;
+
+  if (version == 1 || layer == 4 || rateIndex == 0 || rateIndex == 15 ||
+      srIndex == 3)
+    return false;
+
+  bool mpeg1 = version == 3;
+  uint8_t table = mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4);
+  frame.bitrate = RATES[table][rateIndex] * 1000u;
+  frame.sampleRate = SAMPLE_RATES[srIndex] >> (mpeg1 ? 0 : version ? 1 : 2);
+
+  if (layer == 1) {
+    frame.samples = 384;
+    frame.length = (12 * frame.bitrate / frame.sampleRate + padding) * 4;
+  } else {
+    frame.samples = layer == 3 && !mpeg1 ? 576 : 1152;
+    frame.length = frame.samples / 8 * frame.bitrate / frame.sampleRate +
+                   padding;
+  }
+  frame.side = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+  return frame.length > 4;
+}
+
+/** Duration of an MP3 file in ms */
+bool mp3Duration(int fd, uint64_t size, card_track_t &track) {
+  uint8_t buf[8192];
+  uint64_t offset = 0;
+
+  ssize_t n = pread(fd, buf, 10, 0);
+  if (n == 10 && !memcmp(buf, "ID3", 3)) {
+    uint32_t tag = ((buf[6] & 0x7F) << 21) | ((buf[7] & 0x7F) << 14) |
+                   ((buf[8] & 0x7F) << 7) | (buf[9] & 0x7F);
+    offset = 10 + tag + (buf[5] & 0x10 ? 10 : 0);
+  }
+
+  n = pread(fd, buf, sizeof(buf), offset);
+  if (n < 4)
+    return false;
+
+  for (ssize_t i = 0; i + 4 <= n; i++) {
+    mpeg_t frame;
+    if (!decodeHeader(buf + i, frame))
+      continue;
+    // a real frame is followed by another one
+    if (i + frame.length + 4 <= n) {
+      mpeg_t next;
+      if (!decodeHeader(buf + i + frame.length, next))
+        continue;
+    }
+
+    const uint8_t *xing = buf + i + 4 + frame.side;
+    const uint8_t *vbri = buf + i + 4 + 32;
+    uint32_t frames = 0;
+    if (xing + 12 <= buf + n &&
+        (!memcmp(xing, "Xing", 4) || !memcmp(xing, "Info", 4)) &&
+        (be32(xing + 4) & 1))
+      frames = be32(xing + 8);
+    else if (vbri + 18 <= buf + n && !memcmp(vbri, "VBRI", 4))
+      frames = be32(vbri + 14);
+
+    if (frames) {
+      track.duration = static_cast<uint32_t>(
+          uint64_t(frames) * frame.samples * 1000 / frame.sampleRate);
+    } else {
+      uint64_t audio = size - offset - i;
+      uint8_t tag[3];
+      if (size >= 128 && pread(fd, tag, 3, size - 128) == 3 &&
+          !memcmp(tag, "TAG", 3))
+        audio -= 128;
+      track.duration = static_cast<uint32_t>(audio * 8000 / frame.bitrate);
+      track.flags |= TRACK_FLAG::ESTIMATED;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/** Duration of a WAV file in ms */
+bool wavDuration(int fd, card_track_t &track) {
+  uint8_t buf[12];
+  if (pread(fd, buf, 12, 0) != 12 || memcmp(buf, "RIFF", 4) ||
+      memcmp(buf + 8, "WAVE", 4))
+    return false;
+
+  uint32_t byteRate = 0;
+  for (off_t offset = 12;;) {
+    uint8_t chunk[16];
+    if (pread(fd, chunk, 8, offset) != 8)
+      return false;
+    uint32_t length = le32(chunk + 4);
+
+    if (!memcmp(chunk, "fmt ", 4)) {
+      if (pread(fd, chunk, 16, offset + 8) != 16)
+        return false;
+      byteRate = le32(chunk + 8);
+    } else if (!memcmp(chunk, "data", 4)) {
+      if (!byteRate)
+        return false;
+      track.duration =
+          static_cast<uint32_t>(uint64_t(length) * 1000 / byteRate);
+      return true;
+    }
+    offset += 8 + length + (length & 1);
+  }
+}
+
+void examine(file_t &file, report_t &report) {
+  uint16_t number;
+  uint16_t flags;
+  uint8_t issue =
+      CardLayout::trackNumber(file.folder, file.name.c_str(), number, flags);
+
+  file.valid = false;
+  if (issue == NAME_ISSUE::EXTENSION) {
+    report.add(false, file.path, CardLayout::describe(issue));
+    return;
+  }
+  if (issue != NAME_ISSUE::NONE) {
+    report.add(true, file.path, CardLayout::describe(issue));
+    return;
+  }
+
+  int fd = open(file.path.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    report.add(true, file.path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+
+  file.track = {number, flags, 0, static_cast<uint32_t>(st.st_size)};
+  bool decoded = flags & TRACK_FLAG::WAV ? wavDuration(fd, file.track)
+                                         : mp3Duration(fd, st.st_size,
+                                                       file.track);
+  close(fd);
+
+  if (!decoded) {
+    report.add(true, file.path, "not a playable audio file");
+    return;
+  }
+  file.valid = true;
+}
+
+/** Add the files of a directory, warn about subdirectories */
+void list(const std::string &dir, uint8_t folder, std::vector<file_t> &files,
+          report_t &report) {
+  DIR *handle = opendir(dir.c_str());
+  if (!handle) {
+    report.add(true, dir, strerror(errno));
+    return;
+  }
+
+  while (dirent *entry = readdir(handle)) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    std::string path = dir + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st))
+      continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      if (folder != CARD::ROOT)
+        report.add(false, path, "nested folder ignored by the module");
+      continue;
+    }
+    if (S_ISREG(st.st_mode))
+      files.push_back({path, entry->d_name, folder, {}, false});
+  }
+  closedir(handle);
+}
+
+int scan(const char *root, const char *output, unsigned threads) {
+  auto started = std::chrono::steady_clock::now();
+  report_t report;
+  std::vector<file_t> files;
+
+  list(root, CARD::ROOT, files, report);
+  bool rootTracks = !files.empty();
+
+  DIR *handle = opendir(root);
+  if (!handle) {
+    perror(root);
+    return 1;
+  }
+  while (dirent *entry = readdir(handle)) {
+    std::string path = std::string(root) + "/" + entry->d_name;
+    struct stat st;
+    if (entry->d_name[0] == '.' || stat(path.c_str(), &st) ||
+        !S_ISDIR(st.st_mode))
+      continue;
+
+    uint8_t folder = CardLayout::folderId(entry->d_name);
+    if (folder == CARD::INVALID)
+      report.add(false, path, CardLayout::describe(NAME_ISSUE::UNKNOWN_DIR));
+    else
+      list(path, folder, files, report);
+  }
+  closedir(handle);
+
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++)
+    pool.emplace_back([&] {
+      for (size_t i; (i = next.fetch_add(1)) < files.size();)
+        examine(files[i], report);
+    });
+  for (auto &worker : pool)
+    worker.join();
+
+  std::sort(files.begin(), files.end(), [](const file_t &a, const file_t &b) {
+    if (a.folder != b.folder)
+      return a.folder < b.folder;
+    if (a.track.number != b.track.number)
+      return a.track.number < b.track.number;
+    return a.name < b.name;
+  });
+
+  std::vector<card_folder_t> folders;
+  std::vector<card_track_t> tracks;
+  const file_t *previous = nullptr;
+  for (const file_t &file : files) {
+    if (!file.valid)
+      continue;
+    if (previous && previous->folder == file.folder &&
+        previous->track.number == file.track.number) {
+      report.add(true, file.path,
+                 ("same number as " + previous->name).c_str());
+      continue;
+    }
+    if (folders.empty() || folders.back().folder != file.folder)
+      folders.push_back({file.folder, 0, 0,
+                         static_cast<uint32_t>(tracks.size())});
+    folders.back().count++;
+    tracks.push_back(file.track);
+    previous = &file;
+  }
+  if (rootTracks)
+    report.add(false, root,
+               "root tracks play in copy order, not by file name");
+
+  std::sort(report.lines.begin(), report.lines.end(),
+            [](const std::string &a, const std::string &b) {
+              return a.substr(a.find(':')) < b.substr(b.find(':'));
+            });
+  for (const std::string &line : report.lines)
+    fprintf(stderr, "%s\n", line.c_str());
+
+  std::vector<uint8_t> data;
+  put32(data, CARD::MAGIC);
+  put8(data, CARD::VERSION);
+  put8(data, static_cast<uint8_t>(folders.size()));
+  put16(data, 0);
+  put32(data, static_cast<uint32_t>(tracks.size()));
+  for (const card_folder_t &folder : folders) {
+    put8(data, folder.folder);
+    put8(data, 0);
+    put16(data, folder.count);
+    put32(data, folder.first);
+  }
+  for (const card_track_t &track : tracks) {
+    put16(data, track.number);
+    put16(data, track.flags);
+    put32(data, track.duration);
+    put32(data, track.size);
+  }
+
+  FILE *out = fopen(output, "wb");
+  if (!out) {
+    perror(output);
+    return 1;
+  }
+  bool written = fwrite(data.data(), 1, data.size(), out) == data.size();
+  if (fclose(out) || !written) {
+    perror(output);
+    return 1;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - started;
+  fprintf(stderr,
+          "%zu folders, %zu tracks, %u errors, %u warnings, %zu files in "
+          "%.0f ms on %u threads\n",
+          folders.size(), tracks.size(), report.errors, report.warnings,
+          files.size(), elapsed.count(), threads);
+  return report.errors ? 1 : 0;
+}
+
+int dump(const char *path) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint32_t> data;
+  uint32_t word;
+  while (fread(&word, sizeof(word), 1, in) == 1)
+    data.push_back(word);
+  fclose(in);
+
+  CardIndex index;
+  if (!index.load(data.data(), data.size() * sizeof(uint32_t))) {
+    fprintf(stderr, "%s: not a valid index\n", path);
+    return 1;
+  }
+
+  const card_folder_t *folders = reinterpret_cast<const card_folder_t *>(
+      reinterpret_cast<const uint8_t *>(data.data()) + sizeof(card_header_t));
+  const card_track_t *tracks =
+      reinterpret_cast<const card_track_t *>(folders + index.folders());
+  for (uint8_t f = 0; f < index.folders(); f++) {
+    const card_folder_t &folder = folders[f];
+    if (folder.folder == CARD::MP3)
+      printf("mp3");
+    else if (folder.folder == CARD::ADVERT)
+      printf("advert");
+    else if (folder.folder == CARD::ROOT)
+      printf("root");
+    else
+      printf("%02u", folder.folder);
+    printf(": %u tracks\n", folder.count);
+
+    for (uint16_t t = 0; t < folder.count; t++) {
+      const card_track_t &track = tracks[folder.first + t];
+      printf("  %04u %8u ms %10u bytes%s%s\n", track.number, track.duration,
+             track.size, track.flags & TRACK_FLAG::WAV ? " wav" : "",
+             track.flags & TRACK_FLAG::ESTIMATED ? " estimated" : "");
+    }
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *output = "index.bin";
+  unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:o:d:")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = std::max(1ul, strtoul(optarg, nullptr, 0));
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'd':
+      return dump(optarg);
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: dfpindex [-j threads] [-o index.bin] <card root>\n"
+                    "       dfpindex -d index.bin\n");
+    return 2;
+  }
+  return scan(argv[optind], output, threads);
+}
@@ -0,0 +1,613 @@
+/*!
+ * @file dfpprov.cpp
+ *
+ * Provisions cards from a music library. Maps every track of a library
+ * directory or a playlist onto the addresses the module plays
+ * (playFolderTrack, playLargeFolder, playFromMP3Folder or playTrack)
+ * within the LIMIT ranges, copies the files to one or more mounted cards
+ * in parallel with kernel copy offload (copy_file_range, falling back to
+ * read/write across file systems that do not support it), and writes the
+ * address map CardMap reads to play a track by name.
+ *
+ *   dfpprov [-j threads] [-l layout] [-m map.bin] [-n] <library> <card>...
+ *       <library> is a directory, scanned recursively for .mp3 and .wav
+ *       files in path order, or a playlist with one "path" or
+ *       "path<TAB>name" per line ('#' starts a comment, relative paths
+ *       are relative to the playlist). A track is named by the name given
+ *       in the playlist, or by its path without the extension, relative
+ *       to the library directory or as the file name for a playlist.
+ *       Names must be unique, letter case ignored.
+ *
+ *       Layouts:
+ *         folders  "01".."99" with "001-".."255-" files (default); every
+ *                  source directory starts a new folder
+ *         large    "01".."15" with "0001-".."3000-" files, played with 0x14
+ *         mp3      "mp3" with "0001-".."9999-" files
+ *         root     "0001-".."2999-" files in the root, played by copy
+ *                  order, which matches the numbers since the files are
+ *                  created in address order
+ *
+ *       The destination folders must be empty. -n prints the plan without
+ *       copying. The map is written to map.bin unless -m is given.
+ *
+ *   dfpprov -d map.bin [name]...
+ *       Print a map, or the address and command of each name.
+ *
+ * build: g++ -std=c++17 -O2 -pthread -Isrc extras/cli/dfpprov.cpp
+ *            src/DFPlayerMiniCard.cpp src/DFPlayerMini.cpp -o dfpprov
+ *
+ */
+
+#include "DFPlayerMiniCard.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+/** Address space of a layout */
+struct layout_t {
+  const char *name;
+  uint8_t firstFolder;
+  uint8_t lastFolder;
+  uint16_t firstTrack;
+  uint16_t lastTrack;
+  uint8_t digits; // of the track number in the file name
+  bool groups;    // start a new folder for every source directory
+};
+
+const layout_t LAYOUTS[] = {
+    {"folders", LIMIT::MIN_FOLDER, LIMIT::MAX_FOLDER, LIMIT::MIN_FOLDER_TRACK,
+     LIMIT::MAX_FOLDER_TRACK, 3, true},
+    {"large", LIMIT::MIN_FOLDER, LIMIT::MAX_LARGE_FOLDER,
+     LIMIT::MIN_FOLDER_TRACK, LIMIT::MAX_LARGE_FOLDER_TRACK, 4, true},
+    {"mp3", CARD::MP3, CARD::MP3, 1, LIMIT::MAX_MP3_TRACK, 4, false},
+    {"root", CARD::ROOT, CARD::ROOT, 1, LIMIT::MAX_ROOT_TRACK, 4, false}};
+
+/** Track to provision */
+struct entry_t {
+  std::string source;
+  std::string name;   // key of the address map
+  std::string group;  // source directory
+  std::string target; // path relative to the card root
+  uint64_t size;
+  uint8_t folder;
+  uint16_t number;
+};
+
+/** Totals of a run */
+struct stats_t {
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint32_t> offloaded{0};
+  std::atomic<uint32_t> copied{0};
+  std::atomic<uint32_t> failed{0};
+  std::mutex lock; // of stderr
+};
+
+std::string lowered(std::string text) {
+  for (char &c : text)
+    if (c >= 'A' && c <= 'Z')
+      c = c - 'A' + 'a';
+  return text;
+}
+
+std::string extension(const std::string &path) {
+  size_t dot = path.rfind('.');
+  return dot == std::string::npos || path.find('/', dot) != std::string::npos
+             ? ""
+             : lowered(path.substr(dot));
+}
+
+bool audio(const std::string &path) {
+  std::string ext = extension(path);
+  return ext == ".mp3" || ext == ".wav";
+}
+
+std::string stem(const std::string &path) {
+  size_t slash = path.rfind('/');
+  size_t dot = path.rfind('.');
+  size_t start = slash == std::string::npos ? 0 : slash + 1;
+  return path.substr(start, dot == std::string::npos || dot < start
+                                ? std::string::npos
+                                : dot - start);
+}
+
+std::string directory(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+/** Add the audio files below a directory, in path order */
+void walk(const std::string &root, const std::string &relative,
+          std::vector<entry_t> &entries) {
+  std::string dir = relative.empty() ? root : root + "/" + relative;
+  DIR *handle = opendir(dir.c_str());
+  if (!handle) {
+    perror(dir.c_str());
+    return;
+  }
+
+  std::vector<std::string> names;
+  while (dirent *entry = readdir(handle))
+    if (entry->d_name[0] != '.')
+      names.push_back(entry->d_name);
+  closedir(handle);
+  std::sort(names.begin(), names.end());
+
+  for (const std::string &name : names) {
+    std::string path = relative.empty() ? name : relative + "/" + name;
+    struct stat st;
+    if (stat((root + "/" + path).c_str(), &st))
+      continue;
+    if (S_ISDIR(st.st_mode))
+      walk(root, path, entries);
+    else if (S_ISREG(st.st_mode) && audio(name))
+      entries.push_back({root + "/" + path, path.substr(0, path.rfind('.')),
+                         dir, "", static_cast<uint64_t>(st.st_size), 0, 0});
+  }
+}
+
+/** Read a playlist */
+bool playlist(const char *path, std::vector<entry_t> &entries) {
+  FILE *in = fopen(path, "r");
+  if (!in) {
+    perror(path);
+    return false;
+  }
+
+  bool ok = true;
+  char line[4096];
+  for (unsigned number = 1; fgets(line, sizeof(line), in); number++) {
+    std::string text(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+      text.pop_back();
+    if (text.empty() || text[0] == '#')
+      continue;
+
+    size_t tab = text.find('\t');
+    std::string source = text.substr(0, tab);
+    std::string name = tab == std::string::npos ? stem(source)
+                                                : text.substr(tab + 1);
+    if (source[0] != '/')
+      source = directory(path) + "/" + source;
+
+    struct stat st;
+    if (stat(source.c_str(), &st) || !S_ISREG(st.st_mode) || !audio(source)) {
+      fprintf(stderr, "error: %s:%u: %s: not an .mp3 or .wav file\n", path,
+              number, source.c_str());
+      ok = false;
+      continue;
+    }
+    entries.push_back({source, name, directory(source), "",
+                       static_cast<uint64_t>(st.st_size), 0, 0});
+  }
+  fclose(in);
+  return ok;
+}
+
+/** File name on the card, without characters FAT does not allow */
+std::string target(const layout_t &layout, const entry_t &entry) {
+  char prefix[16];
+  if (entry.folder == CARD::ROOT)
+    snprintf(prefix, sizeof(prefix), "%04u-", entry.number);
+  else if (entry.folder == CARD::MP3)
+    snprintf(prefix, sizeof(prefix), "mp3/%04u-", entry.number);
+  else
+    snprintf(prefix, sizeof(prefix),
+             layout.digits == 3 ? "%02u/%03u-" : "%02u/%04u-", entry.folder,
+             entry.number);
+
+  std::string name = stem(entry.source);
+  if (name.size() > 40) {
+    // cut on a code point, not inside a UTF-8 sequence
+    size_t end = 40;
+    while (end > 0 && (static_cast<uint8_t>(name[end]) & 0xC0) == 0x80)
+      end--;
+    name.resize(end);
+  }
+  for (char &c : name)
+    if (static_cast<uint8_t>(c) < 0x20 || strchr("\"*/:<>?\\|", c))
+      c = '_';
+  return prefix + name + extension(entry.source);
+}
+
+/** Assign addresses in order, false if the library does not fit */
+bool assign(const layout_t &layout, std::vector<entry_t> &entries) {
+  uint8_t folder = layout.firstFolder;
+  uint16_t number = layout.firstTrack;
+  const std::string *group = nullptr;
+
+  for (entry_t &entry : entries) {
+    bool next = number > layout.lastTrack ||
+                (layout.groups && group && *group != entry.group &&
+                 number != layout.firstTrack);
+    if (next) {
+      if (folder == layout.lastFolder) {
+        fprintf(stderr, "error: %zu tracks do not fit the %s layout\n",
+                entries.size(), layout.name);
+        return false;
+      }
+      folder++;
+      number = layout.firstTrack;
+    }
+    entry.folder = folder;
+    entry.number = number++;
+    entry.target = target(layout, entry);
+    group = &entry.group;
+  }
+  return true;
+}
+
+bool unique(std::vector<entry_t> &entries) {
+  std::vector<std::pair<std::string, const entry_t *>> keys;
+  for (const entry_t &entry : entries)
+    keys.push_back({lowered(entry.name), &entry});
+  std::sort(keys.begin(), keys.end());
+
+  bool ok = true;
+  for (size_t i = 1; i < keys.size(); i++)
+    if (keys[i].first == keys[i - 1].first) {
+      fprintf(stderr, "error: %s: name \"%s\" already used by %s\n",
+              keys[i].second->source.c_str(), keys[i].second->name.c_str(),
+              keys[i - 1].second->source.c_str());
+      ok = false;
+    }
+  return ok;
+}
+
+/** Create the folders and the empty files in address order */
+bool prepare(const std::string &card, const std::vector<entry_t> &entries) {
+  struct stat st;
+  if (stat(card.c_str(), &st) || !S_ISDIR(st.st_mode)) {
+    fprintf(stderr, "error: %s: not a mounted card\n", card.c_str());
+    return false;
+  }
+
+  std::string made;
+  for (const entry_t &entry : entries) {
+    std::string dir = entry.folder == CARD::ROOT ? card
+                                                 : card + "/" +
+                                                       directory(entry.target);
+    if (dir != made) {
+      if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+        perror(dir.c_str());
+        return false;
+      }
+      DIR *handle = opendir(dir.c_str());
+      bool empty = true;
+      while (dirent *item = handle ? readdir(handle) : nullptr) {
+        uint16_t number;
+        uint16_t flags;
+        if (item->d_name[0] != '.' &&
+            (entry.folder != CARD::ROOT ||
+             CardLayout::trackNumber(CARD::ROOT, item->d_name, number,
+                                     flags) != NAME_ISSUE::EXTENSION))
+          empty = false;
+      }
+      if (handle)
+        closedir(handle);
+      if (!empty) {
+        fprintf(stderr, "error: %s: destination not empty\n", dir.c_str());
+        return false;
+      }
+      made = dir;
+    }
+
+    std::string path = card + "/" + entry.target;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+      perror(path.c_str());
+      return false;
+    }
+    // contiguous clusters where the file system can reserve them
+    if (entry.size)
+      fallocate(fd, 0, 0, entry.size);
+    close(fd);
+  }
+  return true;
+}
+
+bool copy(const std::string &source, const std::string &path, uint64_t size,
+          stats_t &stats) {
+  int in = open(source.c_str(), O_RDONLY);
+  int out = in < 0 ? -1 : open(path.c_str(), O_WRONLY);
+  if (in < 0 || out < 0) {
+    std::lock_guard<std::mutex> guard(stats.lock);
+    perror(in < 0 ? source.c_str() : path.c_str());
+    if (in >= 0)
+      close(in);
+    return false;
+  }
+
+  uint64_t done = 0;
+  int error = 0;
+  bool offload = true;
+  while (offload && done < size) {
+    ssize_t n = copy_file_range(in, nullptr, out, nullptr, size - done, 0);
+    if (n > 0)
+      done += n;
+    else if (n == 0 || errno == EXDEV || errno == EINVAL ||
+             errno == ENOSYS || errno == EOPNOTSUPP)
+      offload = false;
+    else if (errno != EINTR) {
+      error = errno;
+      break;
+    }
+  }
+
+  std::vector<char> buffer;
+  if (done < size && !offload) {
+    buffer.resize(1 << 20);
+    while (done < size) {
+      ssize_t n = pread(in, buffer.data(), buffer.size(), done);
+      if (n <= 0 || write(out, buffer.data(), n) != n) {
+        error = n < 0 ? errno : 0;
+        break;
+      }
+      done += n;
+    }
+  }
+
+  if (done == size && ftruncate(out, size))
+    error = errno;
+  bool ok = done == size && !error;
+  if (!ok) {
+    std::lock_guard<std::mutex> guard(stats.lock);
+    fprintf(stderr, "error: %s: %s\n", path.c_str(),
+            error ? strerror(error) : "short copy");
+  }
+  close(in);
+  close(out);
+
+  stats.bytes += done;
+  (buffer.empty() ? stats.offloaded : stats.copied)++;
+  return ok;
+}
+
+/** Address map with at most half of the slots used */
+bool writeMap(const char *path, const std::vector<entry_t> &entries) {
+  uint32_t slots = 2;
+  while (slots < 2 * entries.size())
+    slots *= 2;
+
+  std::vector<card_map_slot_t> table(slots);
+  for (card_map_slot_t &slot : table)
+    slot = {0, 0, CARD::INVALID, 0, 0};
+  std::string names;
+  for (const entry_t &entry : entries) {
+    uint32_t hash = CardMap::hash(entry.name.c_str());
+    uint32_t i = hash & (slots - 1);
+    while (table[i].folder != CARD::INVALID)
+      i = (i + 1) & (slots - 1);
+    table[i] = {hash, static_cast<uint32_t>(names.size()), entry.folder, 0,
+                entry.number};
+    names += entry.name;
+    names += '\0';
+  }
+  names.resize((names.size() + 3) & ~size_t(3), '\0');
+  if (names.empty())
+    names.assign(4, '\0');
+
+  card_map_header_t header = {CARD::MAP_MAGIC,
+                              CARD::VERSION,
+                              0,
+                              0,
+                              slots,
+                              static_cast<uint32_t>(entries.size()),
+                              static_cast<uint32_t>(names.size())};
+  FILE *out = fopen(path, "wb");
+  if (!out) {
+    perror(path);
+    return false;
+  }
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(table.data(), sizeof(card_map_slot_t), slots, out);
+  fwrite(names.data(), 1, names.size(), out);
+  if (fclose(out)) {
+    perror(path);
+    return false;
+  }
+  return true;
+}
+
+int provision(const char *library, char **cards, int count,
+              const layout_t &layout, const char *map, unsigned threads,
+              bool dryRun) {
+  auto started = std::chrono::steady_clock::now();
+  std::vector<entry_t> entries;
+
+  struct stat st;
+  if (stat(library, &st)) {
+    perror(library);
+    return 1;
+  }
+  if (S_ISDIR(st.st_mode))
+    walk(library, "", entries);
+  else if (!playlist(library, entries))
+    return 1;
+
+  if (!unique(entries) || !assign(layout, entries))
+    return 1;
+
+  if (dryRun) {
+    for (const entry_t &entry : entries)
+      printf("%s -> %s (%s)\n", entry.source.c_str(), entry.target.c_str(),
+             entry.name.c_str());
+    return 0;
+  }
+
+  for (int c = 0; c < count; c++)
+    if (!prepare(cards[c], entries))
+      return 1;
+
+  // every file to every card, largest first to balance the workers
+  std::vector<std::pair<const entry_t *, int>> jobs;
+  for (const entry_t &entry : entries)
+    for (int c = 0; c < count; c++)
+      jobs.push_back({&entry, c});
+  std::stable_sort(jobs.begin(), jobs.end(), [](const auto &a, const auto &b) {
+    return a.first->size > b.first->size;
+  });
+
+  stats_t stats;
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++)
+    pool.emplace_back([&] {
+      for (size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+        const entry_t &entry = *jobs[i].first;
+        if (!copy(entry.source,
+                  std::string(cards[jobs[i].second]) + "/" + entry.target,
+                  entry.size, stats))
+          stats.failed++;
+      }
+    });
+  for (auto &worker : pool)
+    worker.join();
+
+  // flush so the cards can be removed
+  for (int c = 0; c < count; c++) {
+    int fd = open(cards[c], O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || syncfs(fd) < 0) {
+      fprintf(stderr, "error: %s: %s\n", cards[c], strerror(errno));
+      stats.failed++;
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+
+  if (!writeMap(map, entries))
+    return 1;
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - started;
+  fprintf(stderr,
+          "%zu tracks to %d cards, %.1f MB in %.2f s (%.1f MB/s) on %u "
+          "threads, %u offloaded, %u copied, %u failed\n",
+          entries.size(), count, stats.bytes / 1e6, elapsed.count(),
+          stats.bytes / 1e6 / elapsed.count(), threads,
+          stats.offloaded.load(), stats.copied.load(), stats.failed.load());
+  return stats.failed ? 1 : 0;
+}
+
+void print(const char *name, const card_map_slot_t &slot) {
+  uint16_t first;
+  uint16_t second;
+  uint8_t cmd = CardMap::command(slot.folder, slot.number, first, second);
+  printf("%s: folder %u track %u, command 0x%02X %u %u\n", name, slot.folder,
+         slot.number, cmd, first, second);
+}
+
+int dump(const char *path, char **names, int count) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint32_t> data;
+  uint32_t word;
+  while (fread(&word, sizeof(word), 1, in) == 1)
+    data.push_back(word);
+  fclose(in);
+
+  CardMap map;
+  if (!map.load(data.data(), data.size() * sizeof(uint32_t))) {
+    fprintf(stderr, "%s: not a valid map\n", path);
+    return 1;
+  }
+
+  if (count) {
+    int missing = 0;
+    for (int i = 0; i < count; i++) {
+      const card_map_slot_t *slot = map.find(names[i]);
+      if (slot) {
+        print(names[i], *slot);
+      } else {
+        fprintf(stderr, "%s: not found\n", names[i]);
+        missing++;
+      }
+    }
+    return missing ? 1 : 0;
+  }
+
+  const card_map_header_t *header =
+      reinterpret_cast<const card_map_header_t *>(data.data());
+  const card_map_slot_t *slots =
+      reinterpret_cast<const card_map_slot_t *>(header + 1);
+  const char *text = reinterpret_cast<const char *>(slots + header->slots);
+  std::vector<const card_map_slot_t *> used;
+  for (uint32_t i = 0; i < header->slots; i++)
+    if (slots[i].folder != CARD::INVALID)
+      used.push_back(&slots[i]);
+  std::sort(used.begin(), used.end(), [](const auto *a, const auto *b) {
+    return a->folder != b->folder ? a->folder < b->folder
+                                  : a->number < b->number;
+  });
+  for (const card_map_slot_t *slot : used)
+    print(text + slot->name, *slot);
+  printf("%u names in %u slots\n", header->entries, header->slots);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *map = "map.bin";
+  const layout_t *layout = &LAYOUTS[0];
+  unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+  bool dryRun = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:l:m:nd:")) != -1) {
+    switch (opt) {
+    case 'j':
+      threads = std::max(1ul, strtoul(optarg, nullptr, 0));
+      break;
+    case 'l':
+      layout = nullptr;
+      for (const layout_t &candidate : LAYOUTS)
+        if (!strcmp(optarg, candidate.name))
+          layout = &candidate;
+      if (!layout)
+        optind = argc + 1;
+      break;
+    case 'm':
+      map = optarg;
+      break;
+    case 'n':
+      dryRun = true;
+      break;
+    case 'd':
+      return dump(optarg, argv + optind, argc - optind);
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+
+  if (optind > argc - 2 + dryRun) {
+    fprintf(stderr,
+            "usage: dfpprov [-j threads] [-l folders|large|mp3|root] "
+            "[-m map.bin] [-n]\n"
+            "               <library dir | playlist> <card root>...\n"
+            "       dfpprov -d map.bin [name]...\n");
+    return 2;
+  }
+  return provision(argv[optind], argv + optind + 1, argc - optind - 1,
+                   *layout, map, threads, dryRun);
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Footprint report of the DFPlayerMini library.
+#
+# Compiles every translation unit of src/ for each available target in the
+# default and the DFPLAYERMINI_TINY profile and prints, as tab separated
+# values,
+#
+#   feature  <target> <profile> <file>   <text> <data> <bss>
+#   api      <target> <profile> <symbol> <size>
+#
+# "feature" rows are per source file, "api" rows list the size of every
+# function and table of the core encoder (DFPlayerMini.cpp). Targets whose
+# compiler is not installed are skipped. Keep the output around to diff
+# footprints between revisions.
+#
+# usage: extras/footprint/footprint.sh [output directory]
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+OUT=${1:-$(mktemp -d)}
+mkdir -p "$OUT"
+
+FLAGS="-Os -ffunction-sections -fdata-sections -fno-exceptions -fno-rtti"
+
+# name  compiler  size tool  nm tool  target flags
+TARGETS="
+avr      avr-g++              avr-size             avr-nm              -mmcu=atmega328p_-std=gnu++11
+cortexm0 arm-none-eabi-g++    arm-none-eabi-size   arm-none-eabi-nm    -mcpu=cortex-m0plus_-mthumb_-std=gnu++11
+host     g++                  size                 nm                  -std=c++20_-fno-asynchronous-unwind-tables
+"
+
+echo "$TARGETS" | while read -r target cxx sizetool nmtool tflags; do
+  [ -n "$target" ] || continue
+  if ! command -v "$cxx" >/dev/null 2>&1; then
+    echo "# skipping $target: $cxx not found" >&2
+    continue
+  fi
+  tflags=$(echo "$tflags" | tr '_' ' ')
+
+  for profile in default tiny; do
+    pflags=""
+    [ "$profile" = tiny ] && pflags="-DDFPLAYERMINI_TINY"
+
+    for src in "$ROOT"/src/*.cpp; do
+      name=$(basename "$src" .cpp)
+      obj="$OUT/$target-$profile-$name.o"
+      # shellcheck disable=SC2086
+      "$cxx" $FLAGS $tflags $pflags -I"$ROOT/src" -c "$src" -o "$obj"
+
+      "$sizetool" "$obj" | awk -v t="$target" -v p="$profile" -v f="$name" \
+        'NR == 2 { printf "feature\t%s\t%s\t%s\t%s\t%s\t%s\n", t, p, f, $1, $2, $3 }'
+
+      if [ "$name" = DFPlayerMini ]; then
+        "$nmtool" -S -C --size-sort --radix=d "$obj" |
+          awk -v t="$target" -v p="$profile" '
+            $3 ~ /^[TtRrDdBb]$/ {
+              size = $2 + 0
+              $1 = $2 = $3 = ""
+              sub(/^ +/, "")
+              printf "api\t%s\t%s\t%s\t%d\n", t, p, $0, size
+            }'
+      fi
+    done
+  done
+done
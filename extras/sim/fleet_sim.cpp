@@ -0,0 +1,594 @@
+/*!
+ * @file fleet_sim.cpp
+ *
+ * Discrete-event simulation of a gateway driving a fleet of modules. Time is
+ * virtual (1 us resolution), so hours of operation of thousands of modules
+ * run in seconds. Each module sits behind its own simulated UART with
+ * baud-accurate wire time, per-frame jitter and loss, and answers like the
+ * real firmware with ACKs and query replies after a randomised turnaround. The gateway side is the library itself: packets are
+ * built by DFPlayerMini, received bytes go through FrameParser, the link is
+ * paced by Pacer, status is polled with PollSet and timeouts come from
+ * RttTable.
+ *
+ * Workload per module: control commands with feedback arriving as a Poisson
+ * process, each retransmitted on timeout, plus a pipelined status poll at a
+ * fixed interval.
+ *
+ * build: g++ -std=c++17 -O2 -Isrc extras/sim/fleet_sim.cpp src/DFPlayerMini.cpp
+ *            src/DFPlayerMiniPacer.cpp src/DFPlayerMiniPoll.cpp
+ *            src/DFPlayerMiniRtt.cpp src/DFPlayerMiniState.cpp -o fleet_sim
+ *
+ * usage: fleet_sim [--devices N] [--hours H] [--baud B] [--loss P]
+ *                  [--jitter US] [--rate CMDS_PER_S] [--poll S] [--seed S]
+ *
+ */
+
+#include "DFPlayerMini.hpp"
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniPoll.hpp"
+#include "DFPlayerMiniRtt.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <queue>
+#include <random>
+#include <vector>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+/** Simulation parameters */
+struct config_t {
+  uint32_t devices = 2000;
+  double hours = 1.0;
+  uint32_t baud = LINK::DEFAULT_BAUD;
+  double loss = 0.001;     // probability a frame is lost, per direction
+  uint32_t jitter = 2000;  // us of uniform extra delay per frame
+  double rate = 0.1;       // control commands per second and module
+  double pollInterval = 5; // s between status polls
+  uint64_t seed = 1;
+};
+
+/** Module turnaround, us */
+constexpr uint32_t TURNAROUND_MIN = 8000;
+constexpr uint32_t TURNAROUND_MAX = 30000;
+constexpr uint8_t MAX_RETRIES = 3;
+
+enum : uint8_t { SERVICE, TO_MODULE, TO_HOST, ARRIVAL, POLL_START };
+
+/** One pending event */
+struct event_t {
+  uint64_t time;
+  uint64_t seq;
+  uint8_t type;
+  uint32_t device;
+  uint8_t frame[PACKET::SIZE];
+
+  bool operator>(const event_t &other) const {
+    return time != other.time ? time > other.time : seq > other.seq;
+  }
+};
+
+/** Control command waiting for its ACK */
+struct command_t {
+  uint64_t enqueued;
+  uint64_t sentAt;
+  uint8_t cmd;
+  uint16_t param;
+  uint8_t tries;
+};
+
+/** Gateway and module side of one simulated device */
+struct device_t {
+  // gateway
+  Pacer link;
+  DFPlayerMini player{true};
+  FrameParser parser;
+  query_t queries[4] = {{QUERYCMD::GET_STATUS_, 0, 0, 0, 0, 0},
+                        {QUERYCMD::GET_VOL, 0, 0, 0, 0, 0},
+                        {QUERYCMD::GET_EQ, 0, 0, 0, 0, 0},
+                        {QUERYCMD::GET_TF_TRACK, 0, 0, 0, 0, 0}};
+  PollSet polls{queries, 4, link};
+  rtt_t rttEntries[RTT::CLASSES];
+  RttTable rtt{rttEntries, 1};
+  std::deque<command_t> pending;
+  bool inFlight = false;
+  uint64_t serviceAt = UINT64_MAX;
+  uint64_t pollStartedAt = 0;
+
+  // module
+  FrameParser moduleParser;
+  uint64_t moduleFreeAt = 0;
+  uint8_t volume = 30;
+  uint16_t track = 1;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Fixed-resolution latency histogram with percentiles.
+*/
+/**************************************************************************/
+class Histogram {
+  static constexpr uint32_t BUCKET_US = 100;
+  std::vector<uint64_t> _buckets = std::vector<uint64_t>(100000);
+  uint64_t _count = 0;
+  uint64_t _max = 0;
+  double _sum = 0;
+
+public:
+  void add(uint64_t us) {
+    uint64_t index = std::min<uint64_t>(us / BUCKET_US, _buckets.size() - 1);
+    _buckets[index]++;
+    _count++;
+    _sum += us;
+    _max = std::max(_max, us);
+  }
+
+  double percentile(double p) const {
+    uint64_t target = static_cast<uint64_t>(p / 100.0 * (_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < _buckets.size(); i++) {
+      seen += _buckets[i];
+      if (seen >= target)
+        return (i + 0.5) * BUCKET_US / 1000.0;
+    }
+    return _max / 1000.0;
+  }
+
+  void print(const char *name) const {
+    if (!_count) {
+      printf("%-10s n=0\n", name);
+      return;
+    }
+    printf("%-10s n=%llu mean=%.2f p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f "
+           "max=%.2f ms\n",
+           name, static_cast<unsigned long long>(_count),
+           _sum / _count / 1000.0, percentile(50), percentile(90),
+           percentile(99), percentile(99.9), _max / 1000.0);
+  }
+};
+
+/**************************************************************************/
+/*!
+        @brief  The simulation: event queue, devices and statistics.
+*/
+/**************************************************************************/
+class Simulation {
+  config_t _cfg;
+  std::mt19937_64 _rng;
+  std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t>>
+      _events;
+  uint64_t _seq = 0;
+  uint64_t _now = 0;
+  uint64_t _end;
+
+  std::vector<device_t> _devices; // never resized, members point into it
+
+  uint64_t _framesToModule = 0;
+  uint64_t _framesToHost = 0;
+  uint64_t _lost = 0;
+  uint64_t _retransmits = 0;
+  uint64_t _failed = 0;
+  uint64_t _events_run = 0;
+  size_t _maxQueue = 0;
+  double _queueSum = 0;
+  uint64_t _queueSamples = 0;
+  Histogram _commandLatency;
+  Histogram _pollLatency;
+  Histogram _queryRtt;
+
+  uint32_t ms() const { return static_cast<uint32_t>(_now / 1000); }
+
+  double uniform() {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(_rng);
+  }
+
+  uint64_t wireUs() const {
+    return PACKET::SIZE * LINK::BITS_PER_BYTE * 1000000ULL / _cfg.baud;
+  }
+
+  void push(uint64_t time, uint8_t type, uint32_t device,
+            const uint8_t *frame = nullptr) {
+    event_t event;
+    event.time = time;
+    event.seq = _seq++;
+    event.type = type;
+    event.device = device;
+    if (frame)
+      memcpy(event.frame, frame, PACKET::SIZE);
+    _events.push(event);
+  }
+
+  void wake(uint32_t device, uint64_t at) {
+    device_t &dev = _devices[device];
+    at = std::max(at, _now);
+    if (at < dev.serviceAt) {
+      dev.serviceAt = at;
+      push(at, SERVICE, device);
+    }
+  }
+
+  /** Put a frame on a link, returns false if it was lost */
+  bool transmit(uint64_t start, uint8_t type, uint32_t device,
+                const uint8_t *frame) {
+    if (uniform() < _cfg.loss) {
+      _lost++;
+      return false;
+    }
+    uint64_t jitter =
+        _cfg.jitter ? std::uniform_int_distribution<uint64_t>(
+                          0, _cfg.jitter)(_rng)
+                    : 0;
+    push(start + wireUs() + jitter, type, device, frame);
+    return true;
+  }
+
+  void hostSend(uint32_t device, const stack_t &stack) {
+    uint8_t frame[PACKET::SIZE];
+    memcpy(frame, &stack, PACKET::SIZE);
+    _framesToModule++;
+    transmit(_now, TO_MODULE, device, frame);
+  }
+
+  void service(uint32_t device);
+  void moduleReceive(uint32_t device, const uint8_t *frame);
+  void hostReceive(uint32_t device, const uint8_t *frame);
+  void arrival(uint32_t device);
+  void pollStart(uint32_t device);
+
+  uint64_t exponential(double rate) {
+    return static_cast<uint64_t>(
+        std::exponential_distribution<double>(rate)(_rng) * 1e6);
+  }
+
+public:
+  explicit Simulation(const config_t &cfg)
+      : _cfg(cfg), _rng(cfg.seed),
+        _end(static_cast<uint64_t>(cfg.hours * 3600e6)),
+        _devices(cfg.devices) {}
+
+  void run();
+  void report(double wallSeconds) const;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Let a device's gateway side send whatever is due.
+        @param    device
+                          Index of the device.
+*/
+/**************************************************************************/
+void Simulation::service(uint32_t device) {
+  device_t &dev = _devices[device];
+  uint64_t next = UINT64_MAX;
+
+  if (dev.inFlight) {
+    command_t &cmd = dev.pending.front();
+    uint64_t deadline =
+        cmd.sentAt + dev.rtt.timeout(0, RTT::ACK) * 1000ULL;
+    if (_now >= deadline) {
+      dev.rtt.backoff(0, RTT::ACK);
+      dev.inFlight = false;
+      if (cmd.tries >= MAX_RETRIES) {
+        _failed++;
+        dev.pending.pop_front();
+      } else {
+        _retransmits++;
+      }
+    } else {
+      next = deadline;
+    }
+  }
+
+  stack_t stack;
+  if (!dev.inFlight && !dev.pending.empty() && dev.link.ready(ms())) {
+    command_t &cmd = dev.pending.front();
+    dev.player.command(cmd.cmd, cmd.param);
+    dev.player.getStack(stack);
+    dev.link.sent(ms());
+    cmd.sentAt = _now;
+    cmd.tries++;
+    dev.inFlight = true;
+    hostSend(device, stack);
+    next = std::min<uint64_t>(
+        next, _now + dev.rtt.timeout(0, RTT::ACK) * 1000ULL);
+  }
+
+  if (!dev.polls.done()) {
+    while (dev.polls.poll(ms(), stack))
+      hostSend(device, stack);
+    if (dev.polls.done())
+      _pollLatency.add(_now - dev.pollStartedAt);
+  }
+
+  if (!dev.inFlight && !dev.pending.empty())
+    next = std::min<uint64_t>(next, dev.link.nextFree() * 1000ULL);
+
+  uint16_t timeout = dev.rtt.timeout(0, RTT::QUERY);
+  for (const query_t &query : dev.queries) {
+    if (dev.polls.done())
+      break;
+    if (query.state == QUERY_STATE::IN_FLIGHT)
+      next = std::min<uint64_t>(next, (query.sentAt + timeout) * 1000ULL);
+    else if (query.state == QUERY_STATE::PENDING)
+      next = std::min<uint64_t>(
+          next, std::max<uint64_t>(dev.link.nextFree() * 1000ULL, _now + 1000));
+  }
+
+  dev.serviceAt = UINT64_MAX;
+  if (next != UINT64_MAX)
+    wake(device, next);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Deliver a frame to the emulated module and schedule its
+                answer.
+        @param    device
+                          Index of the device.
+        @param    frame
+                          The frame.
+*/
+/**************************************************************************/
+void Simulation::moduleReceive(uint32_t device, const uint8_t *frame) {
+  device_t &dev = _devices[device];
+
+  for (uint8_t i = 0; i < PACKET::SIZE; i++) {
+    if (!dev.moduleParser.parse(frame[i]))
+      continue;
+
+    const stack_t &in = dev.moduleParser.getStack();
+    uint16_t first, second;
+    DFPlayerMini::decode(in, first, second);
+
+    if (in.command == CONTROLCMD::SET_VOL)
+      dev.volume = static_cast<uint8_t>(first);
+    else if (in.command == CONTROLCMD::PLAY_TRACK)
+      dev.track = first;
+
+    uint64_t ready =
+        std::max(_now, dev.moduleFreeAt) +
+        std::uniform_int_distribution<uint32_t>(TURNAROUND_MIN,
+                                                TURNAROUND_MAX)(_rng);
+
+    DFPlayerMini reply(false);
+    bool answer = true;
+    switch (in.command) {
+    case QUERYCMD::GET_STATUS_:
+      reply.command(in.command, (PLAYBACK_SRC::TF << 8) | 1);
+      break;
+    case QUERYCMD::GET_VOL:
+      reply.command(in.command, dev.volume);
+      break;
+    case QUERYCMD::GET_EQ:
+      reply.command(in.command, EQ::NORMAL);
+      break;
+    case QUERYCMD::GET_TF_TRACK:
+      reply.command(in.command, dev.track);
+      break;
+    default:
+      answer = in.feedback == PACKET::FEEDBACK::YES;
+      reply.command(QUERYCMD::REPLY);
+      break;
+    }
+
+    if (!answer)
+      continue;
+
+    uint8_t out[PACKET::SIZE];
+    reply.getStack(out);
+    dev.moduleFreeAt = ready + wireUs();
+    _framesToHost++;
+    transmit(ready, TO_HOST, device, out);
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Deliver a frame from the module to the gateway.
+        @param    device
+                          Index of the device.
+        @param    frame
+                          The frame.
+*/
+/**************************************************************************/
+void Simulation::hostReceive(uint32_t device, const uint8_t *frame) {
+  device_t &dev = _devices[device];
+
+  for (uint8_t i = 0; i < PACKET::SIZE; i++) {
+    if (!dev.parser.parse(frame[i]))
+      continue;
+
+    const stack_t &in = dev.parser.getStack();
+    if (in.command == QUERYCMD::REPLY) {
+      if (!dev.inFlight)
+        continue;
+      command_t &cmd = dev.pending.front();
+      if (cmd.tries == 1)
+        dev.rtt.sample(0, RTT::ACK,
+                    static_cast<uint16_t>((_now - cmd.sentAt) / 1000));
+      _commandLatency.add(_now - cmd.enqueued);
+      dev.pending.pop_front();
+      dev.inFlight = false;
+    } else if (!dev.polls.done()) {
+      dev.polls.feed(in, ms());
+      for (const query_t &query : dev.queries)
+        if (query.state == QUERY_STATE::DONE && query.cmd == in.command)
+          _queryRtt.add(query.rtt * 1000ULL);
+      if (dev.polls.done())
+        _pollLatency.add(_now - dev.pollStartedAt);
+    }
+  }
+
+  service(device);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Queue a new control command and schedule the next arrival.
+        @param    device
+                          Index of the device.
+*/
+/**************************************************************************/
+void Simulation::arrival(uint32_t device) {
+  device_t &dev = _devices[device];
+
+  command_t cmd;
+  cmd.enqueued = _now;
+  cmd.sentAt = 0;
+  cmd.tries = 0;
+  if (uniform() < 0.5) {
+    cmd.cmd = CONTROLCMD::SET_VOL;
+    cmd.param = std::uniform_int_distribution<uint16_t>(0, 30)(_rng);
+  } else {
+    cmd.cmd = CONTROLCMD::PLAY_TRACK;
+    cmd.param = std::uniform_int_distribution<uint16_t>(1, 200)(_rng);
+  }
+  dev.pending.push_back(cmd);
+
+  _maxQueue = std::max(_maxQueue, dev.pending.size());
+  _queueSum += dev.pending.size();
+  _queueSamples++;
+
+  push(_now + exponential(_cfg.rate), ARRIVAL, device);
+  wake(device, _now);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start a status poll round and schedule the next one.
+        @param    device
+                          Index of the device.
+*/
+/**************************************************************************/
+void Simulation::pollStart(uint32_t device) {
+  device_t &dev = _devices[device];
+
+  if (dev.polls.done()) {
+    dev.polls.start(ms());
+    dev.pollStartedAt = _now;
+  }
+
+  push(_now + static_cast<uint64_t>(_cfg.pollInterval * 1e6), POLL_START,
+       device);
+  wake(device, _now);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Run the simulation until the configured end.
+*/
+/**************************************************************************/
+void Simulation::run() {
+  for (uint32_t i = 0; i < _cfg.devices; i++) {
+    _devices[i].link.setTiming(_cfg.baud, LINK::DEFAULT_GAP);
+    _devices[i].polls.setEstimator(&_devices[i].rtt, 0);
+    push(exponential(_cfg.rate), ARRIVAL, i);
+    push(static_cast<uint64_t>(uniform() * _cfg.pollInterval * 1e6),
+         POLL_START, i);
+  }
+
+  while (!_events.empty()) {
+    event_t event = _events.top();
+    if (event.time > _end)
+      break;
+    _events.pop();
+    _now = event.time;
+    _events_run++;
+
+    switch (event.type) {
+    case SERVICE:
+      if (event.time == _devices[event.device].serviceAt)
+        service(event.device);
+      break;
+    case TO_MODULE:
+      moduleReceive(event.device, event.frame);
+      break;
+    case TO_HOST:
+      hostReceive(event.device, event.frame);
+      break;
+    case ARRIVAL:
+      arrival(event.device);
+      break;
+    case POLL_START:
+      pollStart(event.device);
+      break;
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Print the results.
+        @param    wallSeconds
+                          Real time the run took.
+*/
+/**************************************************************************/
+void Simulation::report(double wallSeconds) const {
+  double simSeconds = _end / 1e6;
+
+  printf("devices    %u\n", _cfg.devices);
+  printf("simulated  %.0f s in %.2f s wall (%.0fx real time), %llu events\n",
+         simSeconds, wallSeconds, simSeconds / wallSeconds,
+         static_cast<unsigned long long>(_events_run));
+  printf("frames     to module %llu, to host %llu, lost %llu\n",
+         static_cast<unsigned long long>(_framesToModule),
+         static_cast<unsigned long long>(_framesToHost),
+         static_cast<unsigned long long>(_lost));
+  printf("throughput %.1f frames/s total, %.3f frames/s per module\n",
+         (_framesToModule + _framesToHost) / simSeconds,
+         (_framesToModule + _framesToHost) / simSeconds / _cfg.devices);
+  printf("commands   retransmits %llu, failed %llu\n",
+         static_cast<unsigned long long>(_retransmits),
+         static_cast<unsigned long long>(_failed));
+  printf("queue      max %zu, mean at arrival %.2f\n", _maxQueue,
+         _queueSamples ? _queueSum / _queueSamples : 0.0);
+  _commandLatency.print("command");
+  _pollLatency.print("poll");
+  _queryRtt.print("query rtt");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  config_t cfg;
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    const char *key = argv[i];
+    const char *value = argv[i + 1];
+
+    if (!strcmp(key, "--devices"))
+      cfg.devices = strtoul(value, nullptr, 0);
+    else if (!strcmp(key, "--hours"))
+      cfg.hours = atof(value);
+    else if (!strcmp(key, "--baud"))
+      cfg.baud = strtoul(value, nullptr, 0);
+    else if (!strcmp(key, "--loss"))
+      cfg.loss = atof(value);
+    else if (!strcmp(key, "--jitter"))
+      cfg.jitter = strtoul(value, nullptr, 0);
+    else if (!strcmp(key, "--rate"))
+      cfg.rate = atof(value);
+    else if (!strcmp(key, "--poll"))
+      cfg.pollInterval = atof(value);
+    else if (!strcmp(key, "--seed"))
+      cfg.seed = strtoull(value, nullptr, 0);
+    else {
+      fprintf(stderr, "unknown option %s\n", key);
+      return 1;
+    }
+  }
+
+  Simulation sim(cfg);
+  auto start = std::chrono::steady_clock::now();
+  sim.run();
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  sim.report(wall.count());
+
+  return 0;
+}
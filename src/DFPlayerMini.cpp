@@ -25,49 +25,367 @@
 
 #include "DFPlayerMini.hpp"
 
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define DFPLAYERMINI_PROGMEM PROGMEM
+#else
+#define DFPLAYERMINI_PROGMEM
+#endif
+
 using namespace DFPLAYERMINI;
 
 /**************************************************************************/
 /*!
         @brief  Class constructor
         @param  feedback
-                Boolean to control whether the packet requires the module
-                to give feedback.
+                Policy of which packets require the module to give
+                feedback; true or false for all or none.
+*/
+/**************************************************************************/
+DFPlayerMini::DFPlayerMini(FeedbackPolicy feedback) { setFeedback(feedback); }
+
+/**************************************************************************/
+/*!
+        @brief  Change which of the packets encoded from now on require the
+                module to give feedback. Ignored by DFPLAYERMINI_TINY builds,
+                whose packets never do.
+        @param  feedback
+                The policy.
 */
 /**************************************************************************/
-DFPlayerMini::DFPlayerMini(bool feedback) {
-  if (feedback)
-    _sendStack.feedback = PACKET::FEEDBACK::YES;
+void DFPlayerMini::setFeedback(FeedbackPolicy feedback) {
+#ifdef DFPLAYERMINI_TINY
+  (void)feedback;
+  _sendStack.feedback = PACKET::FEEDBACK::NO;
+#else
+  _policy = feedback;
+  _sendStack.feedback = feedback.feedback(_sendStack.command);
+#endif
+
+  // keep the current packet valid for getStack()
+  uint16_t checksum = calChecksum(_sendStack);
+  _sendStack.checksumMSB = static_cast<uint8_t>(checksum >> 8);
+  _sendStack.checksumLSB = static_cast<uint8_t>(checksum);
+}
+
+/** Parameter ranges referenced by the descriptor table */
+namespace {
+enum : uint8_t {
+  R_NONE,
+  R_ANY,
+  R_BOOL,
+  R_ROOT_TRACK,
+  R_VOLUME,
+  R_EQ,
+  R_SOURCE,
+  R_FOLDER,
+  R_FOLDER_TRACK,
+  R_GAIN,
+  R_MP3_TRACK,
+  R_ADVERT_TRACK,
+  R_LARGE_FOLDER,
+  R_LARGE_FOLDER_TRACK,
+};
+
+struct range_t {
+  uint16_t min;
+  uint16_t max;
+};
+
+/** Packed descriptor, the opcode is implied by the table position */
+struct entry_t {
+  uint8_t flags; // kind | format << 2 | policy << 4
+  uint8_t first;
+  uint8_t second;
+  uint8_t fallback;
+};
+
+constexpr uint8_t flags(uint8_t kind, uint8_t format,
+                        uint8_t policy = POLICY::SATURATE) {
+  return kind | (format << 2) | (policy << 4);
+}
+
+constexpr uint8_t CONTROL_FIRST = CONTROLCMD::PLAY_NEXT;
+constexpr uint8_t CONTROL_LAST = CONTROLCMD::SET_DAC;
+constexpr uint8_t QUERY_FIRST = REPORT::DEVICE_INSERTED;
+constexpr uint8_t QUERY_LAST = QUERYCMD::GET_FOLDERS;
+
+constexpr uint8_t NONE = flags(KIND::CONTROL, FORMAT::NONE);
+constexpr uint8_t WORD = flags(KIND::CONTROL, FORMAT::WORD);
+constexpr uint8_t REPORTED = flags(KIND::REPORT, FORMAT::WORD);
+constexpr uint8_t QUERIED = flags(KIND::QUERY, FORMAT::NONE);
+
+const range_t RANGES[] DFPLAYERMINI_PROGMEM = {
+    {0, 0},
+    {0, 0xFFFF},
+    {0, 1},
+    {LIMIT::MIN_ROOT_TRACK, LIMIT::MAX_ROOT_TRACK},
+    {LIMIT::MIN_VOLUME, LIMIT::MAX_VOLUME},
+    {EQ::NORMAL, EQ::BASE},
+    {PLAYBACK_SRC::U, PLAYBACK_SRC::SLEEP},
+    {LIMIT::MIN_FOLDER, LIMIT::MAX_FOLDER},
+    {LIMIT::MIN_FOLDER_TRACK, LIMIT::MAX_FOLDER_TRACK},
+    {0, LIMIT::MAX_GAIN},
+    {0, LIMIT::MAX_MP3_TRACK},
+    {0, LIMIT::MAX_ADVERT_TRACK},
+    {LIMIT::MIN_FOLDER, LIMIT::MAX_LARGE_FOLDER},
+    {1, LIMIT::MAX_LARGE_FOLDER_TRACK},
+};
+
+/** Control commands 0x01 - 0x1A */
+const entry_t CONTROLS[] DFPLAYERMINI_PROGMEM = {
+    {NONE, R_NONE, R_NONE, 0},                   // 0x01 PLAY_NEXT
+    {NONE, R_NONE, R_NONE, 0},                   // 0x02 PLAY_PREV
+    {WORD, R_ROOT_TRACK, R_NONE, 0},             // 0x03 PLAY_TRACK
+    {NONE, R_NONE, R_NONE, 0},                   // 0x04 INC_VOL
+    {NONE, R_NONE, R_NONE, 0},                   // 0x05 DEC_VOL
+    {WORD, R_VOLUME, R_NONE, 0},                 // 0x06 SET_VOL
+    {flags(KIND::CONTROL, FORMAT::WORD, POLICY::FALLBACK), R_EQ, R_NONE,
+     EQ::NORMAL},                                // 0x07 SET_EQ
+    {WORD, R_ROOT_TRACK, R_NONE, 0},             // 0x08 SET_PLAYBACK_MODE
+    {flags(KIND::CONTROL, FORMAT::WORD, POLICY::FALLBACK), R_SOURCE, R_NONE,
+     PLAYBACK_SRC::TF},                          // 0x09 SET_PLAYBACK_SRC
+    {NONE, R_NONE, R_NONE, 0},                   // 0x0A MODE_STANDBY
+    {NONE, R_NONE, R_NONE, 0},                   // 0x0B MODE_NORMAL
+    {NONE, R_NONE, R_NONE, 0},                   // 0x0C MODE_RESET
+    {NONE, R_NONE, R_NONE, 0},                   // 0x0D PLAY
+    {NONE, R_NONE, R_NONE, 0},                   // 0x0E PAUSE
+    {flags(KIND::CONTROL, FORMAT::BYTES), R_FOLDER, R_FOLDER_TRACK,
+     0},                                         // 0x0F PLAY_FOLDER_TRACK
+    {flags(KIND::CONTROL, FORMAT::BYTES), R_BOOL, R_GAIN, 0}, // 0x10
+    {WORD, R_BOOL, R_NONE, 0},                   // 0x11 SET_REPEAT_PLAY
+    {WORD, R_MP3_TRACK, R_NONE, 0},              // 0x12 PLAY_MP3_FOLDER
+    {WORD, R_ADVERT_TRACK, R_NONE, 0},           // 0x13 INSERT_ADVERT
+    {flags(KIND::CONTROL, FORMAT::FOLDER_12), R_LARGE_FOLDER,
+     R_LARGE_FOLDER_TRACK, 0},                   // 0x14 PLAY_LARGE_FOLDER
+    {NONE, R_NONE, R_NONE, 0},                   // 0x15 STOP_ADVERT
+    {NONE, R_NONE, R_NONE, 0},                   // 0x16 STOP
+    {WORD, R_FOLDER, R_NONE, 0},                 // 0x17 REPEAT_FOLDER
+    {NONE, R_NONE, R_NONE, 0},                   // 0x18 RANDOM_ALL
+    {WORD, R_BOOL, R_NONE, 0},                   // 0x19 REPEAT_CURRENT
+    {WORD, R_BOOL, R_NONE, 0},                   // 0x1A SET_DAC
+};
+
+#ifndef DFPLAYERMINI_TINY
+/** Reports and queries 0x3A - 0x4F */
+const entry_t QUERIES[] DFPLAYERMINI_PROGMEM = {
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x3A DEVICE_INSERTED
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x3B DEVICE_REMOVED
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x3C U_FINISHED
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x3D TF_FINISHED
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x3E FLASH_FINISHED
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x3F SEND_INIT
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x40 RETRANSMIT (error)
+    {REPORTED, R_ANY, R_NONE, 0}, // 0x41 REPLY (ACK)
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x42 GET_STATUS_
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x43 GET_VOL
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x44 GET_EQ
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x45 GET_MODE
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x46 GET_VERSION
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x47 GET_TF_FILES
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x48 GET_U_FILES
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x49 GET_FLASH_FILES
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x4A KEEP_ON
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x4B GET_TF_TRACK
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x4C GET_U_TRACK
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x4D GET_FLASH_TRACK
+    {flags(KIND::QUERY, FORMAT::WORD), R_FOLDER, R_NONE,
+     0},                          // 0x4E GET_FOLDER_FILES
+    {QUERIED, R_NONE, R_NONE, 0}, // 0x4F GET_FOLDERS
+};
+
+static_assert(sizeof(QUERIES) / sizeof(entry_t) ==
+                  QUERY_LAST - QUERY_FIRST + 1,
+              "one descriptor per query/report");
+#endif
+
+static_assert(sizeof(CONTROLS) / sizeof(entry_t) ==
+                  CONTROL_LAST - CONTROL_FIRST + 1,
+              "one descriptor per control command");
+
+template <class T> T readTable(const T *entry) {
+#if defined(__AVR__)
+  T value;
+  memcpy_P(&value, entry, sizeof(T));
+  return value;
+#else
+  return *entry;
+#endif
+}
+
+uint16_t limit(uint16_t value, uint16_t min, uint16_t max,
+               const command_t &desc) {
+  if (value >= min && value <= max)
+    return value;
+  if (desc.policy == POLICY::FALLBACK)
+    return desc.fallback;
+
+  return value < min ? min : max;
+}
+} // namespace
+
+/**************************************************************************/
+/*!
+        @brief  Look up the descriptor of a command ID.
+        @param    cmd
+                          The command ID.
+        @param    desc
+                          Set to the descriptor.
+        @return False if cmd is not part of the protocol, desc then
+                describes a raw 16 bit parameter.
+*/
+/**************************************************************************/
+bool DFPlayerMini::describe(uint8_t cmd, command_t &desc) {
+  entry_t entry = {flags(KIND::CONTROL, FORMAT::WORD), R_ANY, R_NONE, 0};
+  bool known = true;
+
+  if (cmd >= CONTROL_FIRST && cmd <= CONTROL_LAST)
+    entry = readTable(&CONTROLS[cmd - CONTROL_FIRST]);
+#ifndef DFPLAYERMINI_TINY
+  else if (cmd >= QUERY_FIRST && cmd <= QUERY_LAST)
+    entry = readTable(&QUERIES[cmd - QUERY_FIRST]);
+#endif
   else
-    _sendStack.feedback = PACKET::FEEDBACK::NO;
+    known = false;
+
+  range_t first = readTable(&RANGES[entry.first]);
+  range_t second = readTable(&RANGES[entry.second]);
+
+  desc.opcode = cmd;
+  desc.kind = entry.flags & 0x3;
+  desc.format = (entry.flags >> 2) & 0x3;
+  desc.policy = (entry.flags >> 4) & 0x1;
+  desc.minFirst = first.min;
+  desc.maxFirst = first.max;
+  desc.minSecond = second.min;
+  desc.maxSecond = second.max;
+  desc.fallback = entry.fallback;
+
+  return known;
 }
 
 /**************************************************************************/
 /*!
-        @brief  Play the next song in chronological order.
+        @brief  Encode a complete packet. This is the single encoder behind
+                every command method; it packs and range checks the
+                parameters as the command's descriptor says.
+        @param    _stack
+                          The packet to fill in.
+        @param    feedback
+                          PACKET::FEEDBACK value of the packet.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
 */
 /**************************************************************************/
-void DFPlayerMini::playNext() {
-  _sendStack.command = CONTROLCMD::PLAY_NEXT;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
+void DFPlayerMini::encode(stack_t &_stack, uint8_t feedback, uint8_t cmd,
+                          uint16_t first, uint16_t second) {
+  command_t desc;
+  describe(cmd, desc);
 
-  setChecksum();
+  first = limit(first, desc.minFirst, desc.maxFirst, desc);
+  second = limit(second, desc.minSecond, desc.maxSecond, desc);
+
+  uint16_t param;
+  switch (desc.format) {
+  case FORMAT::BYTES:
+    param = static_cast<uint16_t>((first << 8) | (second & 0xFF));
+    break;
+  case FORMAT::FOLDER_12:
+    param = static_cast<uint16_t>((first << 12) | (second & 0xFFF));
+    break;
+  default:
+    param = first;
+    break;
+  }
+
+  _stack.start_byte = PACKET::START;
+  _stack.version = PACKET::VERSION;
+  _stack.length = PACKET::LEN;
+  _stack.command = cmd;
+  _stack.feedback = feedback;
+  _stack.paramMSB = static_cast<uint8_t>(param >> 8);
+  _stack.paramLSB = static_cast<uint8_t>(param & 0xFF);
+  _stack.end_byte = PACKET::END;
+
+  uint16_t checksum = calChecksum(_stack);
+  _stack.checksumMSB = static_cast<uint8_t>(checksum >> 8);
+  _stack.checksumLSB = static_cast<uint8_t>(checksum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Play the previous song in chronological order.
+        @brief  Split the parameter of a packet the way its descriptor packs
+                it, the inverse of encode().
+        @param    _stack
+                          The packet.
+        @param    first
+                          Set to the word, folder or MSB parameter.
+        @param    second
+                          Set to the track or LSB parameter, 0 if unused.
 */
 /**************************************************************************/
-void DFPlayerMini::playPrevious() {
-  _sendStack.command = CONTROLCMD::PLAY_PREV;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
+void DFPlayerMini::decode(const stack_t &_stack, uint16_t &first,
+                          uint16_t &second) {
+  command_t desc;
+  describe(_stack.command, desc);
+
+  uint16_t param =
+      static_cast<uint16_t>((_stack.paramMSB << 8) | _stack.paramLSB);
+
+  switch (desc.format) {
+  case FORMAT::BYTES:
+    first = _stack.paramMSB;
+    second = _stack.paramLSB;
+    break;
+  case FORMAT::FOLDER_12:
+    first = param >> 12;
+    second = param & 0xFFF;
+    break;
+  default:
+    first = param;
+    second = 0;
+    break;
+  }
+}
 
-  setChecksum();
+/**************************************************************************/
+/*!
+        @brief  Encode any command into the packet to send, requesting
+                feedback as the policy says.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+*/
+/**************************************************************************/
+void DFPlayerMini::command(uint8_t cmd, uint16_t first, uint16_t second) {
+#ifdef DFPLAYERMINI_TINY
+  encode(_sendStack, PACKET::FEEDBACK::NO, cmd, first, second);
+#else
+  encode(_sendStack, _policy.feedback(cmd), cmd, first, second);
+#endif
 }
 
+/**************************************************************************/
+/*!
+        @brief  Play the next song in chronological order.
+*/
+/**************************************************************************/
+void DFPlayerMini::playNext() { command(CONTROLCMD::PLAY_NEXT); }
+
+/**************************************************************************/
+/*!
+        @brief  Play the previous song in chronological order.
+*/
+/**************************************************************************/
+void DFPlayerMini::playPrevious() { command(CONTROLCMD::PLAY_PREV); }
+
 /**************************************************************************/
 /*!
         @brief  Play a specific track in the root folder.
@@ -78,14 +396,7 @@ void DFPlayerMini::playPrevious() {
 */
 /**************************************************************************/
 void DFPlayerMini::playTrack(uint16_t trackNum) {
-  _sendStack.command = CONTROLCMD::PLAY_TRACK;
-
-  trackNum =
-      trackNum <= LIMIT::MAX_ROOT_TRACK ? trackNum : LIMIT::MAX_ROOT_TRACK;
-  _sendStack.paramMSB = static_cast<uint8_t>(trackNum >> 8);
-  _sendStack.paramLSB = static_cast<uint8_t>(trackNum & 0xFF);
-
-  setChecksum();
+  command(CONTROLCMD::PLAY_TRACK, trackNum);
 }
 
 /**************************************************************************/
@@ -98,335 +409,196 @@ void DFPlayerMini::playTrack(uint16_t trackNum) {
 */
 /**************************************************************************/
 void DFPlayerMini::playFolderTrack(uint8_t folderNum, uint8_t trackNum) {
-  _sendStack.command = CONTROLCMD::PLAY_FOLDER_TRACK;
-
-  folderNum = folderNum >= LIMIT::MIN_FOLDER ? folderNum : LIMIT::MIN_FOLDER;
-  folderNum = folderNum <= LIMIT::MAX_FOLDER ? folderNum : LIMIT::MAX_FOLDER;
-  _sendStack.paramMSB = folderNum;
-
-  trackNum =
-      trackNum >= LIMIT::MIN_FOLDER_TRACK ? trackNum : LIMIT::MIN_FOLDER_TRACK;
-  // trackNum = trackNum <= LIMIT::MAX_FOLDER_TRACK ? trackNum :
-  // LIMIT::MAX_FOLDER_TRACK;
-  _sendStack.paramLSB = trackNum;
-
-  setChecksum();
+  command(CONTROLCMD::PLAY_FOLDER_TRACK, folderNum, trackNum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Stop the current playback
+        @brief  Play a specific track from a specific folder, where the track
+                names are numbered 4 digit (e.g. 1234-mysong.mp3) and can be
+                up to 3000. Only 15 folders ("01" to "15") are supported in
+                this mode.
+        @param    folderNum
+                          The folder number.
+        @param    trackNum
+                          The track number to play.
 */
 /**************************************************************************/
-void DFPlayerMini::pause() {
-  _sendStack.command = CONTROLCMD::PAUSE;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::playLargeFolder(uint8_t folderNum, uint16_t trackNum) {
+  command(CONTROLCMD::PLAY_LARGE_FOLDER, folderNum, trackNum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Play a specific track in the folder named "MP3".
-        @param    trackNum
-                          The track number to play.
+        @brief  Start or resume the current playback
 */
 /**************************************************************************/
-// void DFPlayerMini::playFromMP3Folder(uint16_t trackNum) {
-//   _sendStack.command = USE_MP3_FOLDER;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = (trackNum >> 8) & 0xFF;
-//   _sendStack.paramLSB = trackNum & 0xFF;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::play() { command(CONTROLCMD::PLAY); }
 
 /**************************************************************************/
 /*!
-        @brief  Interrupt the current track with a new track.
-        @param    trackNum
-                          The track number to play.
+        @brief  Stop the current playback
 */
 /**************************************************************************/
-// void DFPlayerMini::playAdvertisement(uint16_t trackNum) {
-//   _sendStack.command = INSERT_ADVERT;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = (trackNum >> 8) & 0xFF;
-//   _sendStack.paramLSB = trackNum & 0xFF;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::pause() { command(CONTROLCMD::PAUSE); }
 
 /**************************************************************************/
 /*!
-        @brief  Stop the interrupting track.
+        @brief  Stop playback altogether.
 */
 /**************************************************************************/
-// void DFPlayerMini::stopAdvertisement() {
-//   _sendStack.command = STOP_ADVERT;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 0;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::stop() { command(CONTROLCMD::STOP); }
 
 /**************************************************************************/
 /*!
-        @brief  Increment the volume by 1 out of 30.
+        @brief  Play a specific track in the folder named "MP3".
+        @param    trackNum
+                          The track number to play.
 */
 /**************************************************************************/
-void DFPlayerMini::incVolume() {
-  _sendStack.command = CONTROLCMD::INC_VOL;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::playFromMP3Folder(uint16_t trackNum) {
+  command(CONTROLCMD::PLAY_MP3_FOLDER, trackNum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Decrement the volume by 1 out of 30.
+        @brief  Interrupt the current track with a new track.
+        @param    trackNum
+                          The track number to play.
 */
 /**************************************************************************/
-void DFPlayerMini::decVolume() {
-  _sendStack.command = CONTROLCMD::DEC_VOL;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::playAdvertisement(uint16_t trackNum) {
+  command(CONTROLCMD::INSERT_ADVERT, trackNum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Set the volume to a specific value out of 30.
-        @param    volume
-                          The volume level (0 - 30).
+        @brief  Stop the interrupting track.
 */
 /**************************************************************************/
-void DFPlayerMini::setVolume(uint8_t volume) {
-  _sendStack.command = CONTROLCMD::SET_VOL;
-  _sendStack.paramMSB = 0;
-
-  volume = volume <= LIMIT::MAX_VOLUME ? volume : LIMIT::MAX_VOLUME;
-  _sendStack.paramLSB = volume;
-
-  setChecksum();
-}
+void DFPlayerMini::stopAdvertisement() { command(CONTROLCMD::STOP_ADVERT); }
 
 /**************************************************************************/
 /*!
-        @brief  Set the EQ mode.
-        @param    setting
-                          The desired EQ ID.
+        @brief  Increment the volume by 1 out of 30.
 */
 /**************************************************************************/
-// void DFPlayerMini::EQSelect(uint8_t setting) {
-//   if (setting <= 5) {
-//     _sendStack.command = EQ;
-//     _sendStack.feedback = NO_FEEDBACK;
-//     _sendStack.paramMSB = 0;
-//     _sendStack.paramLSB = setting;
-//
-//     setChecksum();
-//   }
-// }
+void DFPlayerMini::incVolume() { command(CONTROLCMD::INC_VOL); }
 
 /**************************************************************************/
 /*!
-        @brief  Loop a specific track.
-        @param    trackNum
-                          The track number to play.
+        @brief  Decrement the volume by 1 out of 30.
 */
 /**************************************************************************/
-// void DFPlayerMini::loop(uint16_t trackNum) {
-//   _sendStack.command = PLAYBACK_MODE;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = (trackNum >> 8) & 0xFF;
-//   _sendStack.paramLSB = trackNum & 0xFF;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::decVolume() { command(CONTROLCMD::DEC_VOL); }
 
 /**************************************************************************/
 /*!
-        @brief  Specify the playback source.
-        @param    source
-                          The playback source ID.
+        @brief  Set the volume to a specific value out of 30.
+        @param    volume
+                          The volume level (0 - 30).
 */
 /**************************************************************************/
-void DFPlayerMini::playbackSource(uint8_t source) {
-  _sendStack.command = CONTROLCMD::SET_PLAYBACK_SRC;
-  _sendStack.paramMSB = 0;
-
-  switch (source) {
-  case PLAYBACK_SRC::U:
-  case PLAYBACK_SRC::TF:
-  case PLAYBACK_SRC::AUX:
-  case PLAYBACK_SRC::SLEEP:
-    //  case PLAYBACK_SRC::FLASH:
-    break;
-  default:
-    source = PLAYBACK_SRC::TF;
-  }
-  _sendStack.paramLSB = source;
-
-  setChecksum();
+void DFPlayerMini::setVolume(uint8_t volume) {
+  command(CONTROLCMD::SET_VOL, volume);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Put the MP3 player in standby mode (this is NOT sleep mode).
+        @brief  Specify volume gain.
+        @param    gain
+                          The specified volume gain (0 - 31).
 */
 /**************************************************************************/
-void DFPlayerMini::standbyMode() {
-  _sendStack.command = CONTROLCMD::MODE_STANDBY;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::volumeAdjustSet(uint8_t gain) {
+  command(CONTROLCMD::SET_AUDIO_AMP, 1, gain);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Pull the MP3 player out of standby mode.
+        @brief  Set the EQ mode.
+        @param    setting
+                          The desired EQ ID, invalid IDs select EQ::NORMAL.
 */
 /**************************************************************************/
-void DFPlayerMini::normalMode() {
-  _sendStack.command = CONTROLCMD::MODE_NORMAL;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::EQSelect(uint8_t setting) {
+  command(CONTROLCMD::SET_EQ, setting);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Reset all settings to factory default.
+        @brief  Loop a specific track. Shares command 0x08 with
+                playbackMode(); which meaning applies depends on the
+                module firmware.
+        @param    trackNum
+                          The track number to play.
 */
 /**************************************************************************/
-void DFPlayerMini::reset() {
-  _sendStack.command = CONTROLCMD::MODE_RESET;
-  _sendStack.paramMSB = 0;
-  _sendStack.paramLSB = 0;
-
-  setChecksum();
+void DFPlayerMini::loop(uint16_t trackNum) {
+  command(CONTROLCMD::SET_PLAYBACK_MODE, trackNum);
 }
 
 /**************************************************************************/
 /*!
-        @brief  Resume playing current track.
+        @brief  Set the playback mode.
+        @param    mode
+                          The PLAYBACK_MODE value.
 */
 /**************************************************************************/
-// void DFPlayerMini::resume() {
-//   _sendStack.command = PLAYBACK;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 1;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::playbackMode(uint8_t mode) {
+  command(CONTROLCMD::SET_PLAYBACK_MODE, mode);
+}
 
 /**************************************************************************/
 /*!
-        @brief  Pause playing current track.
+        @brief  Specify the playback source.
+        @param    source
+                          The playback source ID, invalid IDs select
+                          PLAYBACK_SRC::TF.
 */
 /**************************************************************************/
-// void DFPlayerMini::pause() {
-//   _sendStack.command = PAUSE;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 1;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::playbackSource(uint8_t source) {
+  command(CONTROLCMD::SET_PLAYBACK_SRC, source);
+}
 
 /**************************************************************************/
 /*!
-        @brief  Play a specific track from a specific folder.
-        @param    folderNum
-                          The folder number.
-        @param    trackNum
-                          The track number to play.
+        @brief  Put the MP3 player in standby mode (this is NOT sleep mode).
 */
 /**************************************************************************/
-// void DFPlayerMini::playFolder(uint8_t folderNum, uint8_t trackNum) {
-//   _sendStack.command = SPEC_FOLDER;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = folderNum;
-//   _sendStack.paramLSB = trackNum;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::standbyMode() { command(CONTROLCMD::MODE_STANDBY); }
 
 /**************************************************************************/
 /*!
-        @brief  Play a specific track from a specific folder, where the track
-                        names are numbered 4 digit (e.g. 1234-mysong.mp3) and
-   can be up to 3000. Only 15 folders ("01" to "15") are supported in this mode.
-        @param    folderNum
-                          The folder number.
-        @param    trackNum
-                          The track number to play.
+        @brief  Pull the MP3 player out of standby mode.
 */
 /**************************************************************************/
-// void DFPlayerMini::playLargeFolder(uint8_t folderNum, uint16_t trackNum) {
-//   const uint16_t arg = (((uint16_t)folderNum) << 12) | (trackNum & 0xfff);
-//
-//   _sendStack.command = SPEC_TRACK_3000;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = arg >> 8;
-//   _sendStack.paramLSB = arg & 0xff;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::normalMode() { command(CONTROLCMD::MODE_NORMAL); }
 
 /**************************************************************************/
 /*!
-        @brief  Specify volume gain.
-        @param    gain
-                          The specified volume gain.
+        @brief  Reset all settings to factory default.
 */
 /**************************************************************************/
-// void DFPlayerMini::volumeAdjustSet(uint8_t gain) {
-//   if (gain <= 31) {
-//     _sendStack.command = VOL_ADJ;
-//     _sendStack.feedback = NO_FEEDBACK;
-//     _sendStack.paramMSB = 0;
-//     _sendStack.paramLSB = VOL_ADJUST + gain;
-//
-//     setChecksum();
-//   }
-// }
+void DFPlayerMini::reset() { command(CONTROLCMD::MODE_RESET); }
 
 /**************************************************************************/
 /*!
         @brief  Play all tracks.
 */
 /**************************************************************************/
-// void DFPlayerMini::startRepeatPlay() {
-//   _sendStack.command = REPEAT_PLAY;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = START_REPEAT;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::startRepeatPlay() {
+  command(CONTROLCMD::SET_REPEAT_PLAY, REPEAT_PLAY::START);
+}
 
 /**************************************************************************/
 /*!
         @brief  Stop repeat play.
 */
 /**************************************************************************/
-// void DFPlayerMini::stopRepeatPlay() {
-//   _sendStack.command = REPEAT_PLAY;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = STOP_REPEAT;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::stopRepeatPlay() {
+  command(CONTROLCMD::SET_REPEAT_PLAY, REPEAT_PLAY::STOP);
+}
 
 /**************************************************************************/
 /*!
@@ -435,98 +607,62 @@ void DFPlayerMini::reset() {
                           The folder number.
 */
 /**************************************************************************/
-// void DFPlayerMini::repeatFolder(uint16_t folder) {
-//   _sendStack.command = REPEAT_FOLDER;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = (folder >> 8) & 0xFF;
-//   _sendStack.paramLSB = folder & 0xFF;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::repeatFolder(uint8_t folderNum) {
+  command(CONTROLCMD::REPEAT_FOLDER, folderNum);
+}
 
 /**************************************************************************/
 /*!
         @brief  Play all tracks in a random order.
 */
 /**************************************************************************/
-// void DFPlayerMini::randomAll() {
-//   _sendStack.command = RANDOM_ALL;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 0;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::randomAll() { command(CONTROLCMD::RANDOM_ALL); }
 
 /**************************************************************************/
 /*!
         @brief  Repeat the current track.
 */
 /**************************************************************************/
-// void DFPlayerMini::startRepeat() {
-//   _sendStack.command = REPEAT_CURRENT;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 0;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::startRepeat() {
+  command(CONTROLCMD::REPEAT_CURRENT, SINGLE_REPEAT::START);
+}
 
 /**************************************************************************/
 /*!
         @brief  Stop repeat play of the current track.
 */
 /**************************************************************************/
-// void DFPlayerMini::stopRepeat() {
-//   _sendStack.command = REPEAT_CURRENT;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 1;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::stopRepeat() {
+  command(CONTROLCMD::REPEAT_CURRENT, SINGLE_REPEAT::STOP);
+}
 
 /**************************************************************************/
 /*!
         @brief  Turn on DAC.
 */
 /**************************************************************************/
-// void DFPlayerMini::startDAC() {
-//   _sendStack.command = SET_DAC;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 0;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::startDAC() { command(CONTROLCMD::SET_DAC, DAC::ON); }
 
 /**************************************************************************/
 /*!
         @brief  Turn off DAC.
 */
 /**************************************************************************/
-// void DFPlayerMini::stopDAC() {
-//   _sendStack.command = SET_DAC;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = 0;
-//   _sendStack.paramLSB = 1;
-//
-//   setChecksum();
-// }
+void DFPlayerMini::stopDAC() { command(CONTROLCMD::SET_DAC, DAC::OFF); }
 
 /**************************************************************************/
 /*!
         @brief  Put the MP3 player into sleep mode.
 */
 /**************************************************************************/
-// void DFPlayerMini::sleep() { playbackSource(SLEEP); }
+void DFPlayerMini::sleep() { playbackSource(PLAYBACK_SRC::SLEEP); }
 
 /**************************************************************************/
 /*!
         @brief  Pull the MP3 player out of sleep mode.
 */
 /**************************************************************************/
-// void DFPlayerMini::wakeUp() { playbackSource(TF); }
+void DFPlayerMini::wakeUp() { playbackSource(PLAYBACK_SRC::TF); }
 
 /**************************************************************************/
 /*!
@@ -665,7 +801,7 @@ void DFPlayerMini::reset() {
    packet to calculate the checksum over.
 */
 /**************************************************************************/
-uint16_t DFPlayerMini::calChecksum(stack_t &_stack) {
+uint16_t DFPlayerMini::calChecksum(const stack_t &_stack) {
   return (~(_stack.version + _stack.length + _stack.command + _stack.feedback +
             _stack.paramMSB + _stack.paramLSB)) +
          1;
@@ -673,17 +809,16 @@ uint16_t DFPlayerMini::calChecksum(stack_t &_stack) {
 
 /**************************************************************************/
 /*!
-        @brief  return the checksum of a given config/command
-                packet.
+        @brief  Check the checksum of a given packet, e.g. one received from
+                the module.
         @param    _stack
-                          reference to a struct containing the config/command
-   packet to calculate the checksum over.
+                          reference to a struct containing the packet to check.
+        @return True if the checksum bytes match the packet content.
 */
 /**************************************************************************/
-void DFPlayerMini::setChecksum() {
-  uint16_t checksum = calChecksum(_sendStack);
-  _sendStack.checksumMSB = static_cast<uint8_t>(checksum >> 8);
-  _sendStack.checksumLSB = static_cast<uint8_t>(checksum);
+bool DFPlayerMini::checkChecksum(const stack_t &_stack) {
+  return calChecksum(_stack) ==
+         static_cast<uint16_t>((_stack.checksumMSB << 8) | _stack.checksumLSB);
 }
 
 /**************************************************************************/
@@ -722,33 +857,20 @@ void DFPlayerMini::setChecksum() {
 
 /**************************************************************************/
 /*!
-        @brief  Query the MP3 player for specific information.
+        @brief  Query the MP3 player for specific information. The answer
+                arrives as a packet with the same command ID, or 0x40 on
+                error.
         @param    cmd
                           The command/query ID.
         @param    msb
                           The payload/parameter MSB.
         @param    lsb
                           The payload/parameter LSB.
-        @return Query response, -1 if error.
 */
 /**************************************************************************/
-// int16_t DFPlayerMini::query(uint8_t cmd, uint8_t msb, uint8_t lsb) {
-//   flush();
-//
-//   _sendStack.command = cmd;
-//   _sendStack.feedback = NO_FEEDBACK;
-//   _sendStack.paramMSB = msb;
-//   _sendStack.paramLSB = lsb;
-//
-//   setChecksum();
-//   timoutTimer.start();
-//
-//   if (parseFeedback())
-//     if (recStack.command != 0x40)
-//       return (recStack.paramMSB << 8) | recStack.paramLSB;
-//
-//   return -1;
-// }
+void DFPlayerMini::query(uint8_t cmd, uint8_t msb, uint8_t lsb) {
+  command(cmd, static_cast<uint16_t>((msb << 8) | lsb));
+}
 
 /**************************************************************************/
 /*!
@@ -909,6 +1031,56 @@ void DFPlayerMini::setChecksum() {
 //   }
 // }
 
+/**************************************************************************/
+/*!
+        @brief  Feed one received byte into the parser.
+        @param    recChar
+                          The byte read from the module.
+        @return True if recChar completed a valid packet, which is then
+                available via getStack().
+*/
+/**************************************************************************/
+bool FrameParser::parse(uint8_t recChar) {
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(&_recvStack);
+
+  switch (_index) {
+  case 0:
+    if (recChar != PACKET::START)
+      return false;
+    break;
+  case 1:
+    if (recChar != PACKET::VERSION) {
+      reset();
+      return parse(recChar);
+    }
+    break;
+  case 2:
+    if (recChar != PACKET::LEN) {
+      reset();
+      return parse(recChar);
+    }
+    break;
+  case PACKET::SIZE - 1:
+    _index = 0;
+    if (recChar != PACKET::END)
+      return parse(recChar);
+    bytes[PACKET::SIZE - 1] = recChar;
+    return DFPlayerMini::checkChecksum(_recvStack);
+  default:
+    break;
+  }
+
+  bytes[_index++] = recChar;
+  return false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Drop any partially received packet.
+*/
+/**************************************************************************/
+void FrameParser::reset() { _index = 0; }
+
 /**************************************************************************/
 /*!
         @brief  Print the entire contents of the specified config/command
@@ -971,6 +1143,7 @@ void DFPlayerMini::getStack(uint8_t *_stack) const {
 /**************************************************************************/
 void DFPlayerMini::getStack(stack_t &_stack) const { _stack = _sendStack; }
 
+#ifndef DFPLAYERMINI_TINY
 /**************************************************************************/
 /*!
         @brief    Save the current received packet from the array _stack points
@@ -991,6 +1164,7 @@ void DFPlayerMini::setStack(uint8_t *_stack) {
   _recvStack.checksumLSB = _stack[8];
   _recvStack.end_byte = _stack[9];
 }
+#endif
 
 /**************************************************************************/
 /*!
@@ -22,6 +22,14 @@
 
 #include <stdint.h>
 
+/*
+ * Build profile: define DFPLAYERMINI_TINY (e.g. -DDFPLAYERMINI_TINY) for the
+ * smallest footprint. Packets never request feedback, DFPlayerMini keeps no
+ * copy of received packets and the descriptor table only covers the control
+ * commands; queries are then encoded as raw 16 bit parameters.
+ * extras/footprint/footprint.sh reports the size of both profiles.
+ */
+
 /**************************************************************************/
 /*!
         @brief  Namespace for dfplayermini
@@ -56,6 +64,17 @@ constexpr uint16_t MAX_FOLDER_TRACK =
 
 constexpr uint8_t MIN_VOLUME = 0;  // minimum system volume
 constexpr uint8_t MAX_VOLUME = 30; // maximum system volume
+
+constexpr uint16_t MIN_MP3_TRACK = 1;       // min track number in "mp3"
+constexpr uint16_t MAX_MP3_TRACK = 9999;    // max track number in "mp3"
+constexpr uint16_t MIN_ADVERT_TRACK = 1;    // min track number in "advert"
+constexpr uint16_t MAX_ADVERT_TRACK = 9999; // max track number in "advert"
+
+constexpr uint8_t MAX_LARGE_FOLDER = 15; // max folder number for 0x14
+constexpr uint16_t MAX_LARGE_FOLDER_TRACK =
+    3000; // max track number in a folder for 0x14
+
+constexpr uint8_t MAX_GAIN = 31; // max audio amplification gain
 } // namespace LIMIT
 
 /** Control Command Values */
@@ -91,6 +110,18 @@ constexpr uint8_t MODE_STANDBY = 0x0A; // enter standby mode
 constexpr uint8_t MODE_NORMAL = 0x0B;  // enter normal working mode
 constexpr uint8_t MODE_RESET = 0x0C;   // reset module
 
+/** Extended playback control */
+constexpr uint8_t PLAY_MP3_FOLDER = 0x12; // play track 0-9999 in "mp3"
+constexpr uint8_t INSERT_ADVERT = 0x13;   // interrupt with track in "advert"
+constexpr uint8_t PLAY_LARGE_FOLDER =
+    0x14; // play track 1-3000 in folder 1-15 (4 digit file names)
+constexpr uint8_t STOP_ADVERT = 0x15;    // end advert, resume interrupted track
+constexpr uint8_t STOP = 0x16;           // stop playback
+constexpr uint8_t REPEAT_FOLDER = 0x17;  // repeat all tracks of a folder
+constexpr uint8_t RANDOM_ALL = 0x18;     // play all tracks in random order
+constexpr uint8_t REPEAT_CURRENT = 0x19; // switch repeat of the current track
+constexpr uint8_t SET_DAC = 0x1A;        // switch DAC output
+
 } // namespace CONTROLCMD
 
 /** Query Command Values */
@@ -115,6 +146,28 @@ constexpr uint8_t GET_FOLDER_FILES = 0x4E;
 constexpr uint8_t GET_FOLDERS = 0x4F;
 } // namespace QUERYCMD
 
+/** Report Values (sent by the module without being asked) */
+namespace REPORT {
+constexpr uint8_t DEVICE_INSERTED = 0x3A; // storage device plugged in
+constexpr uint8_t DEVICE_REMOVED = 0x3B;  // storage device pulled out
+constexpr uint8_t U_FINISHED = 0x3C;      // track finished on U-disk
+constexpr uint8_t TF_FINISHED = 0x3D;     // track finished on TF card
+constexpr uint8_t FLASH_FINISHED = 0x3E;  // track finished on flash
+} // namespace REPORT
+
+/** Module Error Values (parameter of a RETRANSMIT packet) */
+namespace ERROR_CODE {
+constexpr uint8_t BUSY = 0x01;         // module still initialising
+constexpr uint8_t SLEEPING = 0x02;     // module is in sleep mode
+constexpr uint8_t SERIAL_ERROR = 0x03; // incomplete packet received
+constexpr uint8_t CHECKSUM = 0x04;     // packet checksum incorrect
+constexpr uint8_t OUT_OF_SCOPE = 0x05; // track number out of range
+constexpr uint8_t NOT_FOUND = 0x06;    // track not found
+constexpr uint8_t INSERTION = 0x07;    // advert while nothing plays
+constexpr uint8_t CARD_READ = 0x08;    // storage read failed
+constexpr uint8_t ENTER_SLEEP = 0x0A;  // module entered sleep mode
+} // namespace ERROR_CODE
+
 /** EQ Values */
 namespace EQ {
 constexpr uint8_t NORMAL = 0;
@@ -151,6 +204,129 @@ constexpr uint8_t STOP = 0;
 constexpr uint8_t START = 1;
 } // namespace REPEAT_PLAY
 
+/** Single Repeat Values (note the inverted meaning) */
+namespace SINGLE_REPEAT {
+constexpr uint8_t START = 0;
+constexpr uint8_t STOP = 1;
+} // namespace SINGLE_REPEAT
+
+/** DAC Values */
+namespace DAC {
+constexpr uint8_t ON = 0;
+constexpr uint8_t OFF = 1;
+} // namespace DAC
+
+/** Parameter Formats of the command descriptors */
+namespace FORMAT {
+constexpr uint8_t NONE = 0;      // no parameter, both bytes are 0
+constexpr uint8_t WORD = 1;      // one 16 bit parameter, MSB first
+constexpr uint8_t BYTES = 2;     // two 8 bit parameters in MSB and LSB
+constexpr uint8_t FOLDER_12 = 3; // 4 bit folder + 12 bit track
+} // namespace FORMAT
+
+/** Out-of-range Policies of the command descriptors */
+namespace POLICY {
+constexpr uint8_t SATURATE = 0; // clamp to the nearest limit
+constexpr uint8_t FALLBACK = 1; // replace by the descriptor's fallback value
+} // namespace POLICY
+
+/** Kinds of the command descriptors */
+namespace KIND {
+constexpr uint8_t CONTROL = 0; // control command, ACKed on request
+constexpr uint8_t QUERY = 1;   // answered with a packet of the same ID
+constexpr uint8_t REPORT = 2;  // only ever sent by the module
+} // namespace KIND
+
+/** Descriptor of one command ID of the serial protocol */
+struct command_t {
+  uint8_t opcode;     // command ID
+  uint8_t kind;       // KIND value
+  uint8_t format;     // FORMAT value
+  uint8_t policy;     // POLICY value
+  uint16_t minFirst;  // range of the word / folder / MSB parameter
+  uint16_t maxFirst;  //
+  uint16_t minSecond; // range of the track / LSB parameter
+  uint16_t maxSecond; //
+  uint8_t fallback;   // value used by POLICY::FALLBACK
+};
+
+/** Feedback Classes: masks of the command IDs whose packets request
+ * feedback, bit n for control command n, bit 0 for all queries */
+namespace FEEDBACK_CLASS {
+constexpr uint32_t NONE = 0;
+constexpr uint32_t QUERIES = 1ul; // ACK on top of the reply
+constexpr uint32_t PLAYBACK =
+    (1ul << CONTROLCMD::PLAY_NEXT) | (1ul << CONTROLCMD::PLAY_PREV) |
+    (1ul << CONTROLCMD::PLAY_TRACK) | (1ul << CONTROLCMD::SET_PLAYBACK_MODE) |
+    (1ul << CONTROLCMD::PLAY) | (1ul << CONTROLCMD::PAUSE) |
+    (1ul << CONTROLCMD::PLAY_FOLDER_TRACK) |
+    (1ul << CONTROLCMD::SET_REPEAT_PLAY) |
+    (1ul << CONTROLCMD::PLAY_MP3_FOLDER) | (1ul << CONTROLCMD::INSERT_ADVERT) |
+    (1ul << CONTROLCMD::PLAY_LARGE_FOLDER) |
+    (1ul << CONTROLCMD::STOP_ADVERT) | (1ul << CONTROLCMD::STOP) |
+    (1ul << CONTROLCMD::REPEAT_FOLDER) | (1ul << CONTROLCMD::RANDOM_ALL) |
+    (1ul << CONTROLCMD::REPEAT_CURRENT);
+constexpr uint32_t VOLUME =
+    (1ul << CONTROLCMD::INC_VOL) | (1ul << CONTROLCMD::DEC_VOL) |
+    (1ul << CONTROLCMD::SET_VOL) | (1ul << CONTROLCMD::SET_AUDIO_AMP);
+constexpr uint32_t SETTINGS = (1ul << CONTROLCMD::SET_EQ) |
+                              (1ul << CONTROLCMD::SET_PLAYBACK_SRC) |
+                              (1ul << CONTROLCMD::SET_DAC);
+constexpr uint32_t POWER = (1ul << CONTROLCMD::MODE_STANDBY) |
+                           (1ul << CONTROLCMD::MODE_NORMAL) |
+                           (1ul << CONTROLCMD::MODE_RESET);
+constexpr uint32_t CRITICAL = PLAYBACK | POWER; // not ramps and settings
+constexpr uint32_t ALL = 0xFFFFFFFFul;
+} // namespace FEEDBACK_CLASS
+
+/**************************************************************************/
+/*!
+        @brief  Which packets request feedback (an ACK) from the module.
+                Converts from the bool feedback flag: true requests it for
+                all packets, false for none. Also converts from a mask of
+                FEEDBACK_CLASS values; other integer types do not, so a
+                mask never turns into the flag.
+*/
+/**************************************************************************/
+class FeedbackPolicy {
+  uint32_t _mask;
+
+public:
+  FeedbackPolicy(bool feedback = false)
+      : _mask(feedback ? FEEDBACK_CLASS::ALL : FEEDBACK_CLASS::NONE) {}
+  FeedbackPolicy(uint32_t classes) : _mask(classes) {}
+  template <class T> FeedbackPolicy(T) = delete;
+
+  FeedbackPolicy &request(uint32_t classes) {
+    _mask |= classes;
+    return *this;
+  }
+  FeedbackPolicy &waive(uint32_t classes) {
+    _mask &= ~classes;
+    return *this;
+  }
+  FeedbackPolicy &set(uint8_t cmd, bool feedback) {
+    uint32_t bit = cmd < 32 ? 1ul << cmd : FEEDBACK_CLASS::QUERIES;
+    return feedback ? request(bit) : waive(bit);
+  }
+
+  uint32_t mask() const { return _mask; }
+  bool requests(uint8_t cmd) const {
+    return (cmd < 32 ? _mask >> cmd : _mask) & 1;
+  }
+  uint8_t feedback(uint8_t cmd) const {
+    return requests(cmd) ? PACKET::FEEDBACK::YES : PACKET::FEEDBACK::NO;
+  }
+};
+
+/** Time Helpers */
+namespace TIME {
+/** true once the wrapping counter now has passed timestamp t */
+inline bool reached(uint32_t now, uint32_t t) {
+  return static_cast<int32_t>(now - t) >= 0;
+}
+} // namespace TIME
+
 /** Struct to store entire serial datapacket used for MP3 config/control
  */
 struct stack_t {
@@ -166,6 +342,21 @@ struct stack_t {
   uint8_t end_byte;
 };
 
+/**************************************************************************/
+/*!
+        @brief  Byte-wise parser that assembles packets sent by the module.
+*/
+/**************************************************************************/
+class FrameParser {
+  stack_t _recvStack;
+  uint8_t _index = 0;
+
+public:
+  bool parse(uint8_t recChar);
+  void reset();
+  const stack_t &getStack() const { return _recvStack; }
+};
+
 /**************************************************************************/
 /*!
         @brief  Class for interacting with DFPlayerMini MP3 player
@@ -183,50 +374,60 @@ class DFPlayerMini {
                         0,
                         0,
                         PACKET::END};
+#ifndef DFPLAYERMINI_TINY
   stack_t _recvStack;
-
-  static uint16_t calChecksum(stack_t &_stack);
-  void setChecksum();
+  FeedbackPolicy _policy;
+#endif
 
 public:
+  static uint16_t calChecksum(const stack_t &_stack);
+  static bool checkChecksum(const stack_t &_stack);
+  static bool describe(uint8_t cmd, command_t &desc);
+  static void encode(stack_t &_stack, uint8_t feedback, uint8_t cmd,
+                     uint16_t first = 0, uint16_t second = 0);
+  static void decode(const stack_t &_stack, uint16_t &first,
+                     uint16_t &second);
+
   // bool _debug;
 
-  DFPlayerMini(bool feedback = true);
+  DFPlayerMini(FeedbackPolicy feedback = true);
+
+  void setFeedback(FeedbackPolicy feedback);
+  void command(uint8_t cmd, uint16_t first = 0, uint16_t second = 0);
 
   void playNext();
   void playPrevious();
   void playTrack(uint16_t trackNum);
   void playFolderTrack(uint8_t folderNum, uint8_t trackNum);
+  void playLargeFolder(uint8_t folderNum, uint16_t trackNum);
   void play();
   void pause();
+  void stop();
 
-  // void playFromMP3Folder(uint16_t trackNum);
-  // void playAdvertisement(uint16_t trackNum);
-  // void stopAdvertisement();
+  void playFromMP3Folder(uint16_t trackNum);
+  void playAdvertisement(uint16_t trackNum);
+  void stopAdvertisement();
   void incVolume();
   void decVolume();
   void setVolume(uint8_t volume);
-  // void EQSelect(uint8_t setting);
-  // void loop();
+  void volumeAdjustSet(uint8_t gain);
+  void EQSelect(uint8_t setting);
+  void loop(uint16_t trackNum);
+  void playbackMode(uint8_t mode);
   void playbackSource(uint8_t source);
   void standbyMode();
   void normalMode();
   void reset();
-  // void resume();
-  // void pause();
-  // void playFolder(uint8_t folderNum, uint8_t trackNum);
-  // void playLargeFolder(uint8_t folderNum, uint16_t trackNum);
-  // void volumeAdjustSet(uint8_t gain);
-  // void startRepeatPlay();
-  // void stopRepeatPlay();
-  // void repeatFolder(uint16_t folder);
-  // void randomAll();
-  // void startRepeat();
-  // void stopRepeat();
-  // void startDAC();
-  // void stopDAC();
-  // void sleep();
-  // void wakeUp();
+  void startRepeatPlay();
+  void stopRepeatPlay();
+  void repeatFolder(uint8_t folderNum);
+  void randomAll();
+  void startRepeat();
+  void stopRepeat();
+  void startDAC();
+  void stopDAC();
+  void sleep();
+  void wakeUp();
 
   // bool isPlaying();
   // int16_t currentVolume();
@@ -245,13 +446,15 @@ public:
   // void setTimeout(unsigned long threshold);
   // void sendData();
   // void flush();
-  // int16_t query(uint8_t cmd, uint8_t msb = 0, uint8_t lsb = 0);
+  void query(uint8_t cmd, uint8_t msb = 0, uint8_t lsb = 0);
   // bool parseFeedback();
 
   // void printStack(stack _stack);
   void getStack(uint8_t *_stack) const;
   void getStack(stack_t &_stack) const;
+#ifndef DFPLAYERMINI_TINY
   void setStack(uint8_t *_stack);
+#endif
   //  void printError();
 };
 
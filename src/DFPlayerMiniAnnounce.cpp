@@ -0,0 +1,240 @@
+/*!
+ * @file DFPlayerMiniAnnounce.cpp
+ *
+ * Announcement queue with automatic resume.
+ *
+ */
+
+#include "DFPlayerMiniAnnounce.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    queue
+                          Storage for the queued announcements.
+        @param    capacity
+                          Number of entries in queue.
+        @param    state
+                          Tracked state of the module.
+        @param    link
+                          Pacer of the module's link.
+        @param    feedback
+                          Policy of which packets require the module to give
+                          feedback.
+*/
+/**************************************************************************/
+Announcer::Announcer(announcement_t *queue, uint8_t capacity,
+                     PlaybackState &state, Pacer &link, FeedbackPolicy feedback)
+    : _queue(queue), _capacity(capacity), _state(state), _link(link),
+      _player(feedback) {}
+
+/**************************************************************************/
+/*!
+        @brief  Queue an announcement behind all announcements of the same or
+                a higher priority.
+        @param    track
+                          Track number in the "advert" and "mp3" folders.
+        @param    priority
+                          Priority, higher goes first.
+        @param    volume
+                          Announcement volume, 0 keeps the current volume.
+        @param    now
+                          Current time in ms.
+        @return False if the queue is full.
+*/
+/**************************************************************************/
+bool Announcer::announce(uint16_t track, uint8_t priority, uint8_t volume,
+                         uint32_t now) {
+  if (_count >= _capacity)
+    return false;
+
+  uint8_t i = _count;
+  while (i > 0 && _queue[i - 1].priority < priority) {
+    _queue[i] = _queue[i - 1];
+    i--;
+  }
+
+  _queue[i].requested = now;
+  _queue[i].track = track;
+  _queue[i].priority = priority;
+  _queue[i].volume = volume;
+  _count++;
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Produce the next packet of the announcement in progress, if
+                the link is free. Call this from the main loop; the packet
+                must then be written to the module.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool Announcer::poll(uint32_t now, stack_t &_stack) {
+  if (_phase == IDLE && _count)
+    begin(now);
+
+  if (_phase == ANNOUNCING && _maxDuration &&
+      now - _startedAt >= _maxDuration)
+    finish();
+
+  if (_phase == IDLE || _phase == ANNOUNCING || !_link.ready(now))
+    return false;
+
+  const step_t &step = _steps[_stepIndex++];
+  _player.command(step.cmd, step.first, step.second);
+  _player.getStack(_stack);
+  _state.observeSent(_stack);
+  _link.sent(now);
+
+  if (_phase == STARTING && (step.cmd == CONTROLCMD::INSERT_ADVERT ||
+                             step.cmd == CONTROLCMD::PLAY_MP3_FOLDER)) {
+    uint32_t latency = now - _current.requested;
+
+    _startedAt = now;
+    _stats.started++;
+    _stats.lastLatency = latency;
+    _stats.totalLatency += latency;
+    if (latency > _stats.maxLatency)
+      _stats.maxLatency = latency;
+    if (_advert)
+      _stats.inserted++;
+    _counted = _advert;
+  }
+
+  if (_stepIndex >= _stepCount)
+    _phase = _phase == STARTING ? ANNOUNCING : IDLE;
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Observe a packet received from the module. Track-finished
+                reports end the announcement, an insertion error makes it
+                fall back to direct playback and any other error, e.g. a
+                missing file, ends it early.
+        @param    _stack
+                          The packet received.
+*/
+/**************************************************************************/
+void Announcer::notify(const stack_t &_stack) {
+  if (_phase != STARTING && _phase != ANNOUNCING)
+    return;
+
+  switch (_stack.command) {
+  case REPORT::U_FINISHED:
+  case REPORT::TF_FINISHED:
+  case REPORT::FLASH_FINISHED:
+    if (_phase == ANNOUNCING)
+      finish();
+    break;
+  case QUERYCMD::RETRANSMIT:
+    if (_advert && _stack.paramLSB == ERROR_CODE::INSERTION) {
+      _advert = false;
+      _saved.status = PLAYBACK::STOPPED;
+      _stats.fallbacks++;
+      // the direct playback is counted again once it is sent
+      if (_counted) {
+        if (_stats.inserted)
+          _stats.inserted--;
+        if (_stats.started)
+          _stats.started--;
+        if (_stats.totalLatency >= _stats.lastLatency)
+          _stats.totalLatency -= _stats.lastLatency;
+        _counted = false;
+      }
+
+      _stepCount = 0;
+      _stepIndex = 0;
+      addStep(CONTROLCMD::PLAY_MP3_FOLDER, _current.track);
+      _phase = STARTING;
+    } else {
+      _stats.aborted++;
+      finish();
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Append a packet to the sequence being sent.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+*/
+/**************************************************************************/
+void Announcer::addStep(uint8_t cmd, uint16_t first, uint16_t second) {
+  if (_stepCount < MAX_STEPS)
+    _steps[_stepCount++] = {cmd, first, second};
+}
+
+/**************************************************************************/
+/*!
+        @brief  Take the next announcement off the queue and plan the
+                fastest valid way to start it.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void Announcer::begin(uint32_t now) {
+  _current = _queue[0];
+  for (uint8_t i = 1; i < _count; i++)
+    _queue[i - 1] = _queue[i];
+  _count--;
+
+  _saved = _state;
+  _advert = _state.playing() && !_state.advert;
+  _counted = false;
+  _startedAt = now;
+
+  _stepCount = 0;
+  _stepIndex = 0;
+  if (_current.volume && _current.volume != _state.volume)
+    addStep(CONTROLCMD::SET_VOL, _current.volume);
+  addStep(_advert ? CONTROLCMD::INSERT_ADVERT : CONTROLCMD::PLAY_MP3_FOLDER,
+          _current.track);
+
+  _phase = STARTING;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Plan the packets restoring what played before.
+*/
+/**************************************************************************/
+void Announcer::finish() {
+  _stepCount = 0;
+  _stepIndex = 0;
+
+  if (_state.volume != _saved.volume)
+    addStep(CONTROLCMD::SET_VOL, _saved.volume);
+
+  if (_advert) {
+    // the module resumes the interrupted track on its own
+    _state.status = PLAYBACK::PLAYING;
+    _state.advert = false;
+    _state.trackCmd = _saved.trackCmd;
+    _state.trackFirst = _saved.trackFirst;
+    _state.trackSecond = _saved.trackSecond;
+  } else if (_saved.status != PLAYBACK::STOPPED && _saved.trackCmd) {
+    addStep(_saved.trackCmd, _saved.trackFirst, _saved.trackSecond);
+    if (_saved.status == PLAYBACK::PAUSED)
+      addStep(CONTROLCMD::PAUSE);
+  }
+
+  _phase = _stepCount ? RESTORING : IDLE;
+}
@@ -0,0 +1,106 @@
+/*!
+ * @file DFPlayerMiniAnnounce.hpp
+ *
+ * Announcements that interrupt background playback and restore it
+ * afterwards. While a track plays, the announcement is inserted as an advert
+ * (0x13) and the module resumes the track by itself. Otherwise it is played
+ * directly from the "mp3" folder (0x12) and the previous track, pause state
+ * and volume are restored once it has finished. Announcement track N must
+ * therefore exist as advert/NNNN-*.mp3 and mp3/NNNN-*.mp3.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_ANNOUNCE_H__
+#define __DFPLAYERMINI_ANNOUNCE_H__
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Announcement Values */
+namespace ANNOUNCE {
+constexpr uint32_t MAX_DURATION = 60000; // ms an announcement may last
+} // namespace ANNOUNCE
+
+/** One queued announcement */
+struct announcement_t {
+  uint32_t requested; // ms timestamp of the request
+  uint16_t track;     // number in "advert" and "mp3"
+  uint8_t priority;   // higher goes first
+  uint8_t volume;     // announcement volume, 0 keeps the current one
+};
+
+/** Announcement statistics, latencies in ms */
+struct announce_stats_t {
+  uint32_t started;      // announcements started
+  uint32_t inserted;     // of those, played as advert
+  uint32_t fallbacks;    // advert refused by the module, played directly
+  uint32_t aborted;      // ended early by another module error
+  uint32_t lastLatency;  // request to start packet handed to the link
+  uint32_t maxLatency;   // worst latency seen so far
+  uint32_t totalLatency; // sum, divide by started for the mean
+};
+
+/**************************************************************************/
+/*!
+        @brief  Priority queue of announcements for one module.
+*/
+/**************************************************************************/
+class Announcer {
+  /** One packet of a start or restore sequence */
+  struct step_t {
+    uint8_t cmd;
+    uint16_t first;
+    uint16_t second;
+  };
+
+  static constexpr uint8_t MAX_STEPS = 4;
+
+  enum : uint8_t { IDLE, STARTING, ANNOUNCING, RESTORING };
+
+  announcement_t *_queue;
+  uint8_t _capacity;
+  uint8_t _count = 0;
+
+  PlaybackState &_state;
+  Pacer &_link;
+  DFPlayerMini _player;
+
+  uint8_t _phase = IDLE;
+  bool _advert = false;
+  bool _counted = false; // the insertion was counted as started
+  announcement_t _current;
+  PlaybackState _saved;
+  uint32_t _startedAt = 0;
+  uint32_t _maxDuration = ANNOUNCE::MAX_DURATION;
+
+  step_t _steps[MAX_STEPS];
+  uint8_t _stepCount = 0;
+  uint8_t _stepIndex = 0;
+
+  announce_stats_t _stats = {0, 0, 0, 0, 0, 0, 0};
+
+  void addStep(uint8_t cmd, uint16_t first = 0, uint16_t second = 0);
+  void begin(uint32_t now);
+  void finish();
+
+public:
+  Announcer(announcement_t *queue, uint8_t capacity, PlaybackState &state,
+            Pacer &link, FeedbackPolicy feedback = false);
+
+  void setMaxDuration(uint32_t ms) { _maxDuration = ms; }
+
+  bool announce(uint16_t track, uint8_t priority, uint8_t volume,
+                uint32_t now);
+  bool busy() const { return _phase != IDLE || _count != 0; }
+
+  bool poll(uint32_t now, stack_t &_stack);
+  void notify(const stack_t &_stack);
+
+  const announce_stats_t &getStats() const { return _stats; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
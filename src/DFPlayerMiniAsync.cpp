@@ -0,0 +1,395 @@
+/*!
+ * @file DFPlayerMiniAsync.cpp
+ *
+ * Executor and awaitables of the coroutine front end.
+ *
+ */
+
+#include "DFPlayerMiniAsync.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+#ifdef DFPLAYERMINI_HAS_COROUTINES
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Destroy a task that was never handed to an executor.
+*/
+/**************************************************************************/
+Task::~Task() {
+  if (_handle)
+    _handle.destroy();
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start a coroutine on the next call to run().
+        @param    task
+                          The coroutine to start.
+*/
+/**************************************************************************/
+void Executor::spawn(Task task) {
+  Waiter &waiter = task._handle.promise().waiter;
+  waiter.handle = task._handle;
+  task._handle = nullptr;
+
+  schedule(waiter);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Fire expired timeouts and resume every ready coroutine.
+        @param    now
+                          Current time in ms, e.g. millis().
+*/
+/**************************************************************************/
+void Executor::run(uint32_t now) {
+  if (!_started) {
+    _now = now;
+    _started = true;
+  }
+
+  uint32_t steps = now - _now;
+  if (steps > WHEEL_SIZE)
+    steps = WHEEL_SIZE;
+
+  for (uint32_t i = 1; i <= steps; i++)
+    expire(now - steps + i);
+  _now = now;
+
+  while (_readyHead) {
+    Waiter *waiter = _readyHead;
+    _readyHead = waiter->next;
+    if (!_readyHead)
+      _readyTail = nullptr;
+    waiter->next = nullptr;
+
+    waiter->handle.resume();
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Time out every waiter in the wheel slot of a tick whose
+                deadline has been reached.
+        @param    tick
+                          The tick whose slot is visited.
+*/
+/**************************************************************************/
+void Executor::expire(uint32_t tick) {
+  Waiter *waiter = _wheel[tick % WHEEL_SIZE];
+
+  while (waiter) {
+    Waiter *next = waiter->next;
+
+    if (static_cast<int32_t>(tick - waiter->deadline) >= 0) {
+      disarm(*waiter);
+      if (waiter->owner) {
+        *waiter->owner = nullptr;
+        waiter->owner = nullptr;
+      }
+      waiter->result = {STATUS::TIMEOUT, 0};
+      schedule(*waiter);
+    }
+
+    waiter = next;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Queue a suspended coroutine for resumption.
+        @param    waiter
+                          Node of the coroutine, must not be armed.
+*/
+/**************************************************************************/
+void Executor::schedule(Waiter &waiter) {
+  waiter.next = nullptr;
+
+  if (_readyTail)
+    _readyTail->next = &waiter;
+  else
+    _readyHead = &waiter;
+  _readyTail = &waiter;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Schedule a waiter to time out at a given deadline.
+        @param    waiter
+                          Node of the suspended coroutine.
+        @param    deadline
+                          Time in ms at which the waiter times out.
+*/
+/**************************************************************************/
+void Executor::arm(Waiter &waiter, uint32_t deadline) {
+  if (static_cast<int32_t>(deadline - _now) < 1)
+    deadline = _now + 1;
+
+  Waiter *&head = _wheel[deadline % WHEEL_SIZE];
+  waiter.deadline = deadline;
+  waiter.prev = nullptr;
+  waiter.next = head;
+  if (head)
+    head->prev = &waiter;
+  head = &waiter;
+  waiter.armed = true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Cancel the timeout of a waiter, if any.
+        @param    waiter
+                          Node of the suspended coroutine.
+*/
+/**************************************************************************/
+void Executor::disarm(Waiter &waiter) {
+  if (!waiter.armed)
+    return;
+
+  if (waiter.prev)
+    waiter.prev->next = waiter.next;
+  else
+    _wheel[waiter.deadline % WHEEL_SIZE] = waiter.next;
+  if (waiter.next)
+    waiter.next->prev = waiter.prev;
+
+  waiter.prev = nullptr;
+  waiter.next = nullptr;
+  waiter.armed = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Suspend the awaiting coroutine for the requested delay.
+        @param    handle
+                          The awaiting coroutine.
+*/
+/**************************************************************************/
+void Executor::Sleep::await_suspend(std::coroutine_handle<> handle) {
+  waiter.handle = handle;
+  executor.arm(waiter, executor.now() + ms);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    executor
+                          Executor resuming the coroutines awaiting this
+                          module.
+        @param    send
+                          Function writing a complete packet to the module.
+        @param    context
+                          Opaque pointer passed back to send.
+        @param    feedback
+                          Policy of which packets require the module to give
+                          feedback (an ACK).
+*/
+/**************************************************************************/
+AsyncPlayer::AsyncPlayer(Executor &executor, send_t send, void *context,
+                         FeedbackPolicy feedback)
+    : _executor(executor), _send(send), _context(context),
+      _player(feedback) {}
+
+/**************************************************************************/
+/*!
+        @brief  Send the packet last encoded through operator->. Awaiting
+                the result waits for the ACK if feedback is enabled.
+        @return Awaitable operation.
+*/
+/**************************************************************************/
+AsyncPlayer::Operation AsyncPlayer::send() {
+  stack_t stack;
+  _player.getStack(stack);
+
+  return Operation(*this, &_reply,
+                   stack.feedback == PACKET::FEEDBACK::YES ? QUERYCMD::REPLY
+                                                           : 0,
+                   true);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Query the module. Awaiting the result waits for the reply.
+        @param    cmd
+                          The command/query ID.
+        @param    msb
+                          The payload/parameter MSB.
+        @param    lsb
+                          The payload/parameter LSB.
+        @return Awaitable operation whose value is the queried parameter.
+*/
+/**************************************************************************/
+AsyncPlayer::Operation AsyncPlayer::query(uint8_t cmd, uint8_t msb,
+                                          uint8_t lsb) {
+  // encoded in await_suspend, a pending operation may still own the packet
+  Operation operation(*this, &_reply, cmd, true);
+  operation._query = cmd;
+  operation._msb = msb;
+  operation._lsb = lsb;
+
+  return operation;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Wait until the module reports the end of a track. Does not
+                time out.
+        @return Awaitable operation whose value is the finished track.
+*/
+/**************************************************************************/
+AsyncPlayer::Operation AsyncPlayer::trackFinished() {
+  return Operation(*this, &_report, 0, false);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Feed one byte read from the module.
+        @param    recChar
+                          The received byte.
+*/
+/**************************************************************************/
+void AsyncPlayer::feed(uint8_t recChar) {
+  if (_parser.parse(recChar))
+    feed(_parser.getStack());
+}
+
+/**************************************************************************/
+/*!
+        @brief  Feed a complete packet received from the module and wake up
+                the coroutine waiting for it.
+        @param    _stack
+                          The received packet.
+*/
+/**************************************************************************/
+void AsyncPlayer::feed(const stack_t &_stack) {
+  uint16_t value = static_cast<uint16_t>((_stack.paramMSB << 8) |
+                                         _stack.paramLSB);
+
+  switch (_stack.command) {
+  case REPORT::U_FINISHED:
+  case REPORT::TF_FINISHED:
+  case REPORT::FLASH_FINISHED:
+    complete(_report, STATUS::OK, value);
+    break;
+  case QUERYCMD::RETRANSMIT:
+    complete(_reply, STATUS::ERROR, _stack.paramLSB);
+    break;
+  default:
+    if (_stack.command == _expect)
+      complete(_reply, STATUS::OK, value);
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write the current packet through the send function.
+*/
+/**************************************************************************/
+void AsyncPlayer::transmit() {
+  uint8_t frame[PACKET::SIZE];
+  _player.getStack(frame);
+
+  _send(_context, frame, PACKET::SIZE);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Resolve the waiter of a slot, if any.
+        @param    slot
+                          The slot holding the waiter.
+        @param    status
+                          The completion status.
+        @param    value
+                          The completion value.
+*/
+/**************************************************************************/
+void AsyncPlayer::complete(Waiter *&slot, uint8_t status, uint16_t value) {
+  Waiter *waiter = slot;
+  if (!waiter)
+    return;
+
+  slot = nullptr;
+  waiter->owner = nullptr;
+  _executor.disarm(*waiter);
+  waiter->result = {status, value};
+  _executor.schedule(*waiter);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Complete immediately if the slot is taken or nothing has to
+                be waited for.
+        @return True if the awaiting coroutine does not suspend.
+*/
+/**************************************************************************/
+bool AsyncPlayer::Operation::await_ready() {
+  if (*_slot) {
+    _waiter.result = {STATUS::BUSY, 0};
+    return true;
+  }
+
+  if (_transmit && !_expect) {
+    _player.transmit();
+    _waiter.result = {STATUS::OK, 0};
+    return true;
+  }
+
+  return false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Register the awaiting coroutine, then send the packet.
+        @param    handle
+                          The awaiting coroutine.
+*/
+/**************************************************************************/
+void AsyncPlayer::Operation::await_suspend(std::coroutine_handle<> handle) {
+  _waiter.handle = handle;
+  _waiter.owner = _slot;
+  *_slot = &_waiter;
+
+  if (_transmit) {
+    uint32_t threshold = _player._threshold;
+    if (_player._rtt)
+      threshold = _player._rtt->timeout(_player._device,
+                                        RttTable::classOf(_expect));
+
+    _sentAt = _player._executor.now();
+    _player._expect = _expect;
+    _player._executor.arm(_waiter, _sentAt + threshold);
+    if (_query)
+      _player._player.query(_query, _msb, _lsb);
+    _player.transmit();
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Feed the round trip into the estimator, if one is set, and
+                trace timeouts.
+        @return The result of the operation.
+*/
+/**************************************************************************/
+reply_t AsyncPlayer::Operation::await_resume() {
+  if (_waiter.result.status == STATUS::TIMEOUT)
+    DFPLAYERMINI_TRACE_INSTANT(TRACE::TIMEOUT, _player._device, _expect);
+
+  RttTable *rtt = _player._rtt;
+  if (!rtt || !_transmit || !_expect || _waiter.result.status == STATUS::BUSY)
+    return _waiter.result;
+
+  uint8_t cls = RttTable::classOf(_expect);
+  if (_waiter.result.status == STATUS::TIMEOUT)
+    rtt->backoff(_player._device, cls);
+  else
+    rtt->sample(_player._device, cls,
+                static_cast<uint16_t>(_player._executor.now() - _sentAt));
+
+  return _waiter.result;
+}
+
+#endif // DFPLAYERMINI_HAS_COROUTINES
@@ -0,0 +1,219 @@
+/*!
+ * @file DFPlayerMiniAsync.hpp
+ *
+ * C++20 coroutine front end for the DFPlayerMini packet layer. Intended for
+ * host-side orchestration code, where one single-threaded Executor drives the
+ * control flows of many modules at once, e.g.
+ *
+ *     co_await player.send();                  // wait for the ACK
+ *     int16_t vol = (co_await player.query(QUERYCMD::GET_VOL)).value;
+ *     co_await player.trackFinished();
+ *
+ * Every awaitable keeps its bookkeeping inside the awaiting coroutine frame,
+ * so awaiting never allocates. Only spawning a Task allocates its frame.
+ *
+ * Compiles to nothing unless the toolchain provides <coroutine>.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_ASYNC_H__
+#define __DFPLAYERMINI_ASYNC_H__
+
+#if defined(__has_include)
+#if __has_include(<coroutine>) && __cplusplus >= 202002L
+#define DFPLAYERMINI_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifdef DFPLAYERMINI_HAS_COROUTINES
+
+#include "DFPlayerMini.hpp"
+#include "DFPlayerMiniRtt.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <stddef.h>
+
+namespace DFPLAYERMINI {
+
+/** Completion Status of an awaitable */
+namespace STATUS {
+constexpr uint8_t OK = 0;      // reply, ACK or report received
+constexpr uint8_t TIMEOUT = 1; // nothing received within the timeout
+constexpr uint8_t ERROR = 2;   // module answered 0x40, value is the error code
+constexpr uint8_t BUSY = 3;    // another await of the same kind is pending
+} // namespace STATUS
+
+/** Result of an awaitable */
+struct reply_t {
+  uint8_t status;
+  uint16_t value;
+};
+
+class Executor;
+
+/**************************************************************************/
+/*!
+        @brief  Node linking a suspended coroutine into the executor's ready
+                queue and timer wheel. Lives inside the awaiting frame.
+*/
+/**************************************************************************/
+struct Waiter {
+  std::coroutine_handle<> handle;
+  Waiter **owner = nullptr; // slot to clear when the waiter times out
+  Waiter *prev = nullptr;
+  Waiter *next = nullptr;
+  uint32_t deadline = 0;
+  bool armed = false;
+  reply_t result = {STATUS::OK, 0};
+};
+
+/**************************************************************************/
+/*!
+        @brief  Fire-and-forget coroutine started with Executor::spawn().
+*/
+/**************************************************************************/
+class Task {
+public:
+  struct promise_type {
+    Waiter waiter;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // nobody awaits a task, so an escaping exception cannot be rethrown
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Task(Task &&other) : _handle(other._handle) { other._handle = nullptr; }
+  ~Task();
+
+private:
+  friend class Executor;
+  explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+  std::coroutine_handle<promise_type> _handle;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Single-threaded executor multiplexing any number of
+                coroutines. Timeouts are kept in a hashed timer wheel with
+                1 ms slots, so arming and cancelling are O(1).
+*/
+/**************************************************************************/
+class Executor {
+  static constexpr uint16_t WHEEL_SIZE = 256;
+
+  Waiter *_wheel[WHEEL_SIZE] = {};
+  Waiter *_readyHead = nullptr;
+  Waiter *_readyTail = nullptr;
+  uint32_t _now = 0;
+  bool _started = false;
+
+  void expire(uint32_t tick);
+
+public:
+  void spawn(Task task);
+  void run(uint32_t now);
+  uint32_t now() const { return _now; }
+  bool idle() const { return _readyHead == nullptr; }
+
+  void schedule(Waiter &waiter);
+  void arm(Waiter &waiter, uint32_t deadline);
+  void disarm(Waiter &waiter);
+
+  /** Awaitable that resumes the coroutine after a delay */
+  struct Sleep {
+    Executor &executor;
+    uint32_t ms;
+    Waiter waiter;
+
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const {}
+  };
+
+  Sleep sleep(uint32_t ms) { return Sleep{*this, ms, {}}; }
+};
+
+/**************************************************************************/
+/*!
+        @brief  Awaitable view of one module. Frames are encoded by the
+                wrapped DFPlayerMini (reachable with ->) and handed to a
+                user supplied send function; everything read from the module
+                must be fed back through feed().
+*/
+/**************************************************************************/
+class AsyncPlayer {
+public:
+  typedef void (*send_t)(void *context, const uint8_t *frame, uint8_t len);
+
+  /** Awaitable waiting for an ACK, a query reply or a report */
+  class Operation {
+    friend class AsyncPlayer;
+
+    AsyncPlayer &_player;
+    Waiter **_slot;
+    uint8_t _expect;
+    bool _transmit;
+    uint8_t _query = 0; // query encoded once the player is free, 0 if none
+    uint8_t _msb = 0;
+    uint8_t _lsb = 0;
+    uint32_t _sentAt = 0;
+    Waiter _waiter;
+
+    Operation(AsyncPlayer &player, Waiter **slot, uint8_t expect,
+              bool transmit)
+        : _player(player), _slot(slot), _expect(expect), _transmit(transmit) {
+    }
+
+  public:
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    reply_t await_resume();
+  };
+
+  AsyncPlayer(Executor &executor, send_t send, void *context,
+              FeedbackPolicy feedback = true);
+
+  DFPlayerMini *operator->() { return &_player; }
+  void setTimeout(uint32_t threshold) { _threshold = threshold; }
+  void setEstimator(RttTable *rtt, uint8_t device) {
+    _rtt = rtt;
+    _device = device;
+  }
+
+  Operation send();
+  Operation query(uint8_t cmd, uint8_t msb = 0, uint8_t lsb = 0);
+  Operation trackFinished();
+
+  void feed(uint8_t recChar);
+  void feed(const stack_t &_stack);
+
+private:
+  void transmit();
+  void complete(Waiter *&slot, uint8_t status, uint16_t value);
+
+  Executor &_executor;
+  send_t _send;
+  void *_context;
+  DFPlayerMini _player;
+  FrameParser _parser;
+  uint32_t _threshold = 100;
+  RttTable *_rtt = nullptr;
+  uint8_t _device = 0;
+
+  Waiter *_reply = nullptr;
+  uint8_t _expect = 0;
+  Waiter *_report = nullptr;
+};
+
+} // namespace DFPLAYERMINI
+
+#endif // DFPLAYERMINI_HAS_COROUTINES
+
+#endif
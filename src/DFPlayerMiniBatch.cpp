@@ -0,0 +1,148 @@
+/*!
+ * @file DFPlayerMiniBatch.cpp
+ *
+ * Bulk transmit path.
+ *
+ */
+
+#include "DFPlayerMiniBatch.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+#include <string.h>
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    port
+                          Transport the packets are written to.
+        @param    buffer
+                          Storage for frames * PACKET::SIZE bytes.
+        @param    frames
+                          Number of packets the buffer holds.
+*/
+/**************************************************************************/
+FrameBatch::FrameBatch(Transport &port, uint8_t *buffer, uint8_t frames)
+    : _port(port), _buffer(buffer), _capacity(frames) {}
+
+/**************************************************************************/
+/*!
+        @brief  Queue the packet last encoded by a player.
+        @param    player
+                          The player.
+        @return False if the batch is full.
+*/
+/**************************************************************************/
+bool FrameBatch::add(const DFPlayerMini &player) {
+  if (full())
+    return false;
+
+  player.getStack(_buffer + _count++ * PACKET::SIZE);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Queue a packet.
+        @param    _stack
+                          The packet.
+        @return False if the batch is full.
+*/
+/**************************************************************************/
+bool FrameBatch::add(const stack_t &_stack) {
+  if (full())
+    return false;
+
+  memcpy(_buffer + _count++ * PACKET::SIZE, &_stack, PACKET::SIZE);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write all queued packets with a single write. Packets the
+                transport takes only in part stay queued, and the next flush
+                continues with their remaining bytes.
+        @return Number of bytes accepted by the transport.
+*/
+/**************************************************************************/
+size_t FrameBatch::flush() {
+  if (!_count)
+    return 0;
+
+  size_t pending = _count * PACKET::SIZE - _sent;
+  uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+  size_t written = _port.write(_buffer + _sent, pending);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, TRACE::NO_DEVICE, _buffer[3], 0,
+                          _count);
+
+  // drop the packets written completely, keep the rest at the front
+  size_t bytes = _sent + (written < pending ? written : pending);
+  uint8_t done = static_cast<uint8_t>(bytes / PACKET::SIZE);
+  _count -= done;
+  _sent = static_cast<uint8_t>(bytes % PACKET::SIZE);
+  if (done && _count)
+    memmove(_buffer, _buffer + done * PACKET::SIZE, _count * PACKET::SIZE);
+  return written;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write the packet last encoded by a player with a single
+                write.
+        @param    port
+                          The transport.
+        @param    player
+                          The player.
+        @return Number of bytes accepted by the transport.
+*/
+/**************************************************************************/
+size_t FrameBatch::send(Transport &port, const DFPlayerMini &player) {
+  uint8_t frame[PACKET::SIZE];
+  player.getStack(frame);
+
+  uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+  size_t written = port.write(frame, PACKET::SIZE);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, TRACE::NO_DEVICE, frame[3]);
+  return written;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write packets kept in separate buffers with gathered
+                writes of up to TRANSPORT::MAX_SPANS packets, where the
+                transport supports them.
+        @param    port
+                          The transport.
+        @param    stacks
+                          The packets.
+        @param    count
+                          Number of packets.
+        @return Number of bytes accepted by the transport, less than all
+                if it stopped taking them.
+*/
+/**************************************************************************/
+size_t FrameBatch::send(Transport &port, const stack_t *const *stacks,
+                        size_t count) {
+  span_t spans[TRANSPORT::MAX_SPANS];
+  size_t total = 0;
+
+  for (size_t offset = 0; offset < count; offset += TRANSPORT::MAX_SPANS) {
+    uint8_t n = count - offset < TRANSPORT::MAX_SPANS
+                    ? static_cast<uint8_t>(count - offset)
+                    : TRANSPORT::MAX_SPANS;
+    for (uint8_t i = 0; i < n; i++) {
+      spans[i].data = reinterpret_cast<const uint8_t *>(stacks[offset + i]);
+      spans[i].len = PACKET::SIZE;
+    }
+
+    uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+    size_t written = port.writev(spans, n);
+    DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, TRACE::NO_DEVICE,
+                            stacks[offset]->command, 0, n);
+    total += written;
+    if (written < n * PACKET::SIZE)
+      break;
+  }
+  return total;
+}
@@ -0,0 +1,47 @@
+/*!
+ * @file DFPlayerMiniBatch.hpp
+ *
+ * Transmit path that hands complete packets to a transport. A single packet
+ * costs one write(buf, len) instead of one write per byte; packets queued
+ * with add() leave in one write on flush(), and packets spread over
+ * separate buffers leave in one gathered write.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_BATCH_H__
+#define __DFPLAYERMINI_BATCH_H__
+
+#include "DFPlayerMiniTransport.hpp"
+
+namespace DFPLAYERMINI {
+
+/**************************************************************************/
+/*!
+        @brief  Collects packets for one transport and writes them in bulk.
+*/
+/**************************************************************************/
+class FrameBatch {
+  Transport &_port;
+  uint8_t *_buffer;
+  uint8_t _capacity;
+  uint8_t _count = 0;
+  uint8_t _sent = 0; // bytes of the first packet already written
+
+public:
+  FrameBatch(Transport &port, uint8_t *buffer, uint8_t frames);
+
+  bool add(const DFPlayerMini &player);
+  bool add(const stack_t &_stack);
+  size_t flush();
+
+  uint8_t count() const { return _count; }
+  bool full() const { return _count >= _capacity; }
+
+  static size_t send(Transport &port, const DFPlayerMini &player);
+  static size_t send(Transport &port, const stack_t *const *stacks,
+                     size_t count);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,590 @@
+/*!
+ * @file DFPlayerMiniBus.cpp
+ *
+ * Shared-memory command bus.
+ *
+ */
+
+#include "DFPlayerMiniBus.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace DFPLAYERMINI;
+
+namespace {
+
+/** Offset of the request ring, behind the header */
+constexpr size_t requestOffset() {
+  return (sizeof(bus_header_t) + BUS::CACHE_LINE - 1) / BUS::CACHE_LINE *
+         BUS::CACHE_LINE;
+}
+
+bool powerOfTwo(uint32_t value) { return value && !(value & (value - 1)); }
+
+} // namespace
+
+/**************************************************************************/
+/*!
+        @brief  Get the size of the shared memory a bus needs.
+        @param    requestSlots
+                          Slots of the request ring, a power of two.
+        @param    eventSlots
+                          Slots of the event ring, a power of two.
+        @return Size in bytes.
+*/
+/**************************************************************************/
+size_t Bus::size(uint32_t requestSlots, uint32_t eventSlots) {
+  return requestOffset() + requestSlots * sizeof(bus_request_slot_t) +
+         eventSlots * sizeof(bus_event_slot_t);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Create the shared memory object of a new bus and map it.
+                Called by the owner process.
+        @param    name
+                          POSIX shared memory name, e.g. "/dfplayer".
+        @param    requestSlots
+                          Slots of the request ring, a power of two.
+        @param    eventSlots
+                          Slots of the event ring, a power of two.
+        @return False if the object could not be created.
+*/
+/**************************************************************************/
+bool Bus::create(const char *name, uint32_t requestSlots,
+                 uint32_t eventSlots) {
+  close();
+
+  if (!powerOfTwo(requestSlots) || !powerOfTwo(eventSlots))
+    return false;
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0660);
+  if (fd < 0)
+    return false;
+
+  size_t bytes = size(requestSlots, eventSlots);
+  void *memory = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+    memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED)
+    return false;
+
+  attach(memory, bytes, true, requestSlots, eventSlots);
+  _mapped = true;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Map the shared memory object of an existing bus. Called by
+                the client processes.
+        @param    name
+                          POSIX shared memory name.
+        @return False if the object does not exist or is no bus.
+*/
+/**************************************************************************/
+bool Bus::open(const char *name) {
+  close();
+
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return false;
+
+  struct stat info;
+  void *memory = MAP_FAILED;
+  if (fstat(fd, &info) == 0 &&
+      static_cast<size_t>(info.st_size) >= requestOffset())
+    memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED)
+    return false;
+
+  if (!attach(memory, info.st_size, false)) {
+    munmap(memory, info.st_size);
+    return false;
+  }
+
+  _mapped = true;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Use memory mapped by the caller, e.g. for threads of one
+                process.
+        @param    memory
+                          The memory, aligned to BUS::CACHE_LINE.
+        @param    size
+                          Size of the memory in bytes.
+        @param    init
+                          Boolean to control whether the bus is initialised
+                          or an initialised one is validated.
+        @param    requestSlots
+                          Slots of the request ring, if init is set.
+        @param    eventSlots
+                          Slots of the event ring, if init is set.
+        @return False if the memory holds no valid bus.
+*/
+/**************************************************************************/
+bool Bus::attach(void *memory, size_t size, bool init, uint32_t requestSlots,
+                 uint32_t eventSlots) {
+  bus_header_t *header = static_cast<bus_header_t *>(memory);
+
+  if (init) {
+    if (!powerOfTwo(requestSlots) || !powerOfTwo(eventSlots) ||
+        size < Bus::size(requestSlots, eventSlots))
+      return false;
+
+    header = new (memory) bus_header_t;
+    header->magic = BUS::MAGIC;
+    header->version = BUS::VERSION;
+    header->requestSlots = requestSlots;
+    header->eventSlots = eventSlots;
+    header->clients.store(0, std::memory_order_relaxed);
+    header->eventTail.store(0, std::memory_order_relaxed);
+  } else if (header->magic != BUS::MAGIC || header->version != BUS::VERSION ||
+             size < Bus::size(header->requestSlots, header->eventSlots)) {
+    return false;
+  }
+
+  uint8_t *base = static_cast<uint8_t *>(memory);
+  _header = header;
+  _requests.attach(
+      &header->requests,
+      reinterpret_cast<bus_request_slot_t *>(base + requestOffset()),
+      header->requestSlots, init);
+  _events = reinterpret_cast<bus_event_slot_t *>(
+      base + requestOffset() +
+      header->requestSlots * sizeof(bus_request_slot_t));
+  _size = size;
+  _mapped = false;
+
+  if (init) {
+    for (uint32_t i = 0; i < eventSlots; i++)
+      new (&_events[i]) bus_event_slot_t{{0}, {}};
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Unmap the bus.
+*/
+/**************************************************************************/
+void Bus::close() {
+  if (_mapped)
+    munmap(_header, _size);
+
+  _header = nullptr;
+  _requests = MpscRing<bus_request_t>();
+  _events = nullptr;
+  _size = 0;
+  _mapped = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Remove the shared memory object. Mappings stay valid.
+        @param    name
+                          POSIX shared memory name.
+*/
+/**************************************************************************/
+void Bus::unlink(const char *name) { shm_unlink(name); }
+
+/**************************************************************************/
+/*!
+        @brief  Get a client id, used to route answers back.
+        @return The id, BUS::BROADCAST if all ids are taken.
+*/
+/**************************************************************************/
+uint8_t Bus::connect() {
+  uint32_t id = _header->clients.fetch_add(1, std::memory_order_relaxed);
+  return id < BUS::BROADCAST ? static_cast<uint8_t>(id) : BUS::BROADCAST;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Claim, fill and commit a request.
+        @param    client
+                          Id from connect().
+        @param    device
+                          Index of the module at the owner.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+        @param    tag
+                          Opaque value returned with the answer.
+        @return False if the ring is full.
+*/
+/**************************************************************************/
+bool Bus::submit(uint8_t client, uint16_t device, uint8_t cmd, uint16_t first,
+                 uint16_t second, uint32_t tag) {
+  uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+  bus_request_t *request = claim();
+  if (!request)
+    return false;
+
+  request->device = device;
+  request->cmd = cmd;
+  request->client = client;
+  request->first = first;
+  request->second = second;
+  request->tag = tag;
+  commit(request);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::ENQUEUE, start, device, cmd, second);
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Append an event to the event ring, overwriting the oldest
+                one. Owner only.
+        @param    event
+                          The event.
+*/
+/**************************************************************************/
+void Bus::publish(const bus_event_t &event) {
+  uint32_t pos = _header->eventTail.load(std::memory_order_relaxed);
+  bus_event_slot_t &slot = _events[pos & (_header->eventSlots - 1)];
+
+  // odd while being written, 2 * (pos + 1) once complete
+  slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = event;
+  slot.seq.store(2 * (pos + 1), std::memory_order_release);
+  _header->eventTail.store(pos + 1, std::memory_order_release);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Get the position the next event will be published at.
+        @return The position.
+*/
+/**************************************************************************/
+uint32_t Bus::eventTail() const {
+  return _header->eventTail.load(std::memory_order_acquire);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Read the event at a cursor and advance it.
+        @param    cursor
+                          Position of the reader.
+        @param    event
+                          Set to the event read.
+        @return 1 if an event was read, 0 if there is none, minus the number
+                of events skipped if the reader was overtaken.
+*/
+/**************************************************************************/
+int32_t Bus::readEvent(uint32_t &cursor, bus_event_t &event) const {
+  uint32_t tail = eventTail();
+  if (cursor == tail)
+    return 0;
+
+  uint32_t slots = _header->eventSlots;
+  if (tail - cursor > slots) {
+    int32_t skipped = static_cast<int32_t>(tail - slots - cursor);
+    cursor = tail - slots;
+    return -skipped;
+  }
+
+  const bus_event_slot_t &slot = _events[cursor & (slots - 1)];
+  uint32_t expected = 2 * (cursor + 1);
+  if (slot.seq.load(std::memory_order_acquire) == expected) {
+    event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == expected) {
+      cursor++;
+      return 1;
+    }
+  }
+
+  // overwritten while reading: skip to the oldest event still available
+  tail = eventTail();
+  int32_t skipped = static_cast<int32_t>(tail - slots + 1 - cursor);
+  cursor = tail - slots + 1;
+  return -(skipped > 0 ? skipped : 1);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor, starts at the newest event.
+        @param    bus
+                          The bus.
+        @param    client
+                          Id from Bus::connect().
+*/
+/**************************************************************************/
+BusReader::BusReader(const Bus &bus, uint8_t client)
+    : _bus(bus), _client(client), _cursor(bus.eventTail()) {}
+
+/**************************************************************************/
+/*!
+        @brief  Read the next event for this client or all clients.
+        @param    event
+                          Set to the event read.
+        @return False if there is none.
+*/
+/**************************************************************************/
+bool BusReader::read(bus_event_t &event) {
+  for (;;) {
+    int32_t result = _bus.readEvent(_cursor, event);
+    if (result == 0)
+      return false;
+    if (result < 0) {
+      _lost += static_cast<uint32_t>(-result);
+      continue;
+    }
+    if (event.client == _client || event.client == BUS::BROADCAST)
+      return true;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    bus
+                          The bus, created by this process.
+        @param    devices
+                          State of the modules, with port and link set.
+        @param    count
+                          Number of entries in devices.
+        @param    feedback
+                          Policy of which packets require the modules to give
+                          feedback.
+*/
+/**************************************************************************/
+BusGateway::BusGateway(Bus &bus, bus_device_t *devices, uint16_t count,
+                       FeedbackPolicy feedback)
+    : _bus(bus), _devices(devices), _count(count), _player(feedback) {
+  for (uint16_t i = 0; i < _count; i++) {
+    _devices[i].deferred = 0;
+    _devices[i].hasPending = false;
+    _devices[i].hasInFlight = false;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Fail unanswered requests, send what the links allow, then
+                drain the request ring. A module answers one request at a
+                time; requests for a busy module are held by the gateway, so
+                they only hold up the ring once BUS::DEFERRED of them wait.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void BusGateway::poll(uint32_t now) {
+  for (uint16_t i = 0; i < _count; i++) {
+    bus_device_t &device = _devices[i];
+    expire(device, now);
+    if (device.hasPending && !device.hasInFlight && device.link.ready(now))
+      transmit(device, now);
+  }
+  promote(now);
+
+  while (bus_request_t *request = _bus.front()) {
+    if (request->device >= _count) {
+      _dropped++;
+      _bus.pop();
+      continue;
+    }
+    if (!accept(*request, now))
+      break;
+    _bus.pop();
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Take a request off the ring: make it the pending request of
+                its module, or hold it while the module is busy.
+        @param    request
+                          The request.
+        @param    now
+                          Current time in ms.
+        @return False if the request has to stay in the ring.
+*/
+/**************************************************************************/
+bool BusGateway::accept(const bus_request_t &request, uint32_t now) {
+  bus_device_t &device = _devices[request.device];
+
+  // requests held for the module go first, keeping its order
+  if (device.hasPending || device.deferred) {
+    if (_deferredCount == BUS::DEFERRED)
+      return false;
+    _deferred[_deferredCount++] = request;
+    device.deferred++;
+    return true;
+  }
+
+  device.pending = request;
+  device.pendingSince = DFPLAYERMINI_TRACE_BEGIN();
+  device.hasPending = true;
+
+  if (!device.hasInFlight && device.link.ready(now))
+    transmit(device, now);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Move the oldest held request of every module whose pending
+                request has gone out into its pending slot.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void BusGateway::promote(uint32_t now) {
+  uint16_t kept = 0;
+
+  for (uint16_t i = 0; i < _deferredCount; i++) {
+    const bus_request_t &request = _deferred[i];
+    bus_device_t &device = _devices[request.device];
+
+    if (device.hasPending) {
+      _deferred[kept++] = request;
+      continue;
+    }
+
+    device.deferred--;
+    device.pending = request;
+    device.pendingSince = DFPLAYERMINI_TRACE_BEGIN();
+    device.hasPending = true;
+    if (!device.hasInFlight && device.link.ready(now))
+      transmit(device, now);
+  }
+  _deferredCount = kept;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Fail the request in flight back to its client once it has
+                waited longer than the timeout.
+        @param    device
+                          The module.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void BusGateway::expire(bus_device_t &device, uint32_t now) {
+  if (!device.hasInFlight || now - device.sentAt < _timeout)
+    return;
+
+  bus_event_t event;
+  event.device = static_cast<uint16_t>(&device - _devices);
+  event.client = device.inFlight.client;
+  event.kind = BUS_EVENT::TIMEOUT;
+  event.cmd = device.inFlight.cmd;
+  event.value = 0;
+  event.tag = device.inFlight.tag;
+  device.hasInFlight = false;
+
+  DFPLAYERMINI_TRACE_INSTANT(TRACE::TIMEOUT, event.device, event.cmd);
+  _bus.publish(event);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Publish a packet received from a module to the client whose
+                request it answers, or to all clients.
+        @param    device
+                          Index of the module.
+        @param    _stack
+                          The packet received.
+*/
+/**************************************************************************/
+void BusGateway::feed(uint16_t device, const stack_t &_stack) {
+  if (device >= _count)
+    return;
+
+  bus_device_t &dev = _devices[device];
+  bus_event_t event;
+  event.device = device;
+  event.client = BUS::BROADCAST;
+  event.kind = BUS_EVENT::REPORT;
+  event.cmd = _stack.command;
+  event.value = static_cast<uint16_t>((_stack.paramMSB << 8) | _stack.paramLSB);
+  event.tag = 0;
+
+  if (dev.hasInFlight) {
+    bool answered = true;
+
+    if (_stack.command == QUERYCMD::REPLY) {
+      event.kind = BUS_EVENT::ACK;
+      // a query is still answered by its reply
+      answered = dev.inFlight.cmd < QUERYCMD::GET_STATUS_;
+    } else if (_stack.command == QUERYCMD::RETRANSMIT) {
+      event.kind = BUS_EVENT::ERROR;
+    } else if (_stack.command == dev.inFlight.cmd) {
+      event.kind = BUS_EVENT::REPLY;
+    } else {
+      answered = false;
+    }
+
+    if (event.kind != BUS_EVENT::REPORT) {
+      event.client = dev.inFlight.client;
+      event.tag = dev.inFlight.tag;
+    }
+    if (answered)
+      dev.hasInFlight = false;
+  }
+
+  static const uint8_t KINDS[] = {TRACE::ACK, TRACE::REPLY, TRACE::ERROR,
+                                  TRACE::REPORT, TRACE::TIMEOUT};
+  DFPLAYERMINI_TRACE_INSTANT(KINDS[event.kind], device, event.cmd,
+                             event.value);
+  _bus.publish(event);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Encode and write the pending request of a module.
+        @param    device
+                          The module.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void BusGateway::transmit(bus_device_t &device, uint32_t now) {
+  uint8_t frame[PACKET::SIZE];
+
+  _player.command(device.pending.cmd, device.pending.first,
+                  device.pending.second);
+  _player.getStack(frame);
+
+  uint16_t index = static_cast<uint16_t>(&device - _devices);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::PACING, device.pendingSince, index,
+                          device.pending.cmd, device.pending.second);
+  uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+  device.port->write(frame, PACKET::SIZE);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, index, device.pending.cmd,
+                          device.pending.second);
+  device.link.sent(now);
+
+  // a packet without feedback is never answered, nothing is in flight
+  if (frame[4] == PACKET::FEEDBACK::YES ||
+      device.pending.cmd >= QUERYCMD::GET_STATUS_) {
+    device.inFlight = device.pending;
+    device.sentAt = now;
+    device.hasInFlight = true;
+  }
+  device.hasPending = false;
+}
+
+#endif // __linux__
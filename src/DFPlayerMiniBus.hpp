@@ -0,0 +1,203 @@
+/*!
+ * @file DFPlayerMiniBus.hpp
+ *
+ * Shared-memory command bus for gateways where several processes control
+ * the same modules. Clients write fixed-size requests straight into a
+ * lock-free multi-producer ring (MpscRing) in a POSIX shared memory object;
+ * one owner process drains it, encodes and transmits the packets and
+ * publishes ACKs, query replies, errors and reports to a broadcast ring
+ * every client reads with its own cursor. The fast path of both sides is a
+ * handful of atomic operations, without copies or system calls.
+ *
+ * Linux only; link with -lrt on glibc older than 2.34.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_BUS_H__
+#define __DFPLAYERMINI_BUS_H__
+
+#if defined(__linux__)
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniRing.hpp"
+#include "DFPlayerMiniTransport.hpp"
+
+#include <atomic>
+#include <stddef.h>
+
+namespace DFPLAYERMINI {
+
+/** Bus Values */
+namespace BUS {
+constexpr uint32_t MAGIC = 0x44465042; // "DFPB"
+constexpr uint32_t VERSION = 1;
+constexpr uint8_t BROADCAST = 0xFF; // client of unsolicited reports
+constexpr size_t CACHE_LINE = 64;
+constexpr uint16_t TIMEOUT = 500; // ms until an unanswered request fails
+constexpr uint16_t DEFERRED = 32; // requests held for busy modules
+} // namespace BUS
+
+/** Kinds of bus events */
+namespace BUS_EVENT {
+constexpr uint8_t ACK = 0;     // module acknowledged a command
+constexpr uint8_t REPLY = 1;   // query reply, value is the parameter
+constexpr uint8_t ERROR = 2;   // module answered 0x40, value is the error
+constexpr uint8_t REPORT = 3;  // unsolicited packet, sent to BUS::BROADCAST
+constexpr uint8_t TIMEOUT = 4; // no answer within the timeout
+} // namespace BUS_EVENT
+
+/** Request written by a client */
+struct bus_request_t {
+  uint16_t device; // index of the module at the owner
+  uint8_t cmd;     // command ID
+  uint8_t client;  // id from Bus::connect()
+  uint16_t first;  // word, folder or MSB parameter
+  uint16_t second; // track or LSB parameter
+  uint32_t tag;    // opaque, returned with the answer
+};
+
+/** Event published by the owner */
+struct bus_event_t {
+  uint16_t device; // index of the module
+  uint8_t client;  // client that sent the request, or BUS::BROADCAST
+  uint8_t kind;    // BUS_EVENT value
+  uint8_t cmd;     // command ID of the received packet
+  uint16_t value;  // received parameter
+  uint32_t tag;    // tag of the request
+};
+
+/** Header at the start of the shared memory object */
+struct bus_header_t {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t requestSlots;
+  uint32_t eventSlots;
+  std::atomic<uint32_t> clients;
+  ring_index_t requests;
+  alignas(BUS::CACHE_LINE) std::atomic<uint32_t> eventTail; // owner
+};
+
+/** Slot of the request ring */
+typedef ring_slot_t<bus_request_t> bus_request_slot_t;
+
+/** Slot of the event ring */
+struct alignas(32) bus_event_slot_t {
+  std::atomic<uint32_t> seq;
+  bus_event_t event;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Mapping of the bus shared by the owner and its clients.
+*/
+/**************************************************************************/
+class Bus {
+  bus_header_t *_header = nullptr;
+  MpscRing<bus_request_t> _requests;
+  bus_event_slot_t *_events = nullptr;
+  size_t _size = 0;
+  bool _mapped = false;
+
+public:
+  Bus() = default;
+  Bus(const Bus &) = delete;
+  Bus &operator=(const Bus &) = delete;
+  ~Bus() { close(); }
+
+  static size_t size(uint32_t requestSlots, uint32_t eventSlots);
+
+  bool create(const char *name, uint32_t requestSlots, uint32_t eventSlots);
+  bool open(const char *name);
+  bool attach(void *memory, size_t size, bool init, uint32_t requestSlots = 0,
+              uint32_t eventSlots = 0);
+  void close();
+  static void unlink(const char *name);
+
+  bool isOpen() const { return _header != nullptr; }
+  uint8_t connect();
+
+  // clients
+  bus_request_t *claim() { return _requests.claim(); }
+  void commit(bus_request_t *request) { _requests.commit(request); }
+  bool submit(uint8_t client, uint16_t device, uint8_t cmd, uint16_t first = 0,
+              uint16_t second = 0, uint32_t tag = 0);
+
+  // owner
+  bus_request_t *front() { return _requests.front(); }
+  void pop() { _requests.pop(); }
+  void publish(const bus_event_t &event);
+
+  uint32_t eventTail() const;
+  int32_t readEvent(uint32_t &cursor, bus_event_t &event) const;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Cursor of one client on the event ring.
+*/
+/**************************************************************************/
+class BusReader {
+  const Bus &_bus;
+  uint8_t _client;
+  uint32_t _cursor;
+  uint32_t _lost = 0;
+
+public:
+  BusReader(const Bus &bus, uint8_t client);
+
+  bool read(bus_event_t &event);
+  uint32_t lost() const { return _lost; }
+};
+
+/** Per-module state of the bus owner */
+struct bus_device_t {
+  Transport *port;
+  Pacer link;
+  bus_request_t pending;  // drained, waiting for the link
+  bus_request_t inFlight; // sent, waiting for the answer
+  uint64_t pendingSince;  // trace clock when pending was drained
+  uint32_t sentAt;        // ms when inFlight was sent
+  uint16_t deferred;      // requests held by the gateway behind pending
+  bool hasPending;
+  bool hasInFlight;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Owner side: drains requests onto the modules' links and
+                publishes what the modules answer.
+*/
+/**************************************************************************/
+class BusGateway {
+  Bus &_bus;
+  bus_device_t *_devices;
+  uint16_t _count;
+  DFPlayerMini _player;
+  uint16_t _timeout = BUS::TIMEOUT;
+  uint32_t _dropped = 0;
+
+  bus_request_t _deferred[BUS::DEFERRED];
+  uint16_t _deferredCount = 0;
+
+  bool accept(const bus_request_t &request, uint32_t now);
+  void promote(uint32_t now);
+  void expire(bus_device_t &device, uint32_t now);
+  void transmit(bus_device_t &device, uint32_t now);
+
+public:
+  BusGateway(Bus &bus, bus_device_t *devices, uint16_t count,
+             FeedbackPolicy feedback = false);
+
+  void setTimeout(uint16_t ms) { _timeout = ms; }
+
+  void poll(uint32_t now);
+  void feed(uint16_t device, const stack_t &_stack);
+
+  uint32_t dropped() const { return _dropped; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif // __linux__
+
+#endif
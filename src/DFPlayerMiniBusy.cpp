@@ -0,0 +1,179 @@
+/*!
+ * @file DFPlayerMiniBusy.cpp
+ *
+ * Playback status from the BUSY pin.
+ *
+ */
+
+#include "DFPlayerMiniBusy.hpp"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+using namespace DFPLAYERMINI;
+
+#if defined(__linux__)
+/**************************************************************************/
+/*!
+        @brief  Request a line of a GPIO chip as input.
+        @param    chip
+                          Path of the character device.
+        @param    line
+                          Offset of the line on the chip.
+        @return False if the line could not be requested.
+*/
+/**************************************************************************/
+bool GpiochipPin::open(const char *chip, uint32_t line) {
+  close();
+
+  int fd = ::open(chip, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  request.offsets[0] = line;
+  request.num_lines = 1;
+  request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+  strncpy(request.consumer, "dfplayer-busy", sizeof(request.consumer) - 1);
+
+  int result = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &request);
+  ::close(fd);
+  if (result < 0)
+    return false;
+
+  _fd = request.fd;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Release the line.
+*/
+/**************************************************************************/
+void GpiochipPin::close() {
+  if (_fd >= 0)
+    ::close(_fd);
+  _fd = -1;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Read the line. Keeps the last level if the read fails.
+        @return True for high.
+*/
+/**************************************************************************/
+bool GpiochipPin::read() {
+  if (_fd < 0)
+    return _level;
+
+  struct gpio_v2_line_values values;
+  values.bits = 0;
+  values.mask = 1;
+  if (ioctl(_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == 0)
+    _level = values.bits & 1;
+
+  return _level;
+}
+#endif
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    pin
+                          Input the BUSY pin is wired to, nullptr if none.
+*/
+/**************************************************************************/
+BusyMonitor::BusyMonitor(Pin *pin) : _pin(pin) {}
+
+/**************************************************************************/
+/*!
+        @brief  Sample the pin and report a playback edge once a new level
+                has held for the debounce time. Without a pin, reports the
+                edges derived from the packets passed to notify(). If a
+                track both started and stopped since the last call, the
+                earlier edge is reported now and the later one on the next
+                call.
+        @param    now
+                          Current time in ms.
+        @return EDGE value.
+*/
+/**************************************************************************/
+uint8_t BusyMonitor::update(uint32_t now) {
+  if (_pin) {
+    bool level = _pin->read();
+    if (level != _level) {
+      _level = level;
+      _changedAt = now;
+    }
+
+    bool playing = _level == BUSY_PIN::PLAYING;
+    if (playing != _playing && now - _changedAt >= _debounce)
+      change(playing);
+  }
+
+  // with both edges latched, the later one led to the current status
+  uint8_t edge = _edges;
+  if (edge == (EDGE::STARTED | EDGE::STOPPED))
+    edge = _playing ? EDGE::STOPPED : EDGE::STARTED;
+  _edges &= static_cast<uint8_t>(~edge);
+  return edge;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Observe a packet received from the module. With a pin,
+                status replies are compared with its stable level; without
+                one, status replies and track-finished reports drive the
+                playback status.
+        @param    _stack
+                          The packet received.
+*/
+/**************************************************************************/
+void BusyMonitor::notify(const stack_t &_stack) {
+  switch (_stack.command) {
+  case QUERYCMD::GET_STATUS_: {
+    bool playing = _stack.paramLSB == PLAYBACK::PLAYING;
+    if (!_pin) {
+      change(playing);
+    } else if ((_level == BUSY_PIN::PLAYING) == _playing) {
+      _stats.checks++;
+      if (playing != _playing)
+        _stats.mismatches++;
+    }
+    break;
+  }
+  case REPORT::U_FINISHED:
+  case REPORT::TF_FINISHED:
+  case REPORT::FLASH_FINISHED:
+    if (!_pin)
+      change(false);
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Switch the playback status and latch the edge.
+        @param    playing
+                          The new status.
+*/
+/**************************************************************************/
+void BusyMonitor::change(bool playing) {
+  if (playing == _playing)
+    return;
+
+  _playing = playing;
+  _edges |= playing ? EDGE::STARTED : EDGE::STOPPED;
+  if (playing)
+    _stats.started++;
+  else
+    _stats.stopped++;
+}
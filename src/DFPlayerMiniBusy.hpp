@@ -0,0 +1,122 @@
+/*!
+ * @file DFPlayerMiniBusy.hpp
+ *
+ * Playback status from the BUSY pin. The module pulls BUSY low while a track
+ * plays, so reading the pin answers isPlaying() without a GET_STATUS_ round
+ * trip over the UART. Query replies are only used to cross-check the pin,
+ * or in its place when no pin is wired.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_BUSY_H__
+#define __DFPLAYERMINI_BUSY_H__
+
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** BUSY Pin Values */
+namespace BUSY_PIN {
+constexpr bool PLAYING = false;   // level while a track plays
+constexpr uint16_t DEBOUNCE = 20; // ms a level must hold to count
+} // namespace BUSY_PIN
+
+/** Playback Edges (bit values, both can be latched between two updates) */
+namespace EDGE {
+constexpr uint8_t NONE = 0;
+constexpr uint8_t STARTED = 1;
+constexpr uint8_t STOPPED = 2;
+} // namespace EDGE
+
+/** BUSY monitor statistics */
+struct busy_stats_t {
+  uint32_t started;    // started edges reported
+  uint32_t stopped;    // stopped edges reported
+  uint32_t checks;     // status replies compared with the pin
+  uint32_t mismatches; // of those, disagreeing with the pin
+};
+
+/**************************************************************************/
+/*!
+        @brief  Abstract digital input the BUSY pin is wired to.
+*/
+/**************************************************************************/
+class Pin {
+public:
+  /** Read the current level, true for high */
+  virtual bool read() = 0;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Pin whose level is set by the program, for tests and
+                simulations.
+*/
+/**************************************************************************/
+class MockPin : public Pin {
+  bool _level = !BUSY_PIN::PLAYING;
+
+public:
+  void set(bool level) { _level = level; }
+  bool read() override { return _level; }
+};
+
+#if defined(__linux__)
+/**************************************************************************/
+/*!
+        @brief  Input line of a Linux GPIO character device, e.g.
+                /dev/gpiochip0.
+*/
+/**************************************************************************/
+class GpiochipPin : public Pin {
+  int _fd = -1;
+  bool _level = !BUSY_PIN::PLAYING;
+
+public:
+  GpiochipPin() = default;
+  GpiochipPin(const GpiochipPin &) = delete;
+  GpiochipPin &operator=(const GpiochipPin &) = delete;
+  ~GpiochipPin() { close(); }
+
+  bool open(const char *chip, uint32_t line);
+  void close();
+  bool isOpen() const { return _fd >= 0; }
+  bool read() override;
+};
+#endif
+
+/**************************************************************************/
+/*!
+        @brief  Debounced playback status of one module.
+*/
+/**************************************************************************/
+class BusyMonitor {
+  Pin *_pin;
+  uint16_t _debounce = BUSY_PIN::DEBOUNCE;
+
+  bool _playing = false;
+  bool _level = !BUSY_PIN::PLAYING;
+  uint32_t _changedAt = 0;
+  uint8_t _edges = EDGE::NONE; // EDGE values latched since the last update
+
+  busy_stats_t _stats = {0, 0, 0, 0};
+
+  void change(bool playing);
+
+public:
+  explicit BusyMonitor(Pin *pin = nullptr);
+
+  void setPin(Pin *pin) { _pin = pin; }
+  void setDebounce(uint16_t ms) { _debounce = ms; }
+  bool hasPin() const { return _pin != nullptr; }
+
+  uint8_t update(uint32_t now);
+  void notify(const stack_t &_stack);
+
+  bool isPlaying() const { return _playing; }
+  const busy_stats_t &getStats() const { return _stats; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,382 @@
+/*!
+ * @file DFPlayerMiniCard.cpp
+ *
+ * Card layout rules and binary index.
+ *
+ */
+
+#include "DFPlayerMiniCard.hpp"
+
+using namespace DFPLAYERMINI;
+
+namespace {
+char lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+bool equalsIgnoreCase(const char *a, const char *b) {
+  while (*a && lower(*a) == lower(*b)) {
+    a++;
+    b++;
+  }
+  return !*a && !*b;
+}
+} // namespace
+
+/**************************************************************************/
+/*!
+        @brief  Map a folder name in the card root to its folder id.
+        @param    name
+                          The folder name.
+        @return 1-99, CARD::MP3, CARD::ADVERT or CARD::INVALID.
+*/
+/**************************************************************************/
+uint8_t CardLayout::folderId(const char *name) {
+  if (equalsIgnoreCase(name, "mp3"))
+    return CARD::MP3;
+  if (equalsIgnoreCase(name, "advert"))
+    return CARD::ADVERT;
+
+  if (name[0] < '0' || name[0] > '9' || name[1] < '0' || name[1] > '9' ||
+      name[2])
+    return CARD::INVALID;
+
+  uint8_t folder = (name[0] - '0') * 10 + (name[1] - '0');
+  if (folder < LIMIT::MIN_FOLDER || folder > LIMIT::MAX_FOLDER)
+    return CARD::INVALID;
+  return folder;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Validate a file name and extract its track number.
+        @param    folder
+                          Id of the folder holding the file.
+        @param    name
+                          The file name.
+        @param    number
+                          Set to the track number.
+        @param    flags
+                          Set to the TRACK_FLAG values the name implies.
+        @return NAME_ISSUE::NONE or the problem found.
+*/
+/**************************************************************************/
+uint8_t CardLayout::trackNumber(uint8_t folder, const char *name,
+                                uint16_t &number, uint16_t &flags) {
+  const char *dot = nullptr;
+  for (const char *c = name; *c; c++)
+    if (*c == '.')
+      dot = c;
+
+  flags = 0;
+  if (dot && equalsIgnoreCase(dot, ".wav"))
+    flags = TRACK_FLAG::WAV;
+  else if (!dot || !equalsIgnoreCase(dot, ".mp3"))
+    return NAME_ISSUE::EXTENSION;
+
+  uint8_t digits = 0;
+  uint32_t value = 0;
+  while (name[digits] >= '0' && name[digits] <= '9' && digits < 6)
+    value = value * 10 + (name[digits++] - '0');
+  number = static_cast<uint16_t>(value);
+
+  if (!digits)
+    return NAME_ISSUE::NO_NUMBER;
+
+  uint16_t min;
+  uint16_t max;
+  switch (folder) {
+  case CARD::ROOT:
+    min = LIMIT::MIN_ROOT_TRACK;
+    max = LIMIT::MAX_ROOT_TRACK;
+    break;
+  case CARD::MP3:
+    min = LIMIT::MIN_MP3_TRACK;
+    max = LIMIT::MAX_MP3_TRACK;
+    break;
+  case CARD::ADVERT:
+    min = LIMIT::MIN_ADVERT_TRACK;
+    max = LIMIT::MAX_ADVERT_TRACK;
+    break;
+  default:
+    if (digits == 3) {
+      min = LIMIT::MIN_FOLDER_TRACK;
+      max = LIMIT::MAX_FOLDER_TRACK;
+    } else if (digits == 4 && folder <= LIMIT::MAX_LARGE_FOLDER) {
+      min = LIMIT::MIN_FOLDER_TRACK;
+      max = LIMIT::MAX_LARGE_FOLDER_TRACK;
+    } else {
+      return NAME_ISSUE::DIGITS;
+    }
+    return value < min || value > max ? NAME_ISSUE::RANGE : NAME_ISSUE::NONE;
+  }
+
+  if (digits != 4)
+    return NAME_ISSUE::DIGITS;
+  return value < min || value > max ? NAME_ISSUE::RANGE : NAME_ISSUE::NONE;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Describe a name issue.
+        @param    issue
+                          The NAME_ISSUE value.
+        @return A short text.
+*/
+/**************************************************************************/
+const char *CardLayout::describe(uint8_t issue) {
+  switch (issue) {
+  case NAME_ISSUE::NONE:
+    return "ok";
+  case NAME_ISSUE::NO_NUMBER:
+    return "no numeric prefix";
+  case NAME_ISSUE::DIGITS:
+    return "wrong number of digits in the prefix";
+  case NAME_ISSUE::RANGE:
+    return "track number out of range";
+  case NAME_ISSUE::EXTENSION:
+    return "not an .mp3 or .wav file";
+  case NAME_ISSUE::UNKNOWN_DIR:
+    return "folder ignored by the module";
+  default:
+    return "unknown issue";
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Use an index held in memory. The data must stay valid and
+                be aligned to 4 bytes.
+        @param    data
+                          The index.
+        @param    size
+                          Size of the index in bytes.
+        @return False if the data is not a consistent index.
+*/
+/**************************************************************************/
+bool CardIndex::load(const void *data, size_t size) {
+  _header = nullptr;
+  if (size < sizeof(card_header_t))
+    return false;
+
+  const card_header_t *header = static_cast<const card_header_t *>(data);
+  if (header->magic != CARD::MAGIC || header->version != CARD::VERSION)
+    return false;
+
+  uint32_t folderBytes = header->folders * sizeof(card_folder_t);
+  uint32_t trackBytes = header->tracks * sizeof(card_track_t);
+  if (header->tracks > 0xFFFFFFu / sizeof(card_track_t) ||
+      size < sizeof(card_header_t) + folderBytes + trackBytes)
+    return false;
+
+  const card_folder_t *folder =
+      reinterpret_cast<const card_folder_t *>(header + 1);
+  for (uint8_t i = 0; i < header->folders; i++)
+    if (folder[i].first > header->tracks ||
+        folder[i].count > header->tracks - folder[i].first ||
+        (i && folder[i].folder <= folder[i - 1].folder))
+      return false;
+
+  _header = header;
+  _folders = folder;
+  _tracks = reinterpret_cast<const card_track_t *>(folder + header->folders);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Look up the entry of a folder.
+        @param    folder
+                          The folder id.
+        @return The entry, nullptr if the folder is not on the card.
+*/
+/**************************************************************************/
+const card_folder_t *CardIndex::folder(uint8_t folder) const {
+  uint8_t low = 0;
+  uint8_t high = folders();
+
+  while (low < high) {
+    uint8_t mid = (low + high) / 2;
+    if (_folders[mid].folder < folder)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low < folders() && _folders[low].folder == folder ? &_folders[low]
+                                                           : nullptr;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Number of tracks in a folder.
+        @param    folder
+                          The folder id.
+        @return The number of tracks, 0 if the folder is not on the card.
+*/
+/**************************************************************************/
+uint16_t CardIndex::tracks(uint8_t folder) const {
+  const card_folder_t *entry = this->folder(folder);
+  return entry ? entry->count : 0;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Look up a track.
+        @param    folder
+                          The folder id.
+        @param    number
+                          The track number.
+        @return The entry, nullptr if the track is not on the card.
+*/
+/**************************************************************************/
+const card_track_t *CardIndex::track(uint8_t folder, uint16_t number) const {
+  const card_folder_t *entry = this->folder(folder);
+  if (!entry)
+    return nullptr;
+
+  const card_track_t *tracks = _tracks + entry->first;
+  uint16_t low = 0;
+  uint16_t high = entry->count;
+
+  while (low < high) {
+    uint16_t mid = (low + high) / 2;
+    if (tracks[mid].number < number)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low < entry->count && tracks[low].number == number ? &tracks[low]
+                                                            : nullptr;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Hash of a name in the address map: FNV-1a over the name
+                with ASCII letters folded to lower case.
+        @param    name
+                          The name.
+        @return The hash.
+*/
+/**************************************************************************/
+uint32_t CardMap::hash(const char *name) {
+  uint32_t value = 2166136261u;
+  for (; *name; name++)
+    value = (value ^ static_cast<uint8_t>(lower(*name))) * 16777619u;
+  return value;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Command that plays a track of the card, to pass to
+                DFPlayerMini::encode() or command().
+        @param    folder
+                          The folder id.
+        @param    number
+                          The track number.
+        @param    first
+                          Set to the first parameter of the command.
+        @param    second
+                          Set to the second parameter of the command.
+        @return The command ID, 0 if the folder cannot be played from.
+*/
+/**************************************************************************/
+uint8_t CardMap::command(uint8_t folder, uint16_t number, uint16_t &first,
+                         uint16_t &second) {
+  second = 0;
+  switch (folder) {
+  case CARD::ROOT:
+    first = number;
+    return CONTROLCMD::PLAY_TRACK;
+  case CARD::MP3:
+    first = number;
+    return CONTROLCMD::PLAY_MP3_FOLDER;
+  case CARD::ADVERT:
+    first = number;
+    return CONTROLCMD::INSERT_ADVERT;
+  case CARD::INVALID:
+    return 0;
+  default:
+    first = folder;
+    second = number;
+    return number > LIMIT::MAX_FOLDER_TRACK ? CONTROLCMD::PLAY_LARGE_FOLDER
+                                            : CONTROLCMD::PLAY_FOLDER_TRACK;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Use an address map held in memory. The data must stay valid
+                and be aligned to 4 bytes.
+        @param    data
+                          The map.
+        @param    size
+                          Size of the map in bytes.
+        @return False if the data is not a consistent map.
+*/
+/**************************************************************************/
+bool CardMap::load(const void *data, size_t size) {
+  _header = nullptr;
+  if (size < sizeof(card_map_header_t))
+    return false;
+
+  const card_map_header_t *header =
+      static_cast<const card_map_header_t *>(data);
+  if (header->magic != CARD::MAP_MAGIC || header->version != CARD::VERSION ||
+      !header->slots || (header->slots & (header->slots - 1)) ||
+      header->entries >= header->slots ||
+      header->slots > 0xFFFFFFu / sizeof(card_map_slot_t) ||
+      header->names > 0xFFFFFFu || !header->names)
+    return false;
+
+  uint32_t slotBytes = header->slots * sizeof(card_map_slot_t);
+  if (size < sizeof(card_map_header_t) + slotBytes + header->names)
+    return false;
+
+  const card_map_slot_t *slots =
+      reinterpret_cast<const card_map_slot_t *>(header + 1);
+  const char *names = reinterpret_cast<const char *>(slots + header->slots);
+  if (names[header->names - 1])
+    return false;
+
+  // find() stops probing at an empty slot, so one has to exist
+  uint32_t used = 0;
+  for (uint32_t i = 0; i < header->slots; i++) {
+    if (slots[i].folder == CARD::INVALID)
+      continue;
+    if (slots[i].name >= header->names)
+      return false;
+    used++;
+  }
+  if (used != header->entries || used >= header->slots)
+    return false;
+
+  _header = header;
+  _slots = slots;
+  _names = names;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Look up a name.
+        @param    name
+                          The name, letter case is ignored.
+        @return The slot holding the folder id and track number, nullptr if
+                the name is not on the card.
+*/
+/**************************************************************************/
+const card_map_slot_t *CardMap::find(const char *name) const {
+  if (!_header)
+    return nullptr;
+
+  uint32_t mask = _header->slots - 1;
+  uint32_t value = hash(name);
+  // the map always has an empty slot, which ends the probe
+  for (uint32_t i = value & mask;; i = (i + 1) & mask) {
+    const card_map_slot_t &slot = _slots[i];
+    if (slot.folder == CARD::INVALID)
+      return nullptr;
+    if (slot.hash == value && equalsIgnoreCase(_names + slot.name, name))
+      return &slot;
+  }
+}
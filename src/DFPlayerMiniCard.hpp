@@ -0,0 +1,168 @@
+/*!
+ * @file DFPlayerMiniCard.hpp
+ *
+ * Layout of the storage card the module plays from. Validates folder and
+ * file names against the naming scheme the module expects ("01".."99"
+ * folders holding "001-".."255-" files, or "0001-".."3000-" files in
+ * folders up to 15 played with 0x14, "mp3" and "advert" holding
+ * "0001-".."9999-" files), and reads the compact binary index written by
+ * the dfpindex tool, so a controller knows folder sizes and track
+ * durations at startup without querying the module.
+ *
+ * Index layout, all fields little endian. dfpindex writes it field by field
+ * on any host; CardIndex reads it in place, so the reading host must be
+ * little endian too (AVR, ARM, ESP32 and x86 are):
+ *
+ *     card_header_t
+ *     card_folder_t  x header.folders, ascending folder id
+ *     card_track_t   x header.tracks, grouped by folder, ascending number
+ *
+ * The dfpprov tool also writes an address map, so applications can play a
+ * track by name: an open-addressing hash table of names, resolved in
+ * constant time.
+ *
+ *     card_map_header_t
+ *     card_map_slot_t    x header.slots, a power of two, empty slots have
+ *                        folder CARD::INVALID
+ *     char               x header.names, NUL-terminated names
+ *
+ */
+
+#ifndef __DFPLAYERMINI_CARD_H__
+#define __DFPLAYERMINI_CARD_H__
+
+#include "DFPlayerMini.hpp"
+
+#include <stddef.h>
+
+namespace DFPLAYERMINI {
+
+/** Card Values */
+namespace CARD {
+constexpr uint8_t ROOT = 0;       // folder id of the card root
+constexpr uint8_t MP3 = 100;      // folder id of "mp3"
+constexpr uint8_t ADVERT = 101;   // folder id of "advert"
+constexpr uint8_t INVALID = 0xFF; // not a folder the module plays from
+
+constexpr uint32_t MAGIC = 0x49504644;     // "DFPI"
+constexpr uint32_t MAP_MAGIC = 0x4D504644; // "DFPM"
+constexpr uint8_t VERSION = 1;
+} // namespace CARD
+
+/** Problems with a name */
+namespace NAME_ISSUE {
+constexpr uint8_t NONE = 0;
+constexpr uint8_t NO_NUMBER = 1;   // no numeric prefix
+constexpr uint8_t DIGITS = 2;      // wrong number of digits
+constexpr uint8_t RANGE = 3;       // number outside the LIMIT range
+constexpr uint8_t EXTENSION = 4;   // not .mp3 or .wav
+constexpr uint8_t UNKNOWN_DIR = 5; // folder the module ignores
+} // namespace NAME_ISSUE
+
+/** Track flags */
+namespace TRACK_FLAG {
+constexpr uint16_t WAV = 0x01;       // WAV rather than MP3
+constexpr uint16_t ESTIMATED = 0x02; // duration estimated from the bitrate
+} // namespace TRACK_FLAG
+
+/** Index header */
+struct card_header_t {
+  uint32_t magic;  // CARD::MAGIC
+  uint8_t version; // CARD::VERSION
+  uint8_t folders; // number of card_folder_t
+  uint16_t reserved;
+  uint32_t tracks; // number of card_track_t
+};
+
+/** Index entry of a folder */
+struct card_folder_t {
+  uint8_t folder; // CARD id or 1-99
+  uint8_t reserved;
+  uint16_t count; // tracks in the folder
+  uint32_t first; // index of its first card_track_t
+};
+
+/** Index entry of a track */
+struct card_track_t {
+  uint16_t number;   // number prefix of the file name
+  uint16_t flags;    // TRACK_FLAG values
+  uint32_t duration; // ms
+  uint32_t size;     // bytes
+};
+
+/** Address map header */
+struct card_map_header_t {
+  uint32_t magic;  // CARD::MAP_MAGIC
+  uint8_t version; // CARD::VERSION
+  uint8_t reserved;
+  uint16_t reserved2;
+  uint32_t slots;   // number of card_map_slot_t, a power of two
+  uint32_t entries; // used slots
+  uint32_t names;   // bytes of names
+};
+
+/** Address map slot */
+struct card_map_slot_t {
+  uint32_t hash;   // CardMap::hash() of the name
+  uint32_t name;   // offset of the name
+  uint8_t folder;  // CARD id or 1-99, CARD::INVALID if empty
+  uint8_t reserved;
+  uint16_t number; // track number
+};
+
+/**************************************************************************/
+/*!
+        @brief  Name rules of the card layout.
+*/
+/**************************************************************************/
+class CardLayout {
+public:
+  static uint8_t folderId(const char *name);
+  static uint8_t trackNumber(uint8_t folder, const char *name,
+                             uint16_t &number, uint16_t &flags);
+  static const char *describe(uint8_t issue);
+};
+
+/**************************************************************************/
+/*!
+        @brief  Read-only view of a binary index held in memory.
+*/
+/**************************************************************************/
+class CardIndex {
+  const card_header_t *_header = nullptr;
+  const card_folder_t *_folders = nullptr;
+  const card_track_t *_tracks = nullptr;
+
+public:
+  bool load(const void *data, size_t size);
+
+  uint8_t folders() const { return _header ? _header->folders : 0; }
+  const card_folder_t *folder(uint8_t folder) const;
+  uint16_t tracks(uint8_t folder) const;
+  const card_track_t *track(uint8_t folder, uint16_t number) const;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Read-only view of an address map held in memory.
+*/
+/**************************************************************************/
+class CardMap {
+  const card_map_header_t *_header = nullptr;
+  const card_map_slot_t *_slots = nullptr;
+  const char *_names = nullptr;
+
+public:
+  static uint32_t hash(const char *name);
+  static uint8_t command(uint8_t folder, uint16_t number, uint16_t &first,
+                         uint16_t &second);
+
+  bool load(const void *data, size_t size);
+
+  uint32_t entries() const { return _header ? _header->entries : 0; }
+  const card_map_slot_t *find(const char *name) const;
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
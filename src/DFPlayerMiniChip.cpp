@@ -0,0 +1,296 @@
+/*!
+ * @file DFPlayerMiniChip.cpp
+ *
+ * Chip profiles and detection.
+ *
+ */
+
+#include "DFPlayerMiniChip.hpp"
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define DFPLAYERMINI_PROGMEM PROGMEM
+#else
+#define DFPLAYERMINI_PROGMEM
+#endif
+
+using namespace DFPLAYERMINI;
+
+namespace {
+/** Profiles by CHIP value. UNKNOWN is the slowest common denominator and
+ * only lists queries every chip answers. */
+const chip_profile_t PROFILES[CHIP::COUNT] DFPLAYERMINI_PROGMEM = {
+    {CHIP::UNKNOWN, 0, 0x59BC, 3000, 100, 200, 500},
+    {CHIP::YX5200, QUIRK::DOUBLE_REPLY, 0xFBFC, 1500, 30, 60, 100},
+    {CHIP::GD3200B, QUIRK::NO_ACK, 0x59FC, 1000, 20, 50, 80},
+    {CHIP::MH2024K, QUIRK::SLOW_RESET, 0xD9BC, 3000, 50, 100, 150},
+    {CHIP::FN_M16P, 0, 0xD9FC, 1000, 20, 50, 80},
+};
+
+const char *const NAMES[CHIP::COUNT] = {"unknown", "YX5200", "GD3200B",
+                                        "MH2024K", "FN-M16P"};
+} // namespace
+
+/**************************************************************************/
+/*!
+        @brief  Look up the profile of a chip.
+        @param    chip
+                          The CHIP value.
+        @param    out
+                          Set to the profile, to CHIP::UNKNOWN's if chip is
+                          out of range.
+        @return False if chip is out of range.
+*/
+/**************************************************************************/
+bool Chip::profile(uint8_t chip, chip_profile_t &out) {
+  bool known = chip < CHIP::COUNT;
+  const chip_profile_t *entry = &PROFILES[known ? chip : CHIP::UNKNOWN];
+
+#if defined(__AVR__)
+  memcpy_P(&out, entry, sizeof(out));
+#else
+  out = *entry;
+#endif
+  return known;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Name of a chip.
+        @param    chip
+                          The CHIP value.
+        @return The name, "unknown" if chip is out of range.
+*/
+/**************************************************************************/
+const char *Chip::name(uint8_t chip) {
+  return NAMES[chip < CHIP::COUNT ? chip : CHIP::UNKNOWN];
+}
+
+/**************************************************************************/
+/*!
+        @brief  Check whether a chip answers a query.
+        @param    profile
+                          The chip's profile.
+        @param    cmd
+                          The QUERYCMD value.
+        @return True if the chip answers it.
+*/
+/**************************************************************************/
+bool Chip::answers(const chip_profile_t &profile, uint8_t cmd) {
+  if (cmd < QUERYCMD::RETRANSMIT || cmd > QUERYCMD::GET_FOLDERS)
+    return false;
+
+  return profile.queries & (1u << (cmd - QUERYCMD::RETRANSMIT));
+}
+
+/**************************************************************************/
+/*!
+        @brief  Pace a link at the chip's packet gap.
+        @param    profile
+                          The chip's profile.
+        @param    link
+                          Pacer of the module's link.
+        @param    baud
+                          Baud rate of the link.
+*/
+/**************************************************************************/
+void Chip::apply(const chip_profile_t &profile, Pacer &link, uint32_t baud) {
+  link.setTiming(baud, profile.gap);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start a module's round-trip estimates at the chip's
+                timeouts instead of RTT::INITIAL.
+        @param    profile
+                          The chip's profile.
+        @param    rtt
+                          The estimator.
+        @param    device
+                          Index of the module.
+*/
+/**************************************************************************/
+void Chip::apply(const chip_profile_t &profile, RttTable &rtt,
+                 uint8_t device) {
+  rtt.seed(device, RTT::ACK, profile.ackTimeout);
+  rtt.seed(device, RTT::QUERY, profile.queryTimeout);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Time out polls at the chip's query timeout and drop the
+                second answer of chips answering twice.
+        @param    profile
+                          The chip's profile.
+        @param    polls
+                          The poll set.
+*/
+/**************************************************************************/
+void Chip::apply(const chip_profile_t &profile, PollSet &polls) {
+  polls.setTimeout(profile.queryTimeout);
+  polls.setDoubleReply(profile.quirks & QUIRK::DOUBLE_REPLY);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Count missing answers after twice the chip's slower timeout,
+                expect ACKs only from chips sending them and wait the chip's
+                init time after a reset, twice that on chips slow to send
+                0x3F.
+        @param    profile
+                          The chip's profile.
+        @param    watchdog
+                          The watchdog.
+*/
+/**************************************************************************/
+void Chip::apply(const chip_profile_t &profile, Watchdog &watchdog) {
+  uint16_t slower = profile.queryTimeout > profile.ackTimeout
+                        ? profile.queryTimeout
+                        : profile.ackTimeout;
+
+  watchdog.setTimeout(2 * slower);
+  watchdog.setAcks(!(profile.quirks & QUIRK::NO_ACK));
+  watchdog.setInitTimeout(profile.quirks & QUIRK::SLOW_RESET
+                              ? 2 * profile.initTime
+                              : profile.initTime);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    link
+                          Pacer of the module's link.
+*/
+/**************************************************************************/
+ChipProbe::ChipProbe(Pacer &link) : _link(link), _player(true) {}
+
+/**************************************************************************/
+/*!
+        @brief  Start probing. The module must be initialised.
+*/
+/**************************************************************************/
+void ChipProbe::start() {
+  _phase = SEND;
+  _step = 0;
+  _tries = 0;
+  _seen = 0;
+  _busy = false;
+  _chip = CHIP::UNKNOWN;
+  _version = -1;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Produce the next probe packet and close the answer window
+                of the last one.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool ChipProbe::poll(uint32_t now, stack_t &_stack) {
+  if (_phase == WAIT && now - _sentAt >= CHIP::PROBE_WINDOW) {
+    if (_busy && ++_tries < CHIP::PROBE_TRIES) {
+      // the module was still busy, the answers so far mean nothing
+      _seen &= _step ? static_cast<uint8_t>(~FOLDERS) : 0;
+      _busy = false;
+      _phase = SEND;
+    } else if (++_step < 2) {
+      _tries = 0;
+      _busy = false;
+      _phase = SEND;
+    } else {
+      classify();
+      _phase = DONE;
+    }
+  }
+
+  if (_phase != SEND || !_link.ready(now))
+    return false;
+
+  _player.query(_step ? QUERYCMD::GET_FOLDERS : QUERYCMD::GET_VERSION);
+  _player.getStack(_stack);
+  _link.sent(now);
+
+  _sentAt = now;
+  _phase = WAIT;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Record a packet received from the module.
+        @param    _stack
+                          The packet received.
+*/
+/**************************************************************************/
+void ChipProbe::feed(const stack_t &_stack) {
+  if (_phase != WAIT)
+    return;
+
+  switch (_stack.command) {
+  case QUERYCMD::REPLY:
+    if (!_step)
+      _seen |= ACKED;
+    break;
+  case QUERYCMD::RETRANSMIT:
+    if (_stack.paramLSB == ERROR_CODE::BUSY)
+      _busy = true;
+    break;
+  case QUERYCMD::GET_VERSION:
+    if (_step)
+      break;
+    if (_seen & VERSION)
+      _seen |= TWICE;
+    _seen |= VERSION;
+    _version =
+        static_cast<int16_t>((_stack.paramMSB << 8) | _stack.paramLSB);
+    break;
+  case QUERYCMD::GET_FOLDERS:
+    if (_step)
+      _seen |= FOLDERS;
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Observations a chip produces.
+        @param    profile
+                          The chip's profile.
+        @return The observation flags.
+*/
+/**************************************************************************/
+uint8_t ChipProbe::expected(const chip_profile_t &profile) {
+  uint8_t seen = 0;
+  if (!(profile.quirks & QUIRK::NO_ACK))
+    seen |= ACKED;
+  if (Chip::answers(profile, QUERYCMD::GET_VERSION))
+    seen |= VERSION;
+  if ((seen & VERSION) && (profile.quirks & QUIRK::DOUBLE_REPLY))
+    seen |= TWICE;
+  if (Chip::answers(profile, QUERYCMD::GET_FOLDERS))
+    seen |= FOLDERS;
+
+  return seen;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Pick the chip whose expected observations match, or
+                CHIP::UNKNOWN.
+*/
+/**************************************************************************/
+void ChipProbe::classify() {
+  chip_profile_t profile;
+
+  for (uint8_t chip = CHIP::UNKNOWN + 1; chip < CHIP::COUNT; chip++) {
+    Chip::profile(chip, profile);
+    if (expected(profile) == _seen) {
+      _chip = chip;
+      return;
+    }
+  }
+}
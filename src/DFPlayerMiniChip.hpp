@@ -0,0 +1,117 @@
+/*!
+ * @file DFPlayerMiniChip.hpp
+ *
+ * Protocol and timing profiles of the decoder chips found on DFPlayer Mini
+ * boards and their clones, and detection of the chip from how the module
+ * answers a short probe. Applying the detected profile lets pacing,
+ * timeouts and the watchdog run at the chip's own limits instead of those
+ * of the slowest chip in the fleet.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_CHIP_H__
+#define __DFPLAYERMINI_CHIP_H__
+
+#include "DFPlayerMiniPoll.hpp"
+#include "DFPlayerMiniWatchdog.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Chip Values */
+namespace CHIP {
+constexpr uint8_t UNKNOWN = 0; // not detected, slowest common limits
+constexpr uint8_t YX5200 = 1;  // original DFPlayer Mini (YX5200-24SS)
+constexpr uint8_t GD3200B = 2; // GD3200B clones
+constexpr uint8_t MH2024K = 3; // MH2024K-24SS clones
+constexpr uint8_t FN_M16P = 4; // FN-M16P modules
+constexpr uint8_t COUNT = 5;
+
+constexpr uint16_t PROBE_WINDOW = 300; // ms to collect answers per probe
+constexpr uint8_t PROBE_TRIES = 3;     // probes repeated while busy
+} // namespace CHIP
+
+/** Chip quirks */
+namespace QUIRK {
+constexpr uint8_t NO_ACK = 0x01;       // ignores the feedback bit
+constexpr uint8_t DOUBLE_REPLY = 0x02; // answers every query twice
+constexpr uint8_t SLOW_RESET = 0x04;   // sends 0x3F late or not at all
+} // namespace QUIRK
+
+/** Protocol and timing profile of a chip */
+struct chip_profile_t {
+  uint8_t chip;          // CHIP value
+  uint8_t quirks;        // QUIRK flags
+  uint16_t queries;      // bit n set: answers query 0x40 + n
+  uint16_t initTime;     // ms from reset until commands are accepted
+  uint16_t gap;          // ms the chip needs between two packets
+  uint16_t ackTimeout;   // ms until a missing ACK counts as lost
+  uint16_t queryTimeout; // ms until a missing reply counts as lost
+};
+
+/**************************************************************************/
+/*!
+        @brief  Profile table and helpers applying a profile.
+*/
+/**************************************************************************/
+class Chip {
+public:
+  static bool profile(uint8_t chip, chip_profile_t &out);
+  static const char *name(uint8_t chip);
+  static bool answers(const chip_profile_t &profile, uint8_t cmd);
+
+  static void apply(const chip_profile_t &profile, Pacer &link,
+                    uint32_t baud = LINK::DEFAULT_BAUD);
+  static void apply(const chip_profile_t &profile, RttTable &rtt,
+                    uint8_t device);
+  static void apply(const chip_profile_t &profile, PollSet &polls);
+  static void apply(const chip_profile_t &profile, Watchdog &watchdog);
+};
+
+/**************************************************************************/
+/*!
+        @brief  Detects the chip of a module. Sends GET_VERSION with
+                feedback requested, then GET_FOLDERS, and matches whether
+                the module acknowledged, which queries it answered and
+                whether it answered twice against the profile table.
+*/
+/**************************************************************************/
+class ChipProbe {
+  enum : uint8_t { IDLE, SEND, WAIT, DONE };
+
+  /** Observations */
+  enum : uint8_t {
+    ACKED = 0x01,
+    VERSION = 0x02,
+    TWICE = 0x04,
+    FOLDERS = 0x08,
+  };
+
+  Pacer &_link;
+  DFPlayerMini _player;
+  uint8_t _phase = IDLE;
+  uint8_t _step = 0;
+  uint8_t _tries = 0;
+  uint8_t _seen = 0;
+  bool _busy = false;
+  uint32_t _sentAt = 0;
+  uint8_t _chip = CHIP::UNKNOWN;
+  int16_t _version = -1;
+
+  static uint8_t expected(const chip_profile_t &profile);
+  void classify();
+
+public:
+  explicit ChipProbe(Pacer &link);
+
+  void start();
+  bool poll(uint32_t now, stack_t &_stack);
+  void feed(const stack_t &_stack);
+
+  bool done() const { return _phase == DONE; }
+  uint8_t chip() const { return _chip; }
+  int16_t version() const { return _version; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,246 @@
+/*!
+ * @file DFPlayerMiniFade.cpp
+ *
+ * Volume fade engine.
+ *
+ */
+
+#include "DFPlayerMiniFade.hpp"
+
+using namespace DFPLAYERMINI;
+
+/** Fixed point scale of the fade progress */
+static constexpr uint32_t ONE = 1024;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    fades
+                          Storage for the fades that may run concurrently.
+        @param    capacity
+                          Number of entries in fades.
+        @param    links
+                          Pacer of every module, indexed by device number.
+*/
+/**************************************************************************/
+Fader::Fader(fade_t *fades, uint8_t capacity, Pacer *links)
+    : _fades(fades), _capacity(capacity), _links(links), _player(false) {
+  for (uint8_t i = 0; i < _capacity; i++)
+    _fades[i].active = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Limit the share of the link time a fade may use. The step
+                rate of each fade is derived from it and the link slot.
+        @param    percent
+                          Share of the link time (1 - 100).
+*/
+/**************************************************************************/
+void Fader::setShare(uint8_t percent) {
+  percent = percent >= 1 ? percent : 1;
+  percent = percent <= 100 ? percent : 100;
+  _share = percent;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start a fade, replacing any fade running on the device.
+        @param    device
+                          Device number.
+        @param    from
+                          Current volume of the module.
+        @param    to
+                          Target volume.
+        @param    duration
+                          Length of the fade in ms.
+        @param    curve
+                          CURVE value.
+        @param    now
+                          Current time in ms.
+        @return False if all fade slots are taken.
+*/
+/**************************************************************************/
+bool Fader::start(uint8_t device, uint8_t from, uint8_t to, uint32_t duration,
+                  uint8_t curve, uint32_t now) {
+  fade_t *fade = find(device);
+  for (uint8_t i = 0; !fade && i < _capacity; i++)
+    if (!_fades[i].active)
+      fade = &_fades[i];
+
+  if (!fade)
+    return false;
+
+  fade->start = now;
+  fade->duration = duration;
+  fade->nextStep = now;
+  fade->device = device;
+  fade->from = from <= LIMIT::MAX_VOLUME ? from : LIMIT::MAX_VOLUME;
+  fade->to = to <= LIMIT::MAX_VOLUME ? to : LIMIT::MAX_VOLUME;
+  fade->last = fade->from;
+  fade->curve = curve;
+  fade->active = true;
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Abort the fade of a device, leaving the volume where it is.
+        @param    device
+                          Device number.
+*/
+/**************************************************************************/
+void Fader::stop(uint8_t device) {
+  fade_t *fade = find(device);
+  if (fade)
+    fade->active = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Check whether a device is fading.
+        @param    device
+                          Device number.
+        @return True if a fade is running on the device.
+*/
+/**************************************************************************/
+bool Fader::active(uint8_t device) { return find(device) != nullptr; }
+
+/**************************************************************************/
+/*!
+        @brief  Observe a packet the application sent to a device. Pausing,
+                stopping, sleeping, resetting or setting the volume by hand
+                preempts the fade.
+        @param    device
+                          Device number.
+        @param    _stack
+                          The packet sent.
+*/
+/**************************************************************************/
+void Fader::notify(uint8_t device, const stack_t &_stack) {
+  switch (_stack.command) {
+  case CONTROLCMD::PAUSE:
+  case CONTROLCMD::STOP:
+  case CONTROLCMD::INC_VOL:
+  case CONTROLCMD::DEC_VOL:
+  case CONTROLCMD::SET_VOL:
+  case CONTROLCMD::MODE_STANDBY:
+  case CONTROLCMD::MODE_RESET:
+    stop(device);
+    break;
+  case CONTROLCMD::SET_PLAYBACK_SRC:
+    if (_stack.paramLSB == PLAYBACK_SRC::SLEEP)
+      stop(device);
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Produce the next fade packet, if a fade is due and its link
+                is free. Call this whenever the application has nothing else
+                to send; the packet must then be written to the device.
+        @param    now
+                          Current time in ms.
+        @param    device
+                          Set to the device the packet is meant for.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool Fader::poll(uint32_t now, uint8_t &device, stack_t &_stack) {
+  for (uint8_t n = 0; n < _capacity; n++) {
+    uint8_t i = (_cursor + n) % _capacity;
+    fade_t &fade = _fades[i];
+
+    if (!fade.active || !TIME::reached(now, fade.nextStep))
+      continue;
+
+    Pacer &link = _links[fade.device];
+    if (!link.ready(now))
+      continue;
+
+    uint8_t volume = level(fade, now);
+    bool done = now - fade.start >= fade.duration;
+
+    if (volume == fade.last) {
+      if (done)
+        fade.active = false;
+      continue;
+    }
+
+    _player.setVolume(volume);
+    _player.getStack(_stack);
+    device = fade.device;
+
+    fade.last = volume;
+    fade.nextStep = now + static_cast<uint32_t>(link.slotMs()) * 100 / _share;
+    fade.active = !done;
+    link.sent(now);
+
+    _cursor = (i + 1) % _capacity;
+    return true;
+  }
+
+  return false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Find the fade running on a device.
+        @param    device
+                          Device number.
+        @return The fade, nullptr if none.
+*/
+/**************************************************************************/
+fade_t *Fader::find(uint8_t device) {
+  for (uint8_t i = 0; i < _capacity; i++)
+    if (_fades[i].active && _fades[i].device == device)
+      return &_fades[i];
+
+  return nullptr;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Volume the fade curve gives at a point in time.
+        @param    fade
+                          The fade.
+        @param    now
+                          Current time in ms.
+        @return Volume level (0-30).
+*/
+/**************************************************************************/
+uint8_t Fader::level(const fade_t &fade, uint32_t now) const {
+  uint32_t elapsed = now - fade.start;
+  if (elapsed >= fade.duration)
+    return fade.to;
+
+  uint32_t p = fade.duration > 0x3FFFFF ? elapsed / (fade.duration >> 10)
+                                         : (elapsed << 10) / fade.duration;
+  p = p <= ONE ? p : ONE;
+
+  uint32_t y;
+  switch (fade.curve) {
+  case CURVE::LOG:
+    y = (p * (2 * ONE - p)) >> 10;
+    break;
+  case CURVE::S_CURVE:
+    y = (p * p * (3 * ONE - 2 * p)) >> 20;
+    break;
+  default:
+    y = p;
+    break;
+  }
+
+  int32_t delta = static_cast<int32_t>(fade.to) - fade.from;
+  int32_t step = (delta * static_cast<int32_t>(y) +
+                  (delta >= 0 ? 1 : -1) * static_cast<int32_t>(ONE / 2)) /
+                 static_cast<int32_t>(ONE);
+
+  return static_cast<uint8_t>(fade.from + step);
+}
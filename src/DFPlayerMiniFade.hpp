@@ -0,0 +1,71 @@
+/*!
+ * @file DFPlayerMiniFade.hpp
+ *
+ * Non-blocking volume fades for any number of modules. The engine never
+ * writes on its own: the main loop asks it for the next packet whenever it
+ * has nothing else to send, so fades only use link time that other traffic
+ * leaves free.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_FADE_H__
+#define __DFPLAYERMINI_FADE_H__
+
+#include "DFPlayerMiniPacer.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Fade Curve Values */
+namespace CURVE {
+constexpr uint8_t LINEAR = 0;  // constant volume steps
+constexpr uint8_t LOG = 1;     // fast start, slow end
+constexpr uint8_t S_CURVE = 2; // slow start and end (smoothstep)
+} // namespace CURVE
+
+/** State of one running fade */
+struct fade_t {
+  uint32_t start;    // ms timestamp of the fade start
+  uint32_t duration; // ms
+  uint32_t nextStep; // earliest ms timestamp of the next packet
+  uint8_t device;    // index into the pacer array
+  uint8_t from;      // start volume
+  uint8_t to;        // target volume
+  uint8_t last;      // last volume sent
+  uint8_t curve;     // CURVE value
+  bool active;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Engine running concurrent volume fades.
+*/
+/**************************************************************************/
+class Fader {
+  fade_t *_fades;
+  uint8_t _capacity;
+  Pacer *_links;
+  uint8_t _share = 50;
+  uint8_t _cursor = 0;
+
+  DFPlayerMini _player;
+
+  fade_t *find(uint8_t device);
+  uint8_t level(const fade_t &fade, uint32_t now) const;
+
+public:
+  Fader(fade_t *fades, uint8_t capacity, Pacer *links);
+
+  void setShare(uint8_t percent);
+
+  bool start(uint8_t device, uint8_t from, uint8_t to, uint32_t duration,
+             uint8_t curve, uint32_t now);
+  void stop(uint8_t device);
+  bool active(uint8_t device);
+  void notify(uint8_t device, const stack_t &_stack);
+
+  bool poll(uint32_t now, uint8_t &device, stack_t &_stack);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,199 @@
+/*!
+ * @file DFPlayerMiniFault.cpp
+ *
+ * Fault injecting transport.
+ *
+ */
+
+#include "DFPlayerMiniFault.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    profile
+                          The fault rates.
+        @param    seed
+                          Seed of the generator, runs with the same seed
+                          inject the same faults.
+*/
+/**************************************************************************/
+FaultInjector::FaultInjector(const fault_profile_t &profile, uint32_t seed)
+    : _profile(profile) {
+  this->seed(seed);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Next number of the xorshift32 generator.
+        @return The number.
+*/
+/**************************************************************************/
+uint32_t FaultInjector::random() {
+  _state ^= _state << 13;
+  _state ^= _state >> 17;
+  _state ^= _state << 5;
+  return _state;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Mutate one packet, or a part of one.
+        @param    in
+                          The bytes as sent.
+        @param    len
+                          Number of bytes, at most PACKET::SIZE.
+        @param    out
+                          Set to the bytes as received, room for
+                          FAULT::EXPANSION * len bytes.
+        @return Number of bytes in out.
+*/
+/**************************************************************************/
+size_t FaultInjector::apply(const uint8_t *in, size_t len, uint8_t *out) {
+  _stats.packets++;
+
+  size_t cut = len;
+  if (len && chance(_profile.truncate)) {
+    cut = random() % len;
+    _stats.truncated++;
+  }
+  uint8_t copies = 1;
+  if (chance(_profile.duplicate)) {
+    copies = 2;
+    _stats.duplicated++;
+  }
+
+  size_t n = 0;
+  for (uint8_t copy = 0; copy < copies; copy++)
+    for (size_t i = 0; i < cut; i++) {
+      if (chance(_profile.garbage)) {
+        out[n++] = static_cast<uint8_t>(random());
+        _stats.garbage++;
+      }
+      if (chance(_profile.drop)) {
+        _stats.dropped++;
+        continue;
+      }
+      out[n] = in[i];
+      if (chance(_profile.flip)) {
+        out[n] ^= static_cast<uint8_t>(1 << (random() & 7));
+        _stats.flipped++;
+      }
+      n++;
+    }
+  return n;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    inner
+                          Transport receiving the bytes.
+        @param    clock
+                          Timestamp source, the unit of profile.stall.
+        @param    profile
+                          The fault rates.
+        @param    seed
+                          Seed of the generator.
+*/
+/**************************************************************************/
+FaultTransport::FaultTransport(Transport &inner, clock_fn_t clock,
+                               const fault_profile_t &profile, uint32_t seed)
+    : _inner(inner), _clock(clock), _faults(profile, seed) {}
+
+/**************************************************************************/
+/*!
+        @brief  Pass bytes on, or hold them back during a spike.
+        @param    buf
+                          The bytes.
+        @param    len
+                          Number of bytes.
+*/
+/**************************************************************************/
+void FaultTransport::emit(const uint8_t *buf, size_t len) {
+  if (!_stalled) {
+    _inner.write(buf, len);
+    return;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    if (_held < FAULT::HOLD)
+      _hold[_held++] = buf[i];
+    else
+      _faults.getStats().lost++;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write packets through the faults. Like a wire, accepts all
+                bytes whatever happens to them.
+        @param    buf
+                          The bytes, written in chunks of PACKET::SIZE.
+        @param    len
+                          Number of bytes.
+        @return len.
+*/
+/**************************************************************************/
+size_t FaultTransport::write(const uint8_t *buf, size_t len) {
+  const fault_profile_t &profile = _faults.profile();
+  uint32_t now = _clock();
+  uint8_t out[FAULT::EXPANSION * PACKET::SIZE];
+
+  for (size_t offset = 0; offset < len; offset += PACKET::SIZE) {
+    size_t chunk = len - offset < PACKET::SIZE ? len - offset : PACKET::SIZE;
+
+    if (_dead && TIME::reached(now, _deadUntil))
+      _dead = false;
+    if (!_dead && _faults.chance(profile.outage)) {
+      _dead = true;
+      _deadUntil = now + profile.stall;
+      _faults.getStats().outages++;
+    }
+    if (_dead) {
+      _faults.getStats().lost += chunk;
+      continue;
+    }
+
+    if (_stalled && TIME::reached(now, _stallUntil))
+      poll();
+    if (!_stalled && _faults.chance(profile.spike)) {
+      _stalled = true;
+      _stallUntil = now + profile.stall;
+      _faults.getStats().spikes++;
+    }
+
+    emit(out, _faults.apply(buf + offset, chunk, out));
+  }
+  return len;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Release the bytes held back once a spike is over. Call
+                regularly, e.g. from the loop that drains the packets.
+*/
+/**************************************************************************/
+void FaultTransport::poll() {
+  if (_stalled && !TIME::reached(_clock(), _stallUntil))
+    return;
+
+  _stalled = false;
+  if (_held) {
+    _inner.write(_hold, _held);
+    _held = 0;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Whether an outage is in progress.
+        @return True while bytes written are lost.
+*/
+/**************************************************************************/
+bool FaultTransport::down() {
+  if (_dead && TIME::reached(_clock(), _deadUntil))
+    _dead = false;
+  return _dead;
+}
@@ -0,0 +1,113 @@
+/*!
+ * @file DFPlayerMiniFault.hpp
+ *
+ * Fault injection for testing recovery before a noisy cable or a brown-out
+ * does it in the field. FaultInjector mutates a stream of packets the way
+ * a bad link does: lost bytes, flipped bits, garbage between bytes,
+ * truncated and duplicated packets. FaultTransport wraps the transport of
+ * a module and adds latency spikes, which hold the bytes back, and outages,
+ * which lose them. All faults come from a seeded pseudo-random generator,
+ * so a run is reproduced exactly by its profile and seed.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_FAULT_H__
+#define __DFPLAYERMINI_FAULT_H__
+
+#include "DFPlayerMiniTransport.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Fault Values */
+namespace FAULT {
+constexpr uint32_t PPM = 1000000; // rates are in parts per million
+constexpr uint8_t EXPANSION = 4;  // max output bytes per input byte
+constexpr uint8_t HOLD = 64;      // bytes held back during a spike
+} // namespace FAULT
+
+/** Fault rates in parts per million */
+struct fault_profile_t {
+  uint32_t drop;      // per byte: the byte is lost
+  uint32_t flip;      // per byte: one bit of the byte is inverted
+  uint32_t garbage;   // per byte: a random byte is inserted before it
+  uint32_t truncate;  // per packet: the packet is cut short
+  uint32_t duplicate; // per packet: the packet arrives twice
+  uint32_t spike;     // per packet: the link stalls, bytes arrive late
+  uint32_t outage;    // per packet: the link goes dead, bytes are lost
+  uint32_t stall;     // clock ticks a spike or outage lasts
+};
+
+/** Faults injected so far */
+struct fault_stats_t {
+  uint32_t packets;    // packets passed in
+  uint32_t dropped;    //
+  uint32_t flipped;    //
+  uint32_t garbage;    //
+  uint32_t truncated;  //
+  uint32_t duplicated; //
+  uint32_t spikes;     //
+  uint32_t outages;    //
+  uint32_t lost;       // bytes lost to outages and a full hold buffer
+};
+
+/**************************************************************************/
+/*!
+        @brief  Deterministic mutation of a packet stream.
+*/
+/**************************************************************************/
+class FaultInjector {
+  fault_profile_t _profile;
+  uint32_t _state;
+  fault_stats_t _stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+public:
+  FaultInjector(const fault_profile_t &profile, uint32_t seed = 1);
+
+  void setProfile(const fault_profile_t &profile) { _profile = profile; }
+  const fault_profile_t &profile() const { return _profile; }
+  void seed(uint32_t seed) { _state = seed ? seed : 1; }
+
+  uint32_t random();
+  bool chance(uint32_t ppm) { return ppm && random() % FAULT::PPM < ppm; }
+
+  size_t apply(const uint8_t *in, size_t len, uint8_t *out);
+
+  fault_stats_t &getStats() { return _stats; }
+};
+
+/**************************************************************************/
+/*!
+        @brief  Transport injecting faults into what is written to another
+                transport.
+*/
+/**************************************************************************/
+class FaultTransport : public Transport {
+  Transport &_inner;
+  clock_fn_t _clock;
+  FaultInjector _faults;
+
+  uint8_t _hold[FAULT::HOLD];
+  uint8_t _held = 0;
+  uint32_t _stallUntil = 0;
+  uint32_t _deadUntil = 0;
+  bool _stalled = false;
+  bool _dead = false;
+
+  void emit(const uint8_t *buf, size_t len);
+
+public:
+  FaultTransport(Transport &inner, clock_fn_t clock,
+                 const fault_profile_t &profile, uint32_t seed = 1);
+
+  size_t write(const uint8_t *buf, size_t len) override;
+  size_t availableForWrite() override { return _inner.availableForWrite(); }
+
+  void poll();
+  bool down();
+
+  FaultInjector &faults() { return _faults; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,115 @@
+/*!
+ * @file DFPlayerMiniGroup.cpp
+ *
+ * Encode-once fan-out of a packet to a group of modules.
+ *
+ */
+
+#include "DFPlayerMiniGroup.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    ports
+                          Array of the ports the modules are connected to.
+        @param    count
+                          Number of ports in the array.
+        @param    clock
+                          Timestamp source used for scheduling and skew
+                          measurement, normally micros().
+        @param    feedback
+                          Policy of which packets require the modules to give
+                          feedback.
+*/
+/**************************************************************************/
+DFPlayerMiniGroup::DFPlayerMiniGroup(Transport **ports, uint8_t count,
+                                     clock_fn_t clock, FeedbackPolicy feedback)
+    : _ports(ports), _count(count), _clock(clock), _player(feedback) {}
+
+/**************************************************************************/
+/*!
+        @brief  Take the packet last encoded through operator-> and schedule
+                it for all ports.
+        @param    releaseAt
+                          Clock timestamp at which the packet goes out.
+        @return Number of ports able to take the whole packet without
+                blocking right now.
+*/
+/**************************************************************************/
+uint8_t DFPlayerMiniGroup::arm(uint32_t releaseAt) {
+  _player.getStack(_frame);
+  _releaseAt = releaseAt;
+  _armed = true;
+
+  uint8_t ready = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    if (_ports[i]->availableForWrite() >= PACKET::SIZE)
+      ready++;
+
+  _stats.lastReady = ready;
+  return ready;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Release the armed packet once the scheduled instant is within
+                the spin window. Call this from the main loop.
+        @return True if the packet has been released by this call.
+*/
+/**************************************************************************/
+bool DFPlayerMiniGroup::poll() {
+  if (!_armed || !TIME::reached(_clock() + _spin, _releaseAt))
+    return false;
+
+  release();
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Busy-wait for the scheduled instant, then write the armed
+                packet to every port back to back. A port taking only part
+                of the packet gets one more try at the rest, after that it
+                is reported by failed().
+        @return Number of ports that took the whole packet.
+*/
+/**************************************************************************/
+uint8_t DFPlayerMiniGroup::release() {
+  if (!_armed)
+    return 0;
+  _armed = false;
+
+  while (!TIME::reached(_clock(), _releaseAt))
+    ;
+
+  uint8_t failed = 0;
+  uint32_t first = _clock();
+  for (uint8_t i = 0; i < _count; i++) {
+    size_t written = _ports[i]->write(_frame, PACKET::SIZE);
+    if (written < PACKET::SIZE)
+      written += _ports[i]->write(_frame + written, PACKET::SIZE - written);
+
+    uint8_t bit = static_cast<uint8_t>(1 << (i & 7));
+    if (written < PACKET::SIZE) {
+      _failed[i >> 3] |= bit;
+      failed++;
+    } else {
+      _failed[i >> 3] &= static_cast<uint8_t>(~bit);
+    }
+  }
+  uint32_t last = _clock();
+
+  _stats.releases++;
+  _stats.failures += failed;
+  _stats.lastFailed = failed;
+  _stats.lastSkew = last - first;
+  _stats.lastLateness = first - _releaseAt;
+  if (_stats.lastSkew > _stats.maxSkew)
+    _stats.maxSkew = _stats.lastSkew;
+  if (_stats.lastLateness > _stats.maxLateness)
+    _stats.maxLateness = _stats.lastLateness;
+
+  return static_cast<uint8_t>(_count - failed);
+}
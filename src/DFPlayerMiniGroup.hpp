@@ -0,0 +1,69 @@
+/*!
+ * @file DFPlayerMiniGroup.hpp
+ *
+ * Group commands for starting several modules together (multi-room, show
+ * control). The packet is encoded once, armed on every port and released at
+ * a scheduled instant with the ports written back to back.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_GROUP_H__
+#define __DFPLAYERMINI_GROUP_H__
+
+#include "DFPlayerMiniTransport.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Timing of the group releases, in clock ticks (normally us) */
+struct group_stats_t {
+  uint32_t releases;     // number of completed releases
+  uint32_t lastSkew;     // first to last port handoff of the last release
+  uint32_t maxSkew;      // worst skew seen so far
+  uint32_t lastLateness; // scheduled instant to first port handoff
+  uint32_t maxLateness;  // worst lateness seen so far
+  uint32_t failures;     // ports that did not take the whole packet
+  uint8_t lastReady;     // ports able to take the packet at arm()
+  uint8_t lastFailed;    // ports that did not take it at the last release
+};
+
+/**************************************************************************/
+/*!
+        @brief  Send the same packet to a group of modules at one instant.
+*/
+/**************************************************************************/
+class DFPlayerMiniGroup {
+  Transport **_ports;
+  uint8_t _count;
+  clock_fn_t _clock;
+  uint32_t _spin = 1000;
+
+  DFPlayerMini _player;
+  uint8_t _frame[PACKET::SIZE];
+  uint32_t _releaseAt = 0;
+  bool _armed = false;
+  uint8_t _failed[32] = {}; // bit per port, set if the last release failed
+
+  group_stats_t _stats = {0, 0, 0, 0, 0, 0, 0, 0};
+
+public:
+  DFPlayerMiniGroup(Transport **ports, uint8_t count, clock_fn_t clock,
+                    FeedbackPolicy feedback = false);
+
+  DFPlayerMini *operator->() { return &_player; }
+  void setSpinWindow(uint32_t ticks) { _spin = ticks; }
+
+  uint8_t arm(uint32_t releaseAt);
+  void disarm() { _armed = false; }
+  bool armed() const { return _armed; }
+  bool poll();
+  uint8_t release();
+
+  bool failed(uint8_t port) const {
+    return _failed[port >> 3] & (1 << (port & 7));
+  }
+  const group_stats_t &getStats() const { return _stats; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,67 @@
+/*!
+ * @file DFPlayerMiniPacer.cpp
+ *
+ * Link pacing for one module.
+ *
+ */
+
+#include "DFPlayerMiniPacer.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    baud
+                          Baud rate of the link.
+        @param    gap
+                          Minimum time in ms the module needs between the end
+                          of a packet and the start of the next one.
+*/
+/**************************************************************************/
+Pacer::Pacer(uint32_t baud, uint16_t gap) { setTiming(baud, gap); }
+
+/**************************************************************************/
+/*!
+        @brief  Change the link timing.
+        @param    baud
+                          Baud rate of the link.
+        @param    gap
+                          Minimum time in ms between two packets.
+*/
+/**************************************************************************/
+void Pacer::setTiming(uint32_t baud, uint16_t gap) {
+  uint32_t bits = static_cast<uint32_t>(PACKET::SIZE) * LINK::BITS_PER_BYTE;
+  uint32_t wire = (bits * 1000 + baud - 1) / baud;
+
+  _slot = static_cast<uint16_t>(wire + gap);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Check whether a packet may be sent now.
+        @param    now
+                          Current time in ms.
+        @return True if the previous packets and their gaps are over.
+*/
+/**************************************************************************/
+bool Pacer::ready(uint32_t now) const {
+  return _idle || TIME::reached(now, _nextFree);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Account for packets just handed to the link.
+        @param    now
+                          Current time in ms.
+        @param    frames
+                          Number of packets written.
+*/
+/**************************************************************************/
+void Pacer::sent(uint32_t now, uint8_t frames) {
+  if (ready(now))
+    _nextFree = now;
+
+  _nextFree += static_cast<uint32_t>(_slot) * frames;
+  _idle = false;
+}
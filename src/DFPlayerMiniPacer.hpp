@@ -0,0 +1,47 @@
+/*!
+ * @file DFPlayerMiniPacer.hpp
+ *
+ * Book-keeping of the serial link to one module: how long a packet occupies
+ * the wire at the configured baud rate plus the gap the module needs before
+ * it accepts the next packet.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_PACER_H__
+#define __DFPLAYERMINI_PACER_H__
+
+#include "DFPlayerMini.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Link Values */
+namespace LINK {
+constexpr uint32_t DEFAULT_BAUD = 9600; // baud rate of the module UART
+constexpr uint16_t DEFAULT_GAP = 20;    // ms between two packets
+constexpr uint8_t BITS_PER_BYTE = 10;   // 8N1: start + 8 data + stop
+} // namespace LINK
+
+/**************************************************************************/
+/*!
+        @brief  Tracks when the link to a module is free for the next packet.
+*/
+/**************************************************************************/
+class Pacer {
+  uint16_t _slot;
+  uint32_t _nextFree = 0;
+  bool _idle = true;
+
+public:
+  Pacer(uint32_t baud = LINK::DEFAULT_BAUD, uint16_t gap = LINK::DEFAULT_GAP);
+
+  void setTiming(uint32_t baud, uint16_t gap);
+  uint16_t slotMs() const { return _slot; }
+
+  bool ready(uint32_t now) const;
+  uint32_t nextFree() const { return _nextFree; }
+  void sent(uint32_t now, uint8_t frames = 1);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
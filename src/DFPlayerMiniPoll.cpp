@@ -0,0 +1,193 @@
+/*!
+ * @file DFPlayerMiniPoll.cpp
+ *
+ * Pipelined status polling.
+ *
+ */
+
+#include "DFPlayerMiniPoll.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    queries
+                          The queries to poll, only cmd and param need to be
+                          set.
+        @param    count
+                          Number of entries in queries.
+        @param    link
+                          Pacer of the module's link.
+*/
+/**************************************************************************/
+PollSet::PollSet(query_t *queries, uint8_t count, Pacer &link)
+    : _queries(queries), _count(count), _link(link), _player(false) {}
+
+/**************************************************************************/
+/*!
+        @brief  Start a new round of the poll set.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PollSet::start(uint32_t now) {
+  for (uint8_t i = 0; i < _count; i++) {
+    _queries[i].state = QUERY_STATE::PENDING;
+    _queries[i].value = -1;
+    _queries[i].rtt = 0;
+  }
+
+  _inFlight = 0;
+  _startedAt = now;
+  _finishedAt = now;
+  _running = _count != 0;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Time out overdue queries and produce the next query packet
+                while the window and the link allow it.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool PollSet::poll(uint32_t now, stack_t &_stack) {
+  if (!_running)
+    return false;
+
+  uint16_t timeout = _rtt ? _rtt->timeout(_device, RTT::QUERY) : _timeout;
+  for (uint8_t i = 0; i < _count; i++) {
+    query_t &query = _queries[i];
+    if (query.state == QUERY_STATE::IN_FLIGHT &&
+        now - query.sentAt >= timeout) {
+      settle(query, QUERY_STATE::FAILED, -1, now);
+      DFPLAYERMINI_TRACE_INSTANT(TRACE::TIMEOUT, _device, query.cmd,
+                                 query.param);
+      if (_rtt)
+        _rtt->backoff(_device, RTT::QUERY);
+    }
+  }
+
+  if (!_running || _inFlight >= _window || !_link.ready(now))
+    return false;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    query_t &query = _queries[i];
+    if (query.state != QUERY_STATE::PENDING)
+      continue;
+
+    _player.query(query.cmd, 0, query.param);
+    _player.getStack(_stack);
+    _link.sent(now);
+
+    query.state = QUERY_STATE::IN_FLIGHT;
+    query.sentAt = now;
+    _inFlight++;
+    return true;
+  }
+
+  return false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Match a packet received from the module to the oldest query
+                in flight it answers.
+        @param    _stack
+                          The packet received.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PollSet::feed(const stack_t &_stack, uint32_t now) {
+  bool error = _stack.command == QUERYCMD::RETRANSMIT;
+  query_t *oldest = nullptr;
+
+  if (_echo && _stack.command == _echo) {
+    _echo = 0;
+    if (now - _echoAt < _timeout)
+      return; // second copy of the last answer
+  }
+
+  for (uint8_t i = 0; i < _count; i++) {
+    query_t &query = _queries[i];
+    if (query.state != QUERY_STATE::IN_FLIGHT)
+      continue;
+    if (!error && query.cmd != _stack.command)
+      continue;
+    if (!oldest || static_cast<int32_t>(query.sentAt - oldest->sentAt) < 0)
+      oldest = &query;
+  }
+
+  if (!oldest)
+    return;
+
+  if (error) {
+    DFPLAYERMINI_TRACE_INSTANT(TRACE::ERROR, _device, oldest->cmd,
+                               _stack.paramLSB);
+    settle(*oldest, QUERY_STATE::FAILED, -1, now);
+    return;
+  }
+
+  if (_state)
+    _state->observeReceived(_stack);
+  settle(*oldest, QUERY_STATE::DONE,
+         static_cast<int16_t>((_stack.paramMSB << 8) | _stack.paramLSB), now);
+  if (_twice) {
+    _echo = _stack.command;
+    _echoAt = now;
+  }
+  DFPLAYERMINI_TRACE_INSTANT(TRACE::REPLY, _device, _stack.command,
+                             oldest->rtt);
+  if (_rtt)
+    _rtt->sample(_device, RTT::QUERY, oldest->rtt);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Look up the answer to a query of the last round.
+        @param    cmd
+                          The QUERYCMD value.
+        @return The reply parameter, -1 if not answered.
+*/
+/**************************************************************************/
+int16_t PollSet::value(uint8_t cmd) const {
+  for (uint8_t i = 0; i < _count; i++)
+    if (_queries[i].cmd == cmd && _queries[i].state == QUERY_STATE::DONE)
+      return _queries[i].value;
+
+  return -1;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Complete a query in flight.
+        @param    query
+                          The query.
+        @param    state
+                          QUERY_STATE::DONE or QUERY_STATE::FAILED.
+        @param    value
+                          The reply parameter.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PollSet::settle(query_t &query, uint8_t state, int16_t value,
+                     uint32_t now) {
+  query.state = state;
+  query.value = value;
+  query.rtt = static_cast<uint16_t>(now - query.sentAt);
+  _inFlight--;
+
+  for (uint8_t i = 0; i < _count; i++)
+    if (_queries[i].state <= QUERY_STATE::IN_FLIGHT)
+      return;
+
+  _running = false;
+  _finishedAt = now;
+}
@@ -0,0 +1,90 @@
+/*!
+ * @file DFPlayerMiniPoll.hpp
+ *
+ * Pipelined status polling. Instead of one stop-and-wait round trip per
+ * query, a poll set keeps up to a window of queries in flight and matches
+ * the replies as they arrive, so a full health poll costs close to the wire
+ * time of its packets.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_POLL_H__
+#define __DFPLAYERMINI_POLL_H__
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniRtt.hpp"
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Query States */
+namespace QUERY_STATE {
+constexpr uint8_t PENDING = 0;  // not sent yet
+constexpr uint8_t IN_FLIGHT = 1; // sent, waiting for the reply
+constexpr uint8_t DONE = 2;     // reply received
+constexpr uint8_t FAILED = 3;   // error reply or timeout
+} // namespace QUERY_STATE
+
+/** One query of a poll set */
+struct query_t {
+  uint8_t cmd;     // QUERYCMD value, set by the user
+  uint8_t param;   // parameter LSB, e.g. the folder for GET_FOLDER_FILES
+  uint8_t state;   // QUERY_STATE value
+  int16_t value;   // reply parameter, -1 if none
+  uint32_t sentAt; // ms timestamp the query went out
+  uint16_t rtt;    // ms from sending to the reply
+};
+
+/**************************************************************************/
+/*!
+        @brief  Set of queries sent back to back to one module.
+*/
+/**************************************************************************/
+class PollSet {
+  query_t *_queries;
+  uint8_t _count;
+  Pacer &_link;
+  PlaybackState *_state = nullptr;
+  RttTable *_rtt = nullptr;
+  uint8_t _device = 0;
+  DFPlayerMini _player;
+
+  uint8_t _window = 4;
+  uint16_t _timeout = 100;
+  uint8_t _inFlight = 0;
+  uint32_t _startedAt = 0;
+  uint32_t _finishedAt = 0;
+  bool _running = false;
+  bool _twice = false; // the module answers every query twice
+  uint8_t _echo = 0;   // command whose second answer is still due
+  uint32_t _echoAt = 0;
+
+  void settle(query_t &query, uint8_t state, int16_t value, uint32_t now);
+
+public:
+  PollSet(query_t *queries, uint8_t count, Pacer &link);
+
+  void setState(PlaybackState *state) { _state = state; }
+  void setWindow(uint8_t window) { _window = window ? window : 1; }
+  void setTimeout(uint16_t threshold) { _timeout = threshold; }
+  void setDoubleReply(bool twice) {
+    _twice = twice;
+    _echo = 0;
+  }
+  void setEstimator(RttTable *rtt, uint8_t device) {
+    _rtt = rtt;
+    _device = device;
+  }
+
+  void start(uint32_t now);
+  bool poll(uint32_t now, stack_t &_stack);
+  void feed(const stack_t &_stack, uint32_t now);
+
+  bool done() const { return !_running; }
+  uint32_t elapsed() const { return _finishedAt - _startedAt; }
+  int16_t value(uint8_t cmd) const;
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,279 @@
+/*!
+ * @file DFPlayerMiniPosition.cpp
+ *
+ * Host-side playback position estimate.
+ *
+ */
+
+#include "DFPlayerMiniPosition.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    index
+                          Card index holding the track durations, nullptr
+                          if they are not known.
+        @param    baud
+                          Baud rate of the link.
+        @param    processing
+                          Time in ms the module takes to act on a packet
+                          once it has received it.
+*/
+/**************************************************************************/
+PositionTracker::PositionTracker(const CardIndex *index, uint32_t baud,
+                                 uint16_t processing)
+    : _index(index) {
+  setLatency(baud, processing);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Change the latency added to every packet.
+        @param    baud
+                          Baud rate of the link.
+        @param    processing
+                          Time in ms the module takes to act on a packet.
+*/
+/**************************************************************************/
+void PositionTracker::setLatency(uint32_t baud, uint16_t processing) {
+  uint32_t bits = static_cast<uint32_t>(PACKET::SIZE) * LINK::BITS_PER_BYTE;
+
+  _wire = static_cast<uint16_t>((bits * 1000 + baud - 1) / baud);
+  _latency = static_cast<uint16_t>(_wire + processing);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Update the clock from a packet sent to the module.
+        @param    _stack
+                          The packet sent.
+        @param    now
+                          Time in ms the packet was handed to the link.
+*/
+/**************************************************************************/
+void PositionTracker::observeSent(const stack_t &_stack, uint32_t now) {
+  uint16_t first, second;
+  DFPlayerMini::decode(_stack, first, second);
+  uint32_t at = now + _latency;
+
+  switch (_stack.command) {
+  case CONTROLCMD::PLAY_TRACK:
+    _sequence = false;
+    start(CARD::ROOT, first, at);
+    break;
+  case CONTROLCMD::PLAY_MP3_FOLDER:
+    _sequence = false;
+    start(CARD::MP3, first, at);
+    break;
+  case CONTROLCMD::PLAY_FOLDER_TRACK:
+  case CONTROLCMD::PLAY_LARGE_FOLDER:
+    _sequence = false;
+    start(static_cast<uint8_t>(first), second, at);
+    break;
+  case CONTROLCMD::PLAY_NEXT:
+    start(_folder, _number ? _number + 1 : 0, at);
+    break;
+  case CONTROLCMD::PLAY_PREV:
+    start(_folder, _number > 1 ? _number - 1 : _number, at);
+    break;
+  case CONTROLCMD::REPEAT_FOLDER:
+  case CONTROLCMD::RANDOM_ALL:
+    _sequence = true;
+    start(CARD::INVALID, 0, at);
+    break;
+  case CONTROLCMD::INSERT_ADVERT:
+    if (_running) {
+      freeze(at);
+      _advert = true;
+    }
+    break;
+  case CONTROLCMD::STOP_ADVERT:
+    if (_advert) {
+      _advert = false;
+      resume(at);
+    }
+    break;
+  case CONTROLCMD::PLAY:
+    if (!_advert)
+      resume(at);
+    break;
+  case CONTROLCMD::PAUSE:
+    freeze(at);
+    break;
+  case CONTROLCMD::STOP:
+    _running = false;
+    _advert = false;
+    _base = 0;
+    _since = at;
+    break;
+  case CONTROLCMD::SET_PLAYBACK_MODE:
+    _loop = first == PLAYBACK_MODE::SINGLE_REPEAT;
+    _sequence = first == PLAYBACK_MODE::FOLDER_REPEAT ||
+                first == PLAYBACK_MODE::RANDOM;
+    break;
+  case CONTROLCMD::REPEAT_CURRENT:
+    _loop = first == SINGLE_REPEAT::START;
+    break;
+  case CONTROLCMD::SET_PLAYBACK_SRC:
+    if (first == PLAYBACK_SRC::SLEEP)
+      freeze(at);
+    break;
+  case CONTROLCMD::MODE_STANDBY:
+  case CONTROLCMD::MODE_RESET:
+    // keep the position, e.g. to resume after the reset
+    freeze(at);
+    _advert = false;
+    _loop = false;
+    _sequence = false;
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Update the clock from a packet received from the module.
+        @param    _stack
+                          The packet received.
+        @param    now
+                          Time in ms the packet was received.
+*/
+/**************************************************************************/
+void PositionTracker::observeReceived(const stack_t &_stack, uint32_t now) {
+  // the module sent the packet one wire time ago
+  uint32_t at = now - _wire;
+
+  switch (_stack.command) {
+  case REPORT::U_FINISHED:
+  case REPORT::TF_FINISHED:
+  case REPORT::FLASH_FINISHED:
+    if (_advert) {
+      _advert = false;
+      resume(at);
+    } else if (!_running) {
+      break; // some chips report a track twice
+    } else if (_loop) {
+      start(_folder, _number, at);
+    } else if (_sequence) {
+      start(CARD::INVALID, 0, at);
+    } else {
+      freeze(at);
+      if (_duration)
+        _base = _duration;
+    }
+    break;
+  case QUERYCMD::SEND_INIT:
+    freeze(at);
+    _advert = false;
+    _loop = false;
+    _sequence = false;
+    break;
+  case QUERYCMD::GET_STATUS_:
+    if (_stack.paramLSB == PLAYBACK::STOPPED && _running && !_advert)
+      freeze(at);
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Forget the track and stop the clock.
+*/
+/**************************************************************************/
+void PositionTracker::clear() {
+  _folder = CARD::INVALID;
+  _number = 0;
+  _duration = 0;
+  _base = 0;
+  _since = 0;
+  _running = false;
+  _advert = false;
+  _loop = false;
+  _sequence = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Time left of the current track.
+        @param    now
+                          Current time in ms.
+        @return Remaining time in ms, 0 if the duration is not known.
+*/
+/**************************************************************************/
+uint32_t PositionTracker::remaining(uint32_t now) const {
+  return _duration ? _duration - positionAt(now) : 0;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Position at a point in time, not before the last change of
+                the clock.
+        @param    t
+                          The time in ms.
+        @return Position in ms, at most the duration if it is known.
+*/
+/**************************************************************************/
+uint32_t PositionTracker::positionAt(uint32_t t) const {
+  uint32_t position = _base;
+  if (_running && TIME::reached(t, _since))
+    position += t - _since;
+
+  return _duration && position > _duration ? _duration : position;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start the clock on a new track.
+        @param    folder
+                          CARD id or folder of the track.
+        @param    number
+                          Track number, 0 if the module picks the track.
+        @param    at
+                          Time in ms the track starts.
+*/
+/**************************************************************************/
+void PositionTracker::start(uint8_t folder, uint16_t number, uint32_t at) {
+  const card_track_t *track =
+      _index && number ? _index->track(folder, number) : nullptr;
+
+  _folder = number ? folder : CARD::INVALID;
+  _number = number;
+  _duration = track ? track->duration : 0;
+  _base = 0;
+  _since = at;
+  _running = true;
+  _advert = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Stop the clock, keeping the position.
+        @param    at
+                          Time in ms the module stops.
+*/
+/**************************************************************************/
+void PositionTracker::freeze(uint32_t at) {
+  _base = positionAt(at);
+  _since = at;
+  _running = false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Run the clock on from the kept position.
+        @param    at
+                          Time in ms the module continues.
+*/
+/**************************************************************************/
+void PositionTracker::resume(uint32_t at) {
+  if (_running)
+    return;
+
+  _since = at;
+  _running = true;
+}
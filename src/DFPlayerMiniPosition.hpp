@@ -0,0 +1,75 @@
+/*!
+ * @file DFPlayerMiniPosition.hpp
+ *
+ * Playback position of one module, estimated on the host. The module has no
+ * position query, so the tracker runs a clock of its own: started, paused
+ * and stopped by the packets sent to the module and by its track finished
+ * reports, shifted by the time a packet spends on the wire and in the
+ * module. Track durations come from the card index written by dfpindex and
+ * are looked up once per track, so a position query is a subtraction and
+ * never touches the UART.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_POSITION_H__
+#define __DFPLAYERMINI_POSITION_H__
+
+#include "DFPlayerMiniCard.hpp"
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Position Values */
+namespace POSITION {
+constexpr uint16_t PROCESSING = 30; // ms from a packet to the module acting
+} // namespace POSITION
+
+/**************************************************************************/
+/*!
+        @brief  Estimated playback position of one module.
+*/
+/**************************************************************************/
+class PositionTracker {
+  const CardIndex *_index;
+  uint16_t _wire;    // ms one packet takes on the wire
+  uint16_t _latency; // ms from sending a packet to the module acting on it
+
+  uint8_t _folder = CARD::INVALID; // CARD id or 1-99 of the track
+  uint16_t _number = 0;            // track number, 0 if not known
+  uint32_t _duration = 0;          // ms, 0 if not known
+  uint32_t _base = 0;              // position in ms at _since
+  uint32_t _since = 0;             // timestamp the clock last changed
+  bool _running = false;
+  bool _advert = false;   // an advert interrupts the track
+  bool _loop = false;     // the module repeats the track
+  bool _sequence = false; // the module moves on to tracks it picks itself
+
+  uint32_t positionAt(uint32_t t) const;
+  void start(uint8_t folder, uint16_t number, uint32_t at);
+  void freeze(uint32_t at);
+  void resume(uint32_t at);
+
+public:
+  PositionTracker(const CardIndex *index = nullptr,
+                  uint32_t baud = LINK::DEFAULT_BAUD,
+                  uint16_t processing = POSITION::PROCESSING);
+
+  void setIndex(const CardIndex *index) { _index = index; }
+  void setLatency(uint32_t baud, uint16_t processing);
+
+  void observeSent(const stack_t &_stack, uint32_t now);
+  void observeReceived(const stack_t &_stack, uint32_t now);
+  void clear();
+
+  uint32_t position(uint32_t now) const { return positionAt(now); }
+  uint32_t remaining(uint32_t now) const;
+  uint32_t duration() const { return _duration; }
+  uint8_t folder() const { return _folder; }
+  uint16_t number() const { return _number; }
+  bool running() const { return _running; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,345 @@
+/*!
+ * @file DFPlayerMiniPower.cpp
+ *
+ * Idle power management.
+ *
+ */
+
+#include "DFPlayerMiniPower.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    state
+                          Tracked state of the module.
+        @param    link
+                          Pacer of the module's link.
+        @param    queue
+                          Storage for commands submitted while the module
+                          wakes up.
+        @param    capacity
+                          Number of entries in queue.
+        @param    feedback
+                          Policy of which packets require the module to give
+                          feedback.
+*/
+/**************************************************************************/
+PowerManager::PowerManager(PlaybackState &state, Pacer &link,
+                           power_command_t *queue, uint8_t capacity,
+                           FeedbackPolicy feedback)
+    : _state(state), _link(link), _player(feedback), _queue(queue),
+      _capacity(capacity) {}
+
+/**************************************************************************/
+/*!
+        @brief  Set the idle times before standby and sleep.
+        @param    standby
+                          ms idle before standby, 0 to skip standby.
+        @param    sleep
+                          ms idle before sleep, 0 to never sleep.
+*/
+/**************************************************************************/
+void PowerManager::setIdleTimes(uint32_t standby, uint32_t sleep) {
+  _standbyAfter = standby;
+  _sleepAfter = sleep;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Set how long a module takes to wake up.
+        @param    settle
+                          ms after leaving standby until commands are
+                          accepted.
+        @param    initTimeout
+                          ms to wait for 0x3F after the reset that ends
+                          sleep.
+*/
+/**************************************************************************/
+void PowerManager::setWakeTimes(uint16_t settle, uint16_t initTimeout) {
+  _settle = settle;
+  _initTimeout = initTimeout;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Queue a command for the module, waking it up if needed.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+        @param    now
+                          Current time in ms.
+        @return False if the queue is full.
+*/
+/**************************************************************************/
+bool PowerManager::submit(uint8_t cmd, uint16_t first, uint16_t second,
+                          uint32_t now) {
+  if (_count >= _capacity)
+    return false;
+
+  _queue[(_head + _count++) % _capacity] = {cmd, first, second};
+  _lastActivity = now;
+
+  if (_phase == ENTERING) {
+    _phase = _level == POWER::ACTIVE ? RUNNING : WAKING;
+  } else if (_phase == LOW) {
+    _phase = WAKING;
+  }
+  if (_phase == WAKING && !_waking) {
+    _waking = true;
+    _wakeAt = now;
+  }
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Update idle time and wake-up progress from a packet
+                received from the module. Only reports the module sends on
+                its own count as activity; replies to status polls do not
+                keep it awake.
+        @param    _stack
+                          The packet received.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PowerManager::notify(const stack_t &_stack, uint32_t now) {
+  bool report = _stack.command >= REPORT::DEVICE_INSERTED &&
+                _stack.command <= REPORT::FLASH_FINISHED;
+  if (_phase == RUNNING && report)
+    _lastActivity = now;
+
+  if (_phase == WAITING && _level == POWER::SLEEP &&
+      _stack.command == QUERYCMD::SEND_INIT) {
+    _state.observeReceived(_stack);
+    restore();
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Produce the next packet: a queued command, a power mode
+                change or a step of waking up.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool PowerManager::poll(uint32_t now, stack_t &_stack) {
+  if (!_started) {
+    _started = true;
+    _since = now;
+    _lastActivity = now;
+    _stats[POWER::ACTIVE].entries = 1;
+  }
+
+  switch (_phase) {
+  case RUNNING:
+    if (_count) {
+      if (!_link.ready(now))
+        return false;
+
+      const power_command_t command = _queue[_head];
+      _head = (_head + 1) % _capacity;
+      _count--;
+      if (_waking)
+        woken(now);
+      return send(command.cmd, command.first, command.second, now, _stack);
+    }
+
+    if (_state.status != PLAYBACK::STOPPED || _state.advert) {
+      _lastActivity = now;
+    } else if (_standbyAfter && now - _lastActivity >= _standbyAfter) {
+      _target = POWER::STANDBY;
+      _phase = ENTERING;
+    } else if (!_standbyAfter && _sleepAfter &&
+               now - _lastActivity >= _sleepAfter) {
+      _target = POWER::SLEEP;
+      _phase = ENTERING;
+    }
+    return false;
+
+  case LOW:
+    if (_level == POWER::STANDBY && _sleepAfter &&
+        now - _lastActivity >= _sleepAfter) {
+      _target = POWER::SLEEP;
+      _phase = ENTERING;
+    }
+    return false;
+
+  case ENTERING:
+    if (!_link.ready(now))
+      return false;
+
+    if (_target == POWER::SLEEP) {
+      if (_level == POWER::ACTIVE)
+        _saved = _state;
+      send(CONTROLCMD::SET_PLAYBACK_SRC, PLAYBACK_SRC::SLEEP, 0, now, _stack);
+    } else {
+      _saved = _state;
+      send(CONTROLCMD::MODE_STANDBY, 0, 0, now, _stack);
+    }
+    enter(_target, now);
+    _phase = LOW;
+    return true;
+
+  case WAKING:
+    if (!_link.ready(now))
+      return false;
+
+    send(_level == POWER::STANDBY ? CONTROLCMD::MODE_NORMAL
+                                  : CONTROLCMD::MODE_RESET,
+         0, 0, now, _stack);
+    _wokenAt = now;
+    _phase = WAITING;
+    return true;
+
+  case WAITING:
+    if (_level == POWER::STANDBY) {
+      if (now - _wokenAt < _settle)
+        return false;
+      _phase = RUNNING;
+    } else {
+      if (now - _wokenAt < _initTimeout)
+        return false;
+      restore(); // 0x3F got lost, the module is up by now
+    }
+    return poll(now, _stack);
+
+  case RESTORING: {
+    if (!_link.ready(now))
+      return false;
+
+    const step_t &step = _steps[_stepIndex++];
+    send(step.cmd, step.first, 0, now, _stack);
+    if (_stepIndex >= _stepCount)
+      _phase = RUNNING;
+    return true;
+  }
+
+  default:
+    return false;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Statistics of a power level, including the time spent at the
+                current level so far.
+        @param    level
+                          The POWER level.
+        @param    now
+                          Current time in ms.
+        @return The statistics.
+*/
+/**************************************************************************/
+const power_level_t &PowerManager::getStats(uint8_t level, uint32_t now) {
+  if (_started)
+    account(now);
+
+  return _stats[level < POWER::LEVELS ? level : POWER::ACTIVE];
+}
+
+/**************************************************************************/
+/*!
+        @brief  Add the time since the last change to the current level.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PowerManager::account(uint32_t now) {
+  _stats[_level].time += now - _since;
+  _since = now;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Switch to a power level.
+        @param    level
+                          The POWER level.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PowerManager::enter(uint8_t level, uint32_t now) {
+  account(now);
+  _level = level;
+  _stats[level].entries++;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Record the wake latency once the first queued command goes
+                out and return to the active level.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void PowerManager::woken(uint32_t now) {
+  power_level_t &stats = _stats[_level];
+  uint32_t latency = now - _wakeAt;
+
+  stats.wakes++;
+  stats.lastWake = latency;
+  stats.totalWake += latency;
+  if (latency > stats.maxWake)
+    stats.maxWake = latency;
+
+  _waking = false;
+  enter(POWER::ACTIVE, now);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Plan the packets restoring the settings saved before sleep.
+*/
+/**************************************************************************/
+void PowerManager::restore() {
+  _stepCount = 0;
+  _stepIndex = 0;
+
+  if (_saved.source != DEFAULTS::SOURCE &&
+      _saved.source != PLAYBACK_SRC::SLEEP)
+    _steps[_stepCount++] = {CONTROLCMD::SET_PLAYBACK_SRC, _saved.source};
+  if (_saved.volume != DEFAULTS::VOLUME)
+    _steps[_stepCount++] = {CONTROLCMD::SET_VOL, _saved.volume};
+  if (_saved.eq != DEFAULTS::EQUALIZER)
+    _steps[_stepCount++] = {CONTROLCMD::SET_EQ, _saved.eq};
+  if (_saved.mode != DEFAULTS::MODE)
+    _steps[_stepCount++] = {CONTROLCMD::SET_PLAYBACK_MODE, _saved.mode};
+
+  _phase = _stepCount ? RESTORING : RUNNING;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Encode a packet and hand it to the link.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet.
+        @return True.
+*/
+/**************************************************************************/
+bool PowerManager::send(uint8_t cmd, uint16_t first, uint16_t second,
+                        uint32_t now, stack_t &_stack) {
+  _player.command(cmd, first, second);
+  _player.getStack(_stack);
+  _state.observeSent(_stack);
+  _link.sent(now);
+  return true;
+}
@@ -0,0 +1,125 @@
+/*!
+ * @file DFPlayerMiniPower.hpp
+ *
+ * Idle power management for one module. Once playback has stopped and no
+ * command arrived for a while, the module is put into standby (0x0A), and
+ * after a longer while into sleep (source 4). Commands submitted meanwhile
+ * are queued, the module is woken (0x0B from standby, a reset followed by
+ * restoring source, volume, EQ and mode from sleep) and the queue is
+ * released once the module is ready. Time spent per power level and the
+ * wake latency out of each level are measured.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_POWER_H__
+#define __DFPLAYERMINI_POWER_H__
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Power Values */
+namespace POWER {
+constexpr uint8_t ACTIVE = 0;  // normal working mode
+constexpr uint8_t STANDBY = 1; // 0x0A, woken by 0x0B
+constexpr uint8_t SLEEP = 2;   // playback source 4, woken by a reset
+constexpr uint8_t LEVELS = 3;
+
+constexpr uint32_t STANDBY_AFTER = 30000; // ms idle before standby
+constexpr uint32_t SLEEP_AFTER = 600000;  // ms idle before sleep
+constexpr uint16_t SETTLE = 200;          // ms after 0x0B until ready
+constexpr uint16_t INIT_TIMEOUT = 3000;   // ms to wait for 0x3F after reset
+} // namespace POWER
+
+/** Statistics of one power level, times in ms */
+struct power_level_t {
+  uint32_t time;      // spent at this level
+  uint32_t entries;   // times the level was entered
+  uint32_t wakes;     // wakes out of this level
+  uint32_t lastWake;  // wake request to the first queued command sent
+  uint32_t maxWake;   // longest wake
+  uint32_t totalWake; // sum, divide by wakes for the mean
+};
+
+/** Command waiting for the module to wake up */
+struct power_command_t {
+  uint8_t cmd;
+  uint16_t first;
+  uint16_t second;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Moves an idle module into standby and sleep and wakes it on
+                demand.
+*/
+/**************************************************************************/
+class PowerManager {
+  /** One packet of the restore sequence */
+  struct step_t {
+    uint8_t cmd;
+    uint16_t first;
+  };
+
+  static constexpr uint8_t MAX_STEPS = 4;
+
+  enum : uint8_t { RUNNING, ENTERING, LOW, WAKING, WAITING, RESTORING };
+
+  PlaybackState &_state;
+  Pacer &_link;
+  DFPlayerMini _player;
+
+  power_command_t *_queue;
+  uint8_t _capacity;
+  uint8_t _head = 0;
+  uint8_t _count = 0;
+
+  uint32_t _standbyAfter = POWER::STANDBY_AFTER;
+  uint32_t _sleepAfter = POWER::SLEEP_AFTER;
+  uint16_t _settle = POWER::SETTLE;
+  uint16_t _initTimeout = POWER::INIT_TIMEOUT;
+
+  uint8_t _phase = RUNNING;
+  uint8_t _level = POWER::ACTIVE;
+  uint8_t _target = POWER::ACTIVE;
+  uint32_t _lastActivity = 0;
+  uint32_t _since = 0;
+  uint32_t _wakeAt = 0;
+  uint32_t _wokenAt = 0;
+  bool _waking = false;
+  bool _started = false;
+
+  PlaybackState _saved;
+  step_t _steps[MAX_STEPS];
+  uint8_t _stepCount = 0;
+  uint8_t _stepIndex = 0;
+
+  power_level_t _stats[POWER::LEVELS] = {};
+
+  void account(uint32_t now);
+  void enter(uint8_t level, uint32_t now);
+  void woken(uint32_t now);
+  void restore();
+  bool send(uint8_t cmd, uint16_t first, uint16_t second, uint32_t now,
+            stack_t &_stack);
+
+public:
+  PowerManager(PlaybackState &state, Pacer &link, power_command_t *queue,
+               uint8_t capacity, FeedbackPolicy feedback = false);
+
+  void setIdleTimes(uint32_t standby, uint32_t sleep);
+  void setWakeTimes(uint16_t settle, uint16_t initTimeout);
+
+  bool submit(uint8_t cmd, uint16_t first, uint16_t second, uint32_t now);
+  void notify(const stack_t &_stack, uint32_t now);
+  bool poll(uint32_t now, stack_t &_stack);
+
+  uint8_t level() const { return _level; }
+  bool ready() const { return _phase == RUNNING; }
+  const power_level_t &getStats(uint8_t level, uint32_t now);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
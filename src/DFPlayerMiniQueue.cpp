@@ -0,0 +1,166 @@
+/*!
+ * @file DFPlayerMiniQueue.cpp
+ *
+ * Thread-safe packet submission.
+ *
+ */
+
+#include "DFPlayerMiniQueue.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+#ifdef DFPLAYERMINI_HAS_ATOMICS
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    slots
+                          Storage of the queue.
+        @param    count
+                          Number of slots, a power of two.
+        @param    feedback
+                          Policy of which packets require the module to give
+                          feedback.
+*/
+/**************************************************************************/
+FrameQueue::FrameQueue(frame_slot_t *slots, uint32_t count,
+                       FeedbackPolicy feedback)
+    : _ring(&_index, slots, count, true), _policy(feedback) {}
+
+/**************************************************************************/
+/*!
+        @brief  Encode a packet into the next free slot. Safe to call from
+                any number of threads at once.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+        @return False if the queue is full.
+*/
+/**************************************************************************/
+bool FrameQueue::submit(uint8_t cmd, uint16_t first, uint16_t second) {
+  uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+  stack_t *slot = _ring.claim();
+  if (!slot)
+    return false;
+
+  DFPlayerMini::encode(*slot, _policy.feedback(cmd), cmd, first, second);
+  _ring.commit(slot);
+  DFPLAYERMINI_TRACE_SPAN(TRACE::ENQUEUE, start, TRACE::NO_DEVICE, cmd,
+                          second);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write the queued packets in submission order, up to max of
+                them in one gathered write. Call from one thread only. A
+                packet the port takes only part of stays queued, and the
+                next drain continues with its remaining bytes.
+        @param    port
+                          The transport.
+        @param    max
+                          Packets per write, at most
+                          TRANSPORT::MAX_SPANS.
+        @return Number of packets completely written.
+*/
+/**************************************************************************/
+size_t FrameQueue::drain(Transport &port, uint8_t max) {
+  span_t spans[TRANSPORT::MAX_SPANS];
+  if (max > TRANSPORT::MAX_SPANS)
+    max = TRANSPORT::MAX_SPANS;
+
+  size_t total = 0;
+  for (;;) {
+    uint8_t count = 0;
+    size_t requested = 0;
+    while (count < max) {
+      stack_t *frame = _ring.front(count);
+      if (!frame)
+        break;
+      uint8_t skip = count ? 0 : _partial;
+      spans[count].data = reinterpret_cast<const uint8_t *>(frame) + skip;
+      spans[count].len = PACKET::SIZE - skip;
+      requested += spans[count].len;
+      count++;
+    }
+
+    if (!count)
+      return total;
+
+    DFPLAYERMINI_TRACE_INSTANT(TRACE::COALESCE, TRACE::NO_DEVICE,
+                               _ring.front()->command, 0, count);
+    uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+    size_t written = port.writev(spans, count);
+    DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, TRACE::NO_DEVICE,
+                            _ring.front()->command, 0, count);
+    if (!consume(written, requested, total))
+      return total;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write the oldest queued packets the link accepts now, for
+                modules that need the packet gap. Call from one thread only.
+        @param    port
+                          The transport.
+        @param    link
+                          Pacer of the module's link.
+        @param    now
+                          Current time in ms.
+        @return Number of packets completely written.
+*/
+/**************************************************************************/
+size_t FrameQueue::drain(Transport &port, Pacer &link, uint32_t now) {
+  size_t total = 0;
+
+  while (link.ready(now)) {
+    stack_t *frame = _ring.front();
+    if (!frame)
+      break;
+
+    size_t requested = PACKET::SIZE - _partial;
+    uint64_t start = DFPLAYERMINI_TRACE_BEGIN();
+    size_t written = port.write(
+        reinterpret_cast<const uint8_t *>(frame) + _partial, requested);
+    DFPLAYERMINI_TRACE_SPAN(TRACE::TX, start, TRACE::NO_DEVICE,
+                            frame->command, 0);
+    if (!consume(written, requested, total))
+      break;
+    link.sent(now);
+  }
+
+  return total;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Release the packets a write has completed and remember how
+                far it got into the next one.
+        @param    written
+                          Bytes the port accepted.
+        @param    requested
+                          Bytes handed to the port.
+        @param    total
+                          Incremented by the packets completed.
+        @return True if the port took everything.
+*/
+/**************************************************************************/
+bool FrameQueue::consume(size_t written, size_t requested, size_t &total) {
+  size_t bytes = _partial + written;
+  size_t frames = bytes / PACKET::SIZE;
+
+  if (frames) {
+    _ring.pop(static_cast<uint32_t>(frames));
+    total += frames;
+  }
+  _partial = static_cast<uint8_t>(bytes % PACKET::SIZE);
+
+  return written == requested;
+}
+
+#endif // DFPLAYERMINI_HAS_ATOMICS
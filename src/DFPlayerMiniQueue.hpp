@@ -0,0 +1,59 @@
+/*!
+ * @file DFPlayerMiniQueue.hpp
+ *
+ * Thread-safe packet submission for one port. A DFPlayerMini instance keeps
+ * its packet in a member, so threads sharing one instance overwrite each
+ * other's packets. Here every submission encodes straight into its own slot
+ * of an MpscRing, without a mutex, and the port's writer thread drains the
+ * ring with gathered writes.
+ *
+ * Compiles to nothing unless the toolchain provides <atomic>.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_QUEUE_H__
+#define __DFPLAYERMINI_QUEUE_H__
+
+#include "DFPlayerMiniRing.hpp"
+
+#ifdef DFPLAYERMINI_HAS_ATOMICS
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniTransport.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Slot of a packet queue */
+typedef ring_slot_t<stack_t> frame_slot_t;
+
+/**************************************************************************/
+/*!
+        @brief  Lock-free multi-producer queue of packets for one port.
+*/
+/**************************************************************************/
+class FrameQueue {
+  ring_index_t _index;
+  MpscRing<stack_t> _ring;
+  FeedbackPolicy _policy;
+  uint8_t _partial = 0; // bytes of the oldest packet already written
+
+  bool consume(size_t written, size_t requested, size_t &total);
+
+public:
+  FrameQueue(frame_slot_t *slots, uint32_t count,
+             FeedbackPolicy feedback = false);
+
+  // any thread
+  bool submit(uint8_t cmd, uint16_t first = 0, uint16_t second = 0);
+  bool submit(const stack_t &_stack) { return _ring.push(_stack); }
+
+  // writer thread
+  size_t drain(Transport &port, uint8_t max = TRANSPORT::MAX_SPANS);
+  size_t drain(Transport &port, Pacer &link, uint32_t now);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif // DFPLAYERMINI_HAS_ATOMICS
+
+#endif
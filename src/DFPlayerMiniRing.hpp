@@ -0,0 +1,151 @@
+/*!
+ * @file DFPlayerMiniRing.hpp
+ *
+ * Bounded lock-free multi-producer/single-consumer ring of fixed-size
+ * records. Every slot carries a sequence number, so producers claim a slot
+ * with one compare-and-swap, fill it in place and publish it with one
+ * release store; the consumer reads records where they lie. The indices
+ * and slots live in caller-provided memory, which may be shared between
+ * threads or mapped into several processes.
+ *
+ * Compiles to nothing unless the toolchain provides <atomic>.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_RING_H__
+#define __DFPLAYERMINI_RING_H__
+
+#if defined(__has_include)
+#if __has_include(<atomic>) && __cplusplus >= 201103L
+#define DFPLAYERMINI_HAS_ATOMICS 1
+#endif
+#endif
+
+#ifdef DFPLAYERMINI_HAS_ATOMICS
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace DFPLAYERMINI {
+
+/** Ring Values */
+namespace RING {
+constexpr size_t CACHE_LINE = 64;
+} // namespace RING
+
+/** Producer and consumer positions, on separate cache lines */
+struct ring_index_t {
+  alignas(RING::CACHE_LINE) std::atomic<uint32_t> tail; // producers
+  alignas(RING::CACHE_LINE) std::atomic<uint32_t> head; // consumer
+};
+
+/** Slot holding one record */
+template <class T> struct ring_slot_t {
+  std::atomic<uint32_t> seq;
+  uint32_t pos;
+  T value;
+};
+
+/**************************************************************************/
+/*!
+        @brief  View of a ring kept in caller-provided memory.
+*/
+/**************************************************************************/
+template <class T> class MpscRing {
+  ring_index_t *_index = nullptr;
+  ring_slot_t<T> *_slots = nullptr;
+  uint32_t _mask = 0;
+
+public:
+  MpscRing() = default;
+  MpscRing(ring_index_t *index, ring_slot_t<T> *slots, uint32_t count,
+           bool init) {
+    attach(index, slots, count, init);
+  }
+
+  /** Use the ring in index and slots, count must be a power of two */
+  void attach(ring_index_t *index, ring_slot_t<T> *slots, uint32_t count,
+              bool init) {
+    _index = index;
+    _slots = slots;
+    _mask = count - 1;
+
+    if (!init)
+      return;
+    for (uint32_t i = 0; i < count; i++)
+      _slots[i].seq.store(i, std::memory_order_relaxed);
+    _index->tail.store(0, std::memory_order_relaxed);
+    _index->head.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  uint32_t capacity() const { return _mask + 1; }
+
+  /** Reserve the next slot, nullptr if the ring is full. Any thread. */
+  T *claim() {
+    uint32_t pos = _index->tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+      ring_slot_t<T> &slot = _slots[pos & _mask];
+      uint32_t seq = slot.seq.load(std::memory_order_acquire);
+      int32_t diff = static_cast<int32_t>(seq - pos);
+
+      if (diff == 0) {
+        if (_index->tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          slot.pos = pos;
+          return &slot.value;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = _index->tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** Publish a record filled after claim(). Any thread. */
+  void commit(T *value) {
+    ring_slot_t<T> *slot = reinterpret_cast<ring_slot_t<T> *>(
+        reinterpret_cast<uint8_t *>(value) - offsetof(ring_slot_t<T>, value));
+    slot->seq.store(slot->pos + 1, std::memory_order_release);
+  }
+
+  /** Copy a record into the ring, false if it is full. Any thread. */
+  bool push(const T &value) {
+    T *slot = claim();
+    if (!slot)
+      return false;
+    *slot = value;
+    commit(slot);
+    return true;
+  }
+
+  /** Published record offset places behind the oldest, or nullptr.
+   * Consumer only. */
+  T *front(uint32_t offset = 0) {
+    uint32_t pos = _index->head.load(std::memory_order_relaxed) + offset;
+    ring_slot_t<T> &slot = _slots[pos & _mask];
+
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+      return nullptr;
+    return &slot.value;
+  }
+
+  /** Release the oldest count records. Consumer only. */
+  void pop(uint32_t count = 1) {
+    uint32_t pos = _index->head.load(std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < count; i++, pos++)
+      _slots[pos & _mask].seq.store(pos + _mask + 1,
+                                    std::memory_order_release);
+    _index->head.store(pos, std::memory_order_relaxed);
+  }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif // DFPLAYERMINI_HAS_ATOMICS
+
+#endif
@@ -0,0 +1,164 @@
+/*!
+ * @file DFPlayerMiniRtt.cpp
+ *
+ * Round-trip time estimation.
+ *
+ */
+
+#include "DFPlayerMiniRtt.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    entries
+                          Storage for devices * RTT::CLASSES estimates.
+        @param    devices
+                          Number of modules.
+*/
+/**************************************************************************/
+RttTable::RttTable(rtt_t *entries, uint8_t devices)
+    : _entries(entries), _devices(devices) {
+  clear();
+}
+
+/**************************************************************************/
+/*!
+        @brief  Get the class a command's round trip is estimated in.
+        @param    cmd
+                          The command ID.
+        @return RTT::QUERY or RTT::ACK.
+*/
+/**************************************************************************/
+uint8_t RttTable::classOf(uint8_t cmd) {
+  return cmd >= QUERYCMD::GET_STATUS_ ? RTT::QUERY : RTT::ACK;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Set the bounds of the timeouts.
+        @param    floor
+                          Lowest timeout in ms.
+        @param    ceiling
+                          Highest timeout in ms, at most RTT::MAX_BOUND.
+*/
+/**************************************************************************/
+void RttTable::setBounds(uint16_t floor, uint16_t ceiling) {
+  // larger values overflow the fixed-point srtt8 and rttvar4
+  if (floor > RTT::MAX_BOUND)
+    floor = RTT::MAX_BOUND;
+  if (ceiling > RTT::MAX_BOUND)
+    ceiling = RTT::MAX_BOUND;
+
+  _floor = floor;
+  _ceiling = ceiling < floor ? floor : ceiling;
+
+  for (uint16_t i = 0; i < _devices * RTT::CLASSES; i++)
+    _entries[i].rto = clamp(_entries[i].rto);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Forget all samples.
+*/
+/**************************************************************************/
+void RttTable::clear() {
+  for (uint16_t i = 0; i < _devices * RTT::CLASSES; i++)
+    _entries[i] = {0, 0, clamp(RTT::INITIAL), 0};
+}
+
+/**************************************************************************/
+/*!
+        @brief  Set the timeout used until the first sample, e.g. from the
+                profile of the module's chip.
+        @param    device
+                          Index of the module.
+        @param    cls
+                          RTT::ACK or RTT::QUERY.
+        @param    ms
+                          The timeout.
+*/
+/**************************************************************************/
+void RttTable::seed(uint8_t device, uint8_t cls, uint16_t ms) {
+  rtt_t &entry = _entries[device * RTT::CLASSES + cls];
+  if (!entry.samples)
+    entry.rto = clamp(ms);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Take a round-trip sample. Only sample replies that cannot
+                belong to an earlier, timed out copy of the same packet.
+        @param    device
+                          Index of the module.
+        @param    cls
+                          RTT::ACK or RTT::QUERY.
+        @param    ms
+                          Time from sending to the reply.
+*/
+/**************************************************************************/
+void RttTable::sample(uint8_t device, uint8_t cls, uint16_t ms) {
+  rtt_t &rtt = _entries[device * RTT::CLASSES + cls];
+  int32_t measured = ms < _ceiling ? ms : _ceiling;
+
+  if (!rtt.samples) {
+    rtt.srtt8 = static_cast<uint16_t>(measured << 3);
+    rtt.rttvar4 = static_cast<uint16_t>(measured << 1);
+  } else {
+    int32_t delta = measured - (rtt.srtt8 >> 3);
+    rtt.srtt8 = static_cast<uint16_t>(rtt.srtt8 + delta);
+    if (delta < 0)
+      delta = -delta;
+    delta -= rtt.rttvar4 >> 2;
+    rtt.rttvar4 = static_cast<uint16_t>(rtt.rttvar4 + delta);
+  }
+
+  if (rtt.samples < 0xFFFF)
+    rtt.samples++;
+  rtt.rto = clamp((rtt.srtt8 >> 3) + rtt.rttvar4);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Double the timeout after it expired.
+        @param    device
+                          Index of the module.
+        @param    cls
+                          RTT::ACK or RTT::QUERY.
+*/
+/**************************************************************************/
+void RttTable::backoff(uint8_t device, uint8_t cls) {
+  rtt_t &rtt = _entries[device * RTT::CLASSES + cls];
+  rtt.rto = clamp(static_cast<uint32_t>(rtt.rto) << 1);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Get the timeout to wait for a reply.
+        @param    device
+                          Index of the module.
+        @param    cls
+                          RTT::ACK or RTT::QUERY.
+        @return Timeout in ms.
+*/
+/**************************************************************************/
+uint16_t RttTable::timeout(uint8_t device, uint8_t cls) const {
+  return _entries[device * RTT::CLASSES + cls].rto;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Bound a timeout to the floor and the ceiling.
+        @param    ms
+                          The timeout.
+        @return The bounded timeout.
+*/
+/**************************************************************************/
+uint16_t RttTable::clamp(uint32_t ms) const {
+  if (ms < _floor)
+    return _floor;
+  if (ms > _ceiling)
+    return _ceiling;
+  return static_cast<uint16_t>(ms);
+}
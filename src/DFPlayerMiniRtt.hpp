@@ -0,0 +1,73 @@
+/*!
+ * @file DFPlayerMiniRtt.hpp
+ *
+ * Round-trip time estimation per module and command class. Every answered
+ * query or ACK feeds a smoothed mean and mean deviation (Jacobson/Karels,
+ * the estimator TCP uses), from which the timeout is derived as
+ * srtt + 4 * rttvar within a floor and a ceiling. A timeout doubles the
+ * current value until the next sample arrives.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_RTT_H__
+#define __DFPLAYERMINI_RTT_H__
+
+#include "DFPlayerMini.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Round-Trip Time Values */
+namespace RTT {
+constexpr uint8_t ACK = 0;           // control command answered by 0x41
+constexpr uint8_t QUERY = 1;         // query answered by its reply
+constexpr uint8_t CLASSES = 2;       // number of command classes
+constexpr uint16_t INITIAL = 100;    // ms timeout before the first sample
+constexpr uint16_t FLOOR = 20;       // ms lower bound of the timeout
+constexpr uint16_t CEILING = 2000;   // ms upper bound of the timeout
+constexpr uint16_t MAX_BOUND = 8000; // ms highest bound srtt8 can hold
+} // namespace RTT
+
+/** Estimate of one module and command class */
+struct rtt_t {
+  uint16_t srtt8;   // smoothed round-trip time in 1/8 ms
+  uint16_t rttvar4; // mean deviation in 1/4 ms
+  uint16_t rto;     // current timeout in ms
+  uint16_t samples; // number of samples taken
+
+  uint16_t srtt() const { return srtt8 >> 3; }
+  uint16_t rttvar() const { return rttvar4 >> 2; }
+};
+
+/**************************************************************************/
+/*!
+        @brief  Round-trip time estimates of a number of modules.
+*/
+/**************************************************************************/
+class RttTable {
+  rtt_t *_entries;
+  uint8_t _devices;
+  uint16_t _floor = RTT::FLOOR;
+  uint16_t _ceiling = RTT::CEILING;
+
+  uint16_t clamp(uint32_t ms) const;
+
+public:
+  RttTable(rtt_t *entries, uint8_t devices);
+
+  static uint8_t classOf(uint8_t cmd);
+
+  void setBounds(uint16_t floor, uint16_t ceiling);
+  void clear();
+  void seed(uint8_t device, uint8_t cls, uint16_t ms);
+
+  void sample(uint8_t device, uint8_t cls, uint16_t ms);
+  void backoff(uint8_t device, uint8_t cls);
+  uint16_t timeout(uint8_t device, uint8_t cls) const;
+  const rtt_t &estimate(uint8_t device, uint8_t cls) const {
+    return _entries[device * RTT::CLASSES + cls];
+  }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
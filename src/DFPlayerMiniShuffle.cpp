@@ -0,0 +1,235 @@
+/*!
+ * @file DFPlayerMiniShuffle.cpp
+ *
+ * Host-side shuffle engine.
+ *
+ */
+
+#include "DFPlayerMiniShuffle.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    segments
+                          Track ranges of the pool, must outlive the shuffle.
+        @param    count
+                          Number of segments.
+        @param    history
+                          Storage for the most recent track indices, may be
+                          nullptr.
+        @param    historySize
+                          Number of entries in history.
+        @param    seed
+                          Seed of the shuffle, not 0.
+*/
+/**************************************************************************/
+Shuffle::Shuffle(const segment_t *segments, uint8_t count, uint16_t *history,
+                 uint8_t historySize, uint32_t seed)
+    : _segments(segments), _count(count), _rng(seed ? seed : 1),
+      _history(history), _historySize(history ? historySize : 0) {
+  uint32_t size = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    if (_segments[i].last >= _segments[i].first)
+      size += _segments[i].last - _segments[i].first + 1;
+  _size = size > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(size);
+
+  // smallest even bit width covering the pool, so both halves are equal
+  while ((1UL << (2 * _halfBits)) < _size)
+    _halfBits++;
+
+  reshuffle();
+}
+
+/**************************************************************************/
+/*!
+        @brief  Start a new round with a fresh permutation whose first
+                tracks were not among the most recent ones, if such a key is
+                found within a few tries.
+*/
+/**************************************************************************/
+void Shuffle::reshuffle() {
+  // only as many leading tracks as there are non-recent ones can be clean
+  uint16_t check = _historyCount;
+  if (_size < 2 * check)
+    check = _size > _historyCount ? _size - _historyCount : 0;
+
+  for (uint8_t attempt = 0; attempt < KEY_TRIES; attempt++) {
+    _key = random();
+
+    bool clean = true;
+    for (uint16_t i = 0; i < check && clean; i++)
+      clean = !recent(permute(i, _key));
+    if (clean)
+      break;
+  }
+
+  _position = 0;
+  _rounds++;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Select the next track of the round, reshuffling once every
+                track has been played.
+        @return Index of the track in the pool.
+*/
+/**************************************************************************/
+uint16_t Shuffle::nextIndex() {
+  if (!_size)
+    return 0;
+
+  if (_position >= _size)
+    reshuffle();
+
+  uint16_t index = permute(_position++, _key);
+
+  if (_historySize) {
+    _history[_historyHead] = index;
+    _historyHead = (_historyHead + 1) % _historySize;
+    if (_historyCount < _historySize)
+      _historyCount++;
+  }
+
+  return index;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Translate a pool index to its folder and track.
+        @param    index
+                          Index in the pool.
+        @param    folder
+                          Set to the folder, 0 for the root.
+        @param    track
+                          Set to the track.
+        @return False if the index is outside the pool.
+*/
+/**************************************************************************/
+bool Shuffle::locate(uint16_t index, uint8_t &folder, uint16_t &track) const {
+  for (uint8_t i = 0; i < _count; i++) {
+    const segment_t &segment = _segments[i];
+    if (segment.last < segment.first)
+      continue;
+
+    uint16_t length = segment.last - segment.first + 1;
+    if (index < length) {
+      folder = segment.folder;
+      track = segment.first + index;
+      return true;
+    }
+    index -= length;
+  }
+
+  return false;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Select the next track and encode the packet playing it:
+                0x03 for the root, 0x0F for up to 255 tracks in a folder and
+                0x14 beyond that.
+        @param    _stack
+                          Set to the packet.
+        @param    feedback
+                          PACKET::FEEDBACK value.
+        @return False if the pool is empty.
+*/
+/**************************************************************************/
+bool Shuffle::next(stack_t &_stack, uint8_t feedback) {
+  uint8_t folder;
+  uint16_t track;
+  if (!_size || !locate(nextIndex(), folder, track))
+    return false;
+
+  if (!folder)
+    DFPlayerMini::encode(_stack, feedback, CONTROLCMD::PLAY_TRACK, track);
+  else if (track <= LIMIT::MAX_FOLDER_TRACK)
+    DFPlayerMini::encode(_stack, feedback, CONTROLCMD::PLAY_FOLDER_TRACK,
+                         folder, track);
+  else
+    DFPlayerMini::encode(_stack, feedback, CONTROLCMD::PLAY_LARGE_FOLDER,
+                         folder, track);
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  xorshift32 generator for the keys.
+        @return Next pseudo random number.
+*/
+/**************************************************************************/
+uint32_t Shuffle::random() {
+  _rng ^= _rng << 13;
+  _rng ^= _rng >> 17;
+  _rng ^= _rng << 5;
+  return _rng;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Balanced Feistel network, a bijection on 2 * _halfBits bits.
+        @param    x
+                          Input.
+        @param    key
+                          Key of the round.
+        @return Output.
+*/
+/**************************************************************************/
+uint32_t Shuffle::feistel(uint32_t x, uint32_t key) const {
+  uint32_t mask = (1UL << _halfBits) - 1;
+  uint32_t left = x >> _halfBits;
+  uint32_t right = x & mask;
+
+  for (uint8_t round = 0; round < ROUNDS; round++) {
+    uint32_t f = right ^ key ^ (round * 0x9E3779B9UL);
+    f ^= f >> 16;
+    f *= 0x85EBCA6BUL;
+    f ^= f >> 13;
+
+    uint32_t next = left ^ (f & mask);
+    left = right;
+    right = next;
+  }
+
+  return (left << _halfBits) | right;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Map a position of the round to a pool index. Cycle walking
+                keeps the result inside the pool; the domain is less than
+                four times the pool, so few steps are needed.
+        @param    position
+                          Position in the round.
+        @param    key
+                          Key of the round.
+        @return Pool index.
+*/
+/**************************************************************************/
+uint16_t Shuffle::permute(uint16_t position, uint32_t key) const {
+  uint32_t x = position;
+  do {
+    x = feistel(x, key);
+  } while (x >= _size);
+
+  return static_cast<uint16_t>(x);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Check whether a track was among the most recent ones.
+        @param    index
+                          Pool index.
+        @return True if it is in the history.
+*/
+/**************************************************************************/
+bool Shuffle::recent(uint16_t index) const {
+  for (uint8_t i = 0; i < _historyCount; i++)
+    if (_history[i] == index)
+      return true;
+
+  return false;
+}
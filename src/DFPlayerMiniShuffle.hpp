@@ -0,0 +1,74 @@
+/*!
+ * @file DFPlayerMiniShuffle.hpp
+ *
+ * Host-side shuffle over a pool of (folder, track) ranges. The module's own
+ * random mode covers the whole card and may repeat; a Shuffle plays every
+ * track of its pool exactly once per round and avoids replaying the most
+ * recent tracks right after a reshuffle.
+ *
+ * The permutation of a round is a keyed Feistel network over the pool
+ * indices with cycle walking, so it costs a few bytes whatever the pool
+ * size (up to 99 folders x 255 tracks + 3000 root tracks) and each next
+ * track is computed in O(1).
+ *
+ */
+
+#ifndef __DFPLAYERMINI_SHUFFLE_H__
+#define __DFPLAYERMINI_SHUFFLE_H__
+
+#include "DFPlayerMini.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Range of tracks in one folder, folder 0 is the root */
+struct segment_t {
+  uint8_t folder;
+  uint16_t first;
+  uint16_t last;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Non-repeating shuffle over one pool of tracks.
+*/
+/**************************************************************************/
+class Shuffle {
+  static constexpr uint8_t ROUNDS = 4;
+  static constexpr uint8_t KEY_TRIES = 8;
+
+  const segment_t *_segments;
+  uint8_t _count;
+  uint16_t _size = 0;
+  uint8_t _halfBits = 1;
+
+  uint32_t _rng;
+  uint32_t _key = 0;
+  uint16_t _position = 0;
+  uint32_t _rounds = 0;
+
+  uint16_t *_history;
+  uint8_t _historySize;
+  uint8_t _historyCount = 0;
+  uint8_t _historyHead = 0;
+
+  uint32_t random();
+  uint32_t feistel(uint32_t x, uint32_t key) const;
+  uint16_t permute(uint16_t position, uint32_t key) const;
+  bool recent(uint16_t index) const;
+
+public:
+  Shuffle(const segment_t *segments, uint8_t count, uint16_t *history = nullptr,
+          uint8_t historySize = 0, uint32_t seed = 1);
+
+  uint16_t size() const { return _size; }
+  uint32_t rounds() const { return _rounds; }
+
+  void reshuffle();
+  uint16_t nextIndex();
+  bool locate(uint16_t index, uint8_t &folder, uint16_t &track) const;
+  bool next(stack_t &_stack, uint8_t feedback = PACKET::FEEDBACK::NO);
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
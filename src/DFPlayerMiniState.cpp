@@ -0,0 +1,150 @@
+/*!
+ * @file DFPlayerMiniState.cpp
+ *
+ * Host-side model of the module state.
+ *
+ */
+
+#include "DFPlayerMiniState.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Update the state from a packet sent to the module.
+        @param    _stack
+                          The packet sent.
+*/
+/**************************************************************************/
+void PlaybackState::observeSent(const stack_t &_stack) {
+  uint16_t first, second;
+  DFPlayerMini::decode(_stack, first, second);
+
+  switch (_stack.command) {
+  case CONTROLCMD::PLAY_TRACK:
+  case CONTROLCMD::PLAY_FOLDER_TRACK:
+  case CONTROLCMD::PLAY_MP3_FOLDER:
+  case CONTROLCMD::PLAY_LARGE_FOLDER:
+    trackCmd = _stack.command;
+    trackFirst = first;
+    trackSecond = second;
+    status = PLAYBACK::PLAYING;
+    advert = false;
+    break;
+  case CONTROLCMD::PLAY_NEXT:
+  case CONTROLCMD::PLAY_PREV: {
+    uint16_t &track = trackCmd == CONTROLCMD::PLAY_TRACK ||
+                              trackCmd == CONTROLCMD::PLAY_MP3_FOLDER
+                          ? trackFirst
+                          : trackSecond;
+    if (_stack.command == CONTROLCMD::PLAY_NEXT)
+      track++;
+    else if (track > 1)
+      track--;
+    status = PLAYBACK::PLAYING;
+    advert = false;
+    break;
+  }
+  case CONTROLCMD::PLAY:
+    status = PLAYBACK::PLAYING;
+    break;
+  case CONTROLCMD::PAUSE:
+    status = PLAYBACK::PAUSED;
+    break;
+  case CONTROLCMD::STOP:
+    status = PLAYBACK::STOPPED;
+    advert = false;
+    break;
+  case CONTROLCMD::INSERT_ADVERT:
+    advert = status == PLAYBACK::PLAYING;
+    break;
+  case CONTROLCMD::STOP_ADVERT:
+    advert = false;
+    break;
+  case CONTROLCMD::INC_VOL:
+    volume = volume < LIMIT::MAX_VOLUME ? volume + 1 : volume;
+    break;
+  case CONTROLCMD::DEC_VOL:
+    volume = volume > LIMIT::MIN_VOLUME ? volume - 1 : volume;
+    break;
+  case CONTROLCMD::SET_VOL:
+    volume = static_cast<uint8_t>(first);
+    break;
+  case CONTROLCMD::SET_EQ:
+    eq = static_cast<uint8_t>(first);
+    break;
+  case CONTROLCMD::SET_PLAYBACK_MODE:
+    mode = static_cast<uint8_t>(first);
+    break;
+  case CONTROLCMD::SET_PLAYBACK_SRC:
+    source = static_cast<uint8_t>(first);
+    if (source == PLAYBACK_SRC::SLEEP)
+      status = PLAYBACK::STOPPED;
+    break;
+  case CONTROLCMD::MODE_STANDBY:
+    status = PLAYBACK::STOPPED;
+    break;
+  case CONTROLCMD::MODE_RESET:
+    clear();
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Update the state from a packet received from the module.
+        @param    _stack
+                          The packet received.
+*/
+/**************************************************************************/
+void PlaybackState::observeReceived(const stack_t &_stack) {
+  switch (_stack.command) {
+  case REPORT::U_FINISHED:
+  case REPORT::TF_FINISHED:
+  case REPORT::FLASH_FINISHED:
+    if (advert)
+      advert = false;
+    else
+      status = PLAYBACK::STOPPED;
+    break;
+  case QUERYCMD::SEND_INIT:
+    clear();
+    break;
+  case QUERYCMD::GET_STATUS_:
+    status = _stack.paramLSB <= PLAYBACK::PAUSED ? _stack.paramLSB
+                                                 : PLAYBACK::STOPPED;
+    break;
+  case QUERYCMD::GET_VOL:
+    volume = _stack.paramLSB;
+    break;
+  case QUERYCMD::GET_EQ:
+    eq = _stack.paramLSB;
+    break;
+  case QUERYCMD::GET_MODE:
+    mode = _stack.paramLSB;
+    break;
+  default:
+    break;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Return to the state of a freshly reset module.
+*/
+/**************************************************************************/
+void PlaybackState::clear() { *this = PlaybackState(); }
+
+/**************************************************************************/
+/*!
+        @brief  Encode the command that selects the current track again.
+        @param    player
+                          Encoder receiving the packet.
+*/
+/**************************************************************************/
+void PlaybackState::selectTrack(DFPlayerMini &player) const {
+  if (trackCmd)
+    player.command(trackCmd, trackFirst, trackSecond);
+}
@@ -0,0 +1,61 @@
+/*!
+ * @file DFPlayerMiniState.hpp
+ *
+ * Host-side model of what a module is doing, kept up to date from the
+ * packets sent to it and received from it. Used wherever the library has to
+ * restore or reason about playback without asking the module.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_STATE_H__
+#define __DFPLAYERMINI_STATE_H__
+
+#include "DFPlayerMini.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Playback Status Values (same encoding as the GET_STATUS_ reply LSB) */
+namespace PLAYBACK {
+constexpr uint8_t STOPPED = 0;
+constexpr uint8_t PLAYING = 1;
+constexpr uint8_t PAUSED = 2;
+} // namespace PLAYBACK
+
+/** Module settings after power-up or reset */
+namespace DEFAULTS {
+constexpr uint8_t VOLUME = LIMIT::MAX_VOLUME;
+constexpr uint8_t EQUALIZER = EQ::NORMAL;
+constexpr uint8_t MODE = PLAYBACK_MODE::REPEAT;
+constexpr uint8_t SOURCE = PLAYBACK_SRC::TF;
+} // namespace DEFAULTS
+
+/**************************************************************************/
+/*!
+        @brief  Tracked state of one module.
+*/
+/**************************************************************************/
+class PlaybackState {
+public:
+  uint8_t status = PLAYBACK::STOPPED;
+  uint8_t volume = DEFAULTS::VOLUME;
+  uint8_t eq = DEFAULTS::EQUALIZER;
+  uint8_t mode = DEFAULTS::MODE;
+  uint8_t source = DEFAULTS::SOURCE;
+  bool advert = false; // an advert interrupts the track
+
+  /** Command that selected the current track, 0 if none */
+  uint8_t trackCmd = 0;
+  uint16_t trackFirst = 0;  // track, or folder for two-part addresses
+  uint16_t trackSecond = 0; // track in the folder
+
+  void observeSent(const stack_t &_stack);
+  void observeReceived(const stack_t &_stack);
+  void clear();
+
+  bool playing() const { return status == PLAYBACK::PLAYING; }
+  void selectTrack(DFPlayerMini &player) const;
+};
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,153 @@
+/*!
+ * @file DFPlayerMiniTrace.cpp
+ *
+ * Per-frame tracing and Chrome trace-event export.
+ *
+ */
+
+#include "DFPlayerMiniTrace.hpp"
+
+#if defined(DFPLAYERMINI_TRACE) && defined(__linux__)
+
+#include <string.h>
+#include <time.h>
+
+using namespace DFPLAYERMINI;
+
+std::atomic<bool> Trace::_enabled(false);
+std::atomic<uint8_t> Trace::_threads(0);
+TraceBuffer *Trace::_buffers[TRACE::MAX_THREADS];
+thread_local TraceBuffer *Trace::_current = nullptr;
+
+namespace {
+const char *const NAMES[TRACE::KINDS] = {
+    "enqueue", "coalesce", "pacing", "tx",      "ack",
+    "reply",   "report",   "error",  "timeout", "reset"};
+} // namespace
+
+/**************************************************************************/
+/*!
+        @brief  Record the calling thread's events into a buffer. The buffer
+                must outlive the last write().
+        @param    buffer
+                          The buffer.
+        @return False if TRACE::MAX_THREADS buffers are attached already.
+*/
+/**************************************************************************/
+bool Trace::attach(TraceBuffer &buffer) {
+  uint8_t index = _threads.load(std::memory_order_relaxed);
+  do {
+    if (index >= TRACE::MAX_THREADS)
+      return false;
+  } while (!_threads.compare_exchange_weak(index, index + 1,
+                                           std::memory_order_relaxed));
+
+  buffer._thread = index + 1;
+  _buffers[index] = &buffer;
+  _current = &buffer;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Trace clock.
+        @return CLOCK_MONOTONIC in ns.
+*/
+/**************************************************************************/
+uint64_t Trace::clock() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Export all attached buffers as Chrome trace-event JSON. Each
+                module is shown as a process, each recording thread as one
+                of its threads. Call while no thread is recording.
+        @param    file
+                          The output file.
+        @return False on a write error.
+*/
+/**************************************************************************/
+bool Trace::write(FILE *file) {
+  uint8_t threads = _threads.load(std::memory_order_acquire);
+  uint64_t origin = UINT64_MAX;
+  uint32_t dropped = 0;
+
+  for (uint8_t t = 0; t < threads; t++) {
+    const TraceBuffer &buffer = *_buffers[t];
+    dropped += buffer._dropped;
+    for (uint32_t i = 0; i < buffer._count; i++)
+      if (buffer._records[i].start < origin)
+        origin = buffer._records[i].start;
+  }
+
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%u},"
+                "\"traceEvents\":[\n",
+          dropped);
+
+  bool first = true;
+  static uint8_t named[(TRACE::NO_DEVICE + 8) / 8];
+  memset(named, 0, sizeof(named));
+  for (uint8_t t = 0; t < threads; t++) {
+    const TraceBuffer &buffer = *_buffers[t];
+
+    for (uint32_t i = 0; i < buffer._count; i++) {
+      const trace_record_t &rec = buffer._records[i];
+      uint32_t pid = rec.device == TRACE::NO_DEVICE ? 0 : rec.device + 1u;
+      const char *name = rec.kind < TRACE::KINDS ? NAMES[rec.kind] : "?";
+
+      if (!(named[pid / 8] & (1u << (pid % 8)))) {
+        named[pid / 8] |= 1u << (pid % 8);
+        if (pid)
+          fprintf(file,
+                  "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+                  "\"args\":{\"name\":\"device %u\"}}",
+                  first ? "" : ",\n", pid, pid - 1);
+        else
+          fprintf(file,
+                  "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                  "\"args\":{\"name\":\"host\"}}",
+                  first ? "" : ",\n");
+        first = false;
+      }
+
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"cat\":\"dfplayer\",\"pid\":%u,\"tid\":%u,"
+              "\"ts\":%.3f,",
+              first ? "" : ",\n", name, pid, buffer._thread,
+              (rec.start - origin) / 1000.0);
+      if (rec.duration)
+        fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,", rec.duration / 1000.0);
+      else
+        fprintf(file, "\"ph\":\"i\",\"s\":\"t\",");
+      fprintf(file,
+              "\"args\":{\"cmd\":\"0x%02X\",\"param\":%u,\"count\":%u}}",
+              rec.cmd, rec.param, rec.count);
+      first = false;
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+  return !ferror(file);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Export all attached buffers to a file.
+        @param    path
+                          Path of the JSON file.
+        @return False if the file could not be written.
+*/
+/**************************************************************************/
+bool Trace::write(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  bool ok = write(file);
+  return fclose(file) == 0 && ok;
+}
+
+#endif // DFPLAYERMINI_TRACE && __linux__
@@ -0,0 +1,159 @@
+/*!
+ * @file DFPlayerMiniTrace.hpp
+ *
+ * Optional per-frame tracing: enqueue, coalescing, pacing waits, wire
+ * writes, answers from the modules, timeouts and resets are recorded into
+ * preallocated per-thread buffers and exported in the Chrome trace-event
+ * JSON format, which Perfetto (ui.perfetto.dev) and chrome://tracing open.
+ *
+ * Build with -DDFPLAYERMINI_TRACE to compile the hooks in; without it every
+ * DFPLAYERMINI_TRACE_* macro expands to nothing. With it, a disabled tracer
+ * or a thread without a buffer costs one relaxed load per hook.
+ *
+ * Linux only.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_TRACE_H__
+#define __DFPLAYERMINI_TRACE_H__
+
+#include <stdint.h>
+
+/** Kinds of trace records */
+namespace DFPLAYERMINI {
+namespace TRACE {
+constexpr uint8_t ENQUEUE = 0;  // span: request encoded into a queue
+constexpr uint8_t COALESCE = 1; // instant: packets gathered into one write
+constexpr uint8_t PACING = 2;   // span: request waited for the link
+constexpr uint8_t TX = 3;       // span: packets written to the transport
+constexpr uint8_t ACK = 4;      // instant: module acknowledged
+constexpr uint8_t REPLY = 5;    // instant: module answered a query
+constexpr uint8_t REPORT = 6;   // instant: unsolicited packet
+constexpr uint8_t ERROR = 7;    // instant: module asked for a retransmit
+constexpr uint8_t TIMEOUT = 8;  // instant: no answer in time
+constexpr uint8_t RESET = 9;    // instant: watchdog reset the module
+constexpr uint8_t KINDS = 10;
+
+constexpr uint16_t NO_DEVICE = 0xFFFF; // record not tied to one module
+constexpr uint8_t MAX_THREADS = 64;    // buffers attached at once
+
+/** Swallows the arguments of disabled hooks */
+template <class... Args> inline void ignore(const Args &...) {}
+} // namespace TRACE
+} // namespace DFPLAYERMINI
+
+#if defined(DFPLAYERMINI_TRACE) && defined(__linux__)
+
+#include <atomic>
+#include <stdio.h>
+
+namespace DFPLAYERMINI {
+
+/** One trace record, times in ns of CLOCK_MONOTONIC */
+struct trace_record_t {
+  uint64_t start;
+  uint32_t duration; // 0 for instant records
+  uint16_t device;   // TRACE::NO_DEVICE if not tied to a module
+  uint8_t kind;      // TRACE value
+  uint8_t cmd;       // command ID
+  uint16_t param;    // packet parameter
+  uint16_t count;    // packets covered by the record
+};
+
+/**************************************************************************/
+/*!
+        @brief  Records of one thread, in caller-provided storage. Records
+                past the capacity are counted and dropped.
+*/
+/**************************************************************************/
+class TraceBuffer {
+  trace_record_t *_records;
+  uint32_t _capacity;
+  uint32_t _count = 0;
+  uint32_t _dropped = 0;
+  uint8_t _thread = 0;
+
+  friend class Trace;
+
+public:
+  TraceBuffer(trace_record_t *records, uint32_t capacity)
+      : _records(records), _capacity(capacity) {}
+
+  void add(uint8_t kind, uint64_t start, uint32_t duration, uint16_t device,
+           uint8_t cmd, uint16_t param, uint16_t count) {
+    if (_count >= _capacity) {
+      _dropped++;
+      return;
+    }
+    _records[_count++] = {start, duration, device, kind, cmd, param, count};
+  }
+
+  uint32_t count() const { return _count; }
+  uint32_t dropped() const { return _dropped; }
+  void clear() { _count = _dropped = 0; }
+};
+
+/**************************************************************************/
+/*!
+        @brief  Process-wide switch, buffer registry and exporter.
+*/
+/**************************************************************************/
+class Trace {
+  static std::atomic<bool> _enabled;
+  static std::atomic<uint8_t> _threads;
+  static TraceBuffer *_buffers[TRACE::MAX_THREADS];
+  static thread_local TraceBuffer *_current;
+
+public:
+  static void enable(bool on) {
+    _enabled.store(on, std::memory_order_relaxed);
+  }
+  static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+  static bool attach(TraceBuffer &buffer);
+  static uint64_t clock();
+
+  /** Buffer of the calling thread while tracing, else nullptr */
+  static TraceBuffer *current() { return enabled() ? _current : nullptr; }
+
+  /** Start time of a span, 0 while not tracing */
+  static uint64_t begin() { return current() ? clock() : 0; }
+
+  static void span(uint8_t kind, uint64_t start, uint16_t device, uint8_t cmd,
+                   uint16_t param = 0, uint16_t count = 1) {
+    TraceBuffer *buffer = current();
+    if (!buffer || !start)
+      return;
+
+    uint32_t duration = static_cast<uint32_t>(clock() - start);
+    buffer->add(kind, start, duration ? duration : 1, device, cmd, param,
+                count);
+  }
+
+  static void instant(uint8_t kind, uint16_t device, uint8_t cmd,
+                      uint16_t param = 0, uint16_t count = 1) {
+    if (TraceBuffer *buffer = current())
+      buffer->add(kind, clock(), 0, device, cmd, param, count);
+  }
+
+  static bool write(FILE *file);
+  static bool write(const char *path);
+};
+
+} // namespace DFPLAYERMINI
+
+#define DFPLAYERMINI_TRACE_BEGIN() DFPLAYERMINI::Trace::begin()
+#define DFPLAYERMINI_TRACE_SPAN(...) DFPLAYERMINI::Trace::span(__VA_ARGS__)
+#define DFPLAYERMINI_TRACE_INSTANT(...)                                        \
+  DFPLAYERMINI::Trace::instant(__VA_ARGS__)
+
+#else
+
+#define DFPLAYERMINI_TRACE_BEGIN() 0
+#define DFPLAYERMINI_TRACE_SPAN(...) DFPLAYERMINI::TRACE::ignore(__VA_ARGS__)
+#define DFPLAYERMINI_TRACE_INSTANT(...)                                        \
+  DFPLAYERMINI::TRACE::ignore(__VA_ARGS__)
+
+#endif // DFPLAYERMINI_TRACE && __linux__
+
+#endif
@@ -0,0 +1,62 @@
+/*!
+ * @file DFPlayerMiniTransport.cpp
+ *
+ * File descriptor transport.
+ *
+ */
+
+#include "DFPlayerMiniTransport.hpp"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Write a buffer with one system call.
+        @param    buf
+                          The bytes.
+        @param    len
+                          Number of bytes.
+        @return Number of bytes written, 0 on error.
+*/
+/**************************************************************************/
+size_t FdTransport::write(const uint8_t *buf, size_t len) {
+  ssize_t written;
+  do {
+    written = ::write(_fd, buf, len);
+  } while (written < 0 && errno == EINTR);
+
+  return written < 0 ? 0 : static_cast<size_t>(written);
+}
+
+/**************************************************************************/
+/*!
+        @brief  Write several buffers with one system call.
+        @param    spans
+                          The buffers.
+        @param    count
+                          Number of buffers.
+        @return Number of bytes written, 0 on error.
+*/
+/**************************************************************************/
+size_t FdTransport::writev(const span_t *spans, uint8_t count) {
+  struct iovec iov[UINT8_MAX];
+  for (uint8_t i = 0; i < count; i++) {
+    iov[i].iov_base = const_cast<uint8_t *>(spans[i].data);
+    iov[i].iov_len = spans[i].len;
+  }
+
+  ssize_t written;
+  do {
+    written = ::writev(_fd, iov, count);
+  } while (written < 0 && errno == EINTR);
+
+  return written < 0 ? 0 : static_cast<size_t>(written);
+}
+
+#endif // __linux__
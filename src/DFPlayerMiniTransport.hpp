@@ -0,0 +1,102 @@
+/*!
+ * @file DFPlayerMiniTransport.hpp
+ *
+ * Minimal byte sink used by the parts of the library that write packets on
+ * their own (group commands, schedulers, ...). DFPlayerMini itself only
+ * encodes packets and stays independent from any serial API.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_TRANSPORT_H__
+#define __DFPLAYERMINI_TRANSPORT_H__
+
+#include "DFPlayerMini.hpp"
+
+#include <stddef.h>
+
+namespace DFPLAYERMINI {
+
+/** Transport Values */
+namespace TRANSPORT {
+constexpr uint8_t MAX_SPANS = 16; // buffers in one gathered write
+} // namespace TRANSPORT
+
+/** Function returning a free running timestamp, e.g. micros() or millis() */
+typedef uint32_t (*clock_fn_t)();
+
+/** One buffer of a gathered write */
+struct span_t {
+  const uint8_t *data;
+  size_t len;
+};
+
+/**************************************************************************/
+/*!
+        @brief  Abstract port a module is connected to.
+*/
+/**************************************************************************/
+class Transport {
+public:
+  /** Write len bytes, return the number of bytes accepted */
+  virtual size_t write(const uint8_t *buf, size_t len) = 0;
+  /** Number of bytes that can be written without blocking */
+  virtual size_t availableForWrite() { return PACKET::SIZE; }
+  /** Write several buffers back to back, return the number of bytes
+   * accepted. Override where the port can gather in one call. */
+  virtual size_t writev(const span_t *spans, uint8_t count) {
+    size_t total = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      size_t written = write(spans[i].data, spans[i].len);
+      total += written;
+      if (written < spans[i].len)
+        break;
+    }
+    return total;
+  }
+};
+
+/**************************************************************************/
+/*!
+        @brief  Transport forwarding to any Arduino style stream, e.g.
+                HardwareSerial or SoftwareSerial.
+*/
+/**************************************************************************/
+template <class S> class StreamTransport : public Transport {
+  S &_stream;
+
+public:
+  explicit StreamTransport(S &stream) : _stream(stream) {}
+
+  size_t write(const uint8_t *buf, size_t len) override {
+    return _stream.write(buf, len);
+  }
+  size_t availableForWrite() override {
+    // Print::availableForWrite() returns 0 where the stream cannot tell,
+    // e.g. SoftwareSerial, which writes blocking anyway
+    int free = _stream.availableForWrite();
+    return free > 0 ? static_cast<size_t>(free)
+                    : Transport::availableForWrite();
+  }
+};
+
+#if defined(__linux__)
+/**************************************************************************/
+/*!
+        @brief  Transport writing to a file descriptor, e.g. an opened tty.
+                Gathered writes map to a single writev().
+*/
+/**************************************************************************/
+class FdTransport : public Transport {
+  int _fd;
+
+public:
+  explicit FdTransport(int fd) : _fd(fd) {}
+
+  size_t write(const uint8_t *buf, size_t len) override;
+  size_t writev(const span_t *spans, uint8_t count) override;
+};
+#endif
+
+} // namespace DFPLAYERMINI
+
+#endif
@@ -0,0 +1,223 @@
+/*!
+ * @file DFPlayerMiniWatchdog.cpp
+ *
+ * Health watchdog with reset and state replay.
+ *
+ */
+
+#include "DFPlayerMiniWatchdog.hpp"
+#include "DFPlayerMiniTrace.hpp"
+
+using namespace DFPLAYERMINI;
+
+/**************************************************************************/
+/*!
+        @brief  Class constructor
+        @param    state
+                          Tracked state of the module.
+        @param    link
+                          Pacer of the module's link.
+        @param    feedback
+                          Policy of which replayed packets require the module to
+                          give feedback.
+*/
+/**************************************************************************/
+Watchdog::Watchdog(PlaybackState &state, Pacer &link, FeedbackPolicy feedback)
+    : _state(state), _link(link), _player(feedback) {}
+
+/**************************************************************************/
+/*!
+        @brief  Set how many failures in a row mark the module unresponsive.
+        @param    misses
+                          Expected replies that did not arrive.
+        @param    busy
+                          Busy errors received.
+*/
+/**************************************************************************/
+void Watchdog::setLimits(uint8_t misses, uint8_t busy) {
+  _maxMisses = misses ? misses : 1;
+  _maxBusy = busy ? busy : 1;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Observe a packet sent to the module by the application.
+                Queries and, unless the module ignores the feedback bit,
+                packets requesting feedback expect an answer.
+        @param    _stack
+                          The packet sent.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void Watchdog::sent(const stack_t &_stack, uint32_t now) {
+  if (_pending)
+    return;
+
+  if (_stack.command >= QUERYCMD::GET_STATUS_ ||
+      (_acks && _stack.feedback == PACKET::FEEDBACK::YES)) {
+    _pending = true;
+    _waitingSince = now;
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Observe a packet received from the module.
+        @param    _stack
+                          The packet received.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void Watchdog::notify(const stack_t &_stack, uint32_t now) {
+  if (_stack.command == QUERYCMD::RETRANSMIT &&
+      _stack.paramLSB == ERROR_CODE::BUSY) {
+    if (_busy < 0xFF)
+      _busy++;
+  } else {
+    _busy = 0;
+  }
+
+  _pending = false;
+  _misses = 0;
+
+  if (_phase == WAITING_INIT && _stack.command == QUERYCMD::SEND_INIT) {
+    _state.observeReceived(_stack);
+    replay();
+    if (!_stepCount)
+      recovered(now);
+  }
+}
+
+/**************************************************************************/
+/*!
+        @brief  Check the module's health and produce the next recovery
+                packet, if the link is free. Other packet producers should
+                hold back while recovering() is true.
+        @param    now
+                          Current time in ms.
+        @param    _stack
+                          Set to the packet to send.
+        @return True if a packet was produced.
+*/
+/**************************************************************************/
+bool Watchdog::poll(uint32_t now, stack_t &_stack) {
+  switch (_phase) {
+  case MONITORING:
+    if (_pending && now - _waitingSince >= _timeout) {
+      _pending = false;
+      if (_misses < 0xFF)
+        _misses++;
+      DFPLAYERMINI_TRACE_INSTANT(TRACE::TIMEOUT, TRACE::NO_DEVICE, 0,
+                                 _misses);
+    }
+    if (_misses < _maxMisses && _busy < _maxBusy)
+      return false;
+
+    _saved = _state;
+    _detectedAt = now;
+    _stats.failures++;
+    _phase = RESETTING;
+    break;
+  case WAITING_INIT:
+    if (now - _resetAt < _initTimeout)
+      return false;
+    _phase = RESETTING;
+    break;
+  default:
+    break;
+  }
+
+  if (!_link.ready(now))
+    return false;
+
+  if (_phase == RESETTING) {
+    _player.reset();
+    _player.getStack(_stack);
+    _state.observeSent(_stack);
+    _link.sent(now);
+
+    _resetAt = now;
+    _stats.resets++;
+    DFPLAYERMINI_TRACE_INSTANT(TRACE::RESET, TRACE::NO_DEVICE,
+                               CONTROLCMD::MODE_RESET, _stats.resets);
+    _phase = WAITING_INIT;
+    return true;
+  }
+
+  const step_t &step = _steps[_stepIndex++];
+  _player.command(step.cmd, step.first, step.second);
+  _player.getStack(_stack);
+  _state.observeSent(_stack);
+  _link.sent(now);
+
+  if (_stepIndex >= _stepCount)
+    recovered(now);
+
+  return true;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Append a packet to the replay sequence.
+        @param    cmd
+                          The command ID.
+        @param    first
+                          The word, folder or MSB parameter.
+        @param    second
+                          The track or LSB parameter.
+*/
+/**************************************************************************/
+void Watchdog::addStep(uint8_t cmd, uint16_t first, uint16_t second) {
+  if (_stepCount < MAX_STEPS)
+    _steps[_stepCount++] = {cmd, first, second};
+}
+
+/**************************************************************************/
+/*!
+        @brief  Plan the packets restoring the state saved at detection.
+*/
+/**************************************************************************/
+void Watchdog::replay() {
+  _stepCount = 0;
+  _stepIndex = 0;
+
+  if (_saved.source != DEFAULTS::SOURCE)
+    addStep(CONTROLCMD::SET_PLAYBACK_SRC, _saved.source);
+  if (_saved.volume != DEFAULTS::VOLUME)
+    addStep(CONTROLCMD::SET_VOL, _saved.volume);
+  if (_saved.eq != DEFAULTS::EQUALIZER)
+    addStep(CONTROLCMD::SET_EQ, _saved.eq);
+  if (_saved.mode != DEFAULTS::MODE)
+    addStep(CONTROLCMD::SET_PLAYBACK_MODE, _saved.mode);
+  if (_saved.status != PLAYBACK::STOPPED && _saved.trackCmd) {
+    addStep(_saved.trackCmd, _saved.trackFirst, _saved.trackSecond);
+    if (_saved.status == PLAYBACK::PAUSED)
+      addStep(CONTROLCMD::PAUSE);
+  }
+
+  _phase = REPLAYING;
+}
+
+/**************************************************************************/
+/*!
+        @brief  Record the end of a recovery.
+        @param    now
+                          Current time in ms.
+*/
+/**************************************************************************/
+void Watchdog::recovered(uint32_t now) {
+  uint32_t duration = now - _detectedAt;
+
+  _stats.recoveries++;
+  _stats.lastRecovery = duration;
+  _stats.totalRecovery += duration;
+  if (duration > _stats.maxRecovery)
+    _stats.maxRecovery = duration;
+
+  _phase = MONITORING;
+  _pending = false;
+  _misses = 0;
+  _busy = 0;
+}
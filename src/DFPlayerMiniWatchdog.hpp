@@ -0,0 +1,103 @@
+/*!
+ * @file DFPlayerMiniWatchdog.hpp
+ *
+ * Health watchdog for one module. A module that stops answering, or keeps
+ * answering with the busy error, is reset; once it has sent its 0x3F init
+ * frame the last known source, volume, EQ, mode and track are replayed,
+ * skipping every setting that already equals the power-up default. The
+ * module cannot seek, so playback restarts at the beginning of the track.
+ *
+ */
+
+#ifndef __DFPLAYERMINI_WATCHDOG_H__
+#define __DFPLAYERMINI_WATCHDOG_H__
+
+#include "DFPlayerMiniPacer.hpp"
+#include "DFPlayerMiniState.hpp"
+
+namespace DFPLAYERMINI {
+
+/** Watchdog Values */
+namespace WATCHDOG {
+constexpr uint16_t TIMEOUT = 500;      // ms until an expected reply counts missing
+constexpr uint8_t MAX_MISSES = 3;      // missing replies in a row
+constexpr uint8_t MAX_BUSY = 3;        // busy errors in a row
+constexpr uint16_t INIT_TIMEOUT = 3000; // ms to wait for 0x3F before resetting again
+} // namespace WATCHDOG
+
+/** Watchdog statistics, recovery times in ms */
+struct watchdog_stats_t {
+  uint32_t failures;      // lock-ups detected
+  uint32_t recoveries;    // lock-ups recovered from
+  uint32_t resets;        // reset packets sent
+  uint32_t lastRecovery;  // detection to last replayed packet
+  uint32_t maxRecovery;   //
+  uint32_t totalRecovery; // sum, divide by recoveries for the MTTR
+};
+
+/**************************************************************************/
+/*!
+        @brief  Detects an unresponsive module and brings it back.
+*/
+/**************************************************************************/
+class Watchdog {
+  /** One packet of the replay sequence */
+  struct step_t {
+    uint8_t cmd;
+    uint16_t first;
+    uint16_t second;
+  };
+
+  static constexpr uint8_t MAX_STEPS = 6;
+
+  enum : uint8_t { MONITORING, RESETTING, WAITING_INIT, REPLAYING };
+
+  PlaybackState &_state;
+  Pacer &_link;
+  DFPlayerMini _player;
+
+  uint16_t _timeout = WATCHDOG::TIMEOUT;
+  uint8_t _maxMisses = WATCHDOG::MAX_MISSES;
+  uint8_t _maxBusy = WATCHDOG::MAX_BUSY;
+  uint16_t _initTimeout = WATCHDOG::INIT_TIMEOUT;
+  bool _acks = true; // the module acknowledges feedback packets
+
+  uint8_t _phase = MONITORING;
+  bool _pending = false;
+  uint32_t _waitingSince = 0;
+  uint8_t _misses = 0;
+  uint8_t _busy = 0;
+
+  PlaybackState _saved;
+  uint32_t _detectedAt = 0;
+  uint32_t _resetAt = 0;
+
+  step_t _steps[MAX_STEPS];
+  uint8_t _stepCount = 0;
+  uint8_t _stepIndex = 0;
+
+  watchdog_stats_t _stats = {0, 0, 0, 0, 0, 0};
+
+  void addStep(uint8_t cmd, uint16_t first = 0, uint16_t second = 0);
+  void replay();
+  void recovered(uint32_t now);
+
+public:
+  Watchdog(PlaybackState &state, Pacer &link, FeedbackPolicy feedback = false);
+
+  void setTimeout(uint16_t threshold) { _timeout = threshold; }
+  void setLimits(uint8_t misses, uint8_t busy);
+  void setInitTimeout(uint16_t threshold) { _initTimeout = threshold; }
+  void setAcks(bool acks) { _acks = acks; }
+
+  void sent(const stack_t &_stack, uint32_t now);
+  void notify(const stack_t &_stack, uint32_t now);
+  bool poll(uint32_t now, stack_t &_stack);
+
+  bool recovering() const { return _phase != MONITORING; }
+  const watchdog_stats_t &getStats() const { return _stats; }
+};
+
+} // namespace DFPLAYERMINI
+
+#endif